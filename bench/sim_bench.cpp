@@ -0,0 +1,298 @@
+// Headless solver throughput benchmark. Loads a scene, runs a
+// fixed number of steps and reports timing plus a checksum of the final
+// particle positions so that runs can be compared for equality.
+//
+// Usage: sim_bench [-f scene] [-n steps] [-h timestep] [-t threads] [-s]
+//                  [-k scalar|sse2|avx2] [-c] [-b]
+//                  [-w record.log | -r replay.log]
+//                  [-L restore.ckpt] [-S save.ckpt]
+//                  [-C cache.bin] [-F frames.bin] [-K interval]
+//                  [-p interval] [-o stats.csv]
+//
+// -f loads a scene file (see SceneFile.h) instead of the default scene.
+//
+// -t sets the worker count (default: hardware concurrency) and -s steps the
+// bodies one after another instead of concurrently (which they only do if
+// there are at least as many bodies as workers). -k caps the collision
+// kernel instruction set (default: the widest the CPU supports) and -c runs
+// one pass per collider instead of the fused collision pass. -b tests
+// every body against every collider instead of using the broadphase.
+//
+// -w records the run's inputs and -r replays a log recorded here or by the
+// viewer (Project RESOURCE_DIR -w record.log). A replay runs every step in
+// the log, ignoring -n and -h, and ends with the same checksum as the
+// recording.
+//
+// -L restores a checkpoint before stepping and -S saves one after the last
+// step. Saving after n steps and restoring it for m more steps gives the
+// same checksum as running n + m steps. -L cannot be combined with -w or -r.
+//
+// -C streams every step's body positions and elements to a chunked cache
+// file for offline inspection. -F records them in the fixed-layout frame
+// file that the viewer plays back (Project RESOURCE_DIR -p frames.bin),
+// with the element lists in frames.bin.ele. -K keeps only every
+// interval-th step in either.
+//
+// With a PROFILE build, -p dumps per-phase step times every interval steps
+// (to stderr, or to the CSV file given by -o) and a summary is printed at
+// the end.
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Scene.h"
+#include "Cloth.h"
+#include "SoftBody.h"
+#include "ParticleStore.h"
+#include "CollisionKernels.h"
+#include "SimCache.h"
+#include "FrameFile.h"
+
+using namespace std;
+
+// FNV-1a over the raw bytes of every particle position
+static uint64_t hashPositions(const ParticleStore &particles, uint64_t hash)
+{
+	const unsigned char *bytes = (const unsigned char *)particles.x.data();
+	size_t n = particles.x.size() * sizeof(Eigen::Vector3d);
+	for (size_t i = 0; i < n; i++) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+static uint64_t checksum(const Scene &scene)
+{
+	uint64_t hash = 14695981039346656037ull;
+	for (auto cloth : scene.getCloths()) {
+		hash = hashPositions(cloth->getParticles(), hash);
+	}
+	for (auto softBody : scene.getSoftBodies()) {
+		hash = hashPositions(softBody->getParticles(), hash);
+	}
+	return hash;
+}
+
+static void usage(const char *argv0)
+{
+	cout << "Usage: " << argv0 << " [-f scene] [-n steps] [-h timestep] [-t threads] [-s] [-k scalar|sse2|avx2] [-c] [-b] [-w record.log | -r replay.log] [-L restore.ckpt] [-S save.ckpt] [-C cache.bin] [-F frames.bin] [-K interval] [-p interval] [-o stats.csv]" << endl;
+}
+
+int main(int argc, char **argv)
+{
+	string scenePath;
+	int steps = 1000;
+	double h = 0.0;
+	int threads = 0;
+	bool serialBodies = false;
+	SimdLevel simdLevel = CollisionKernels::getSupportedLevel();
+	bool perCollider = false;
+	bool allColliders = false;
+	string recordPath;
+	string replayPath;
+	string restorePath;
+	string savePath;
+	string cachePath;
+	string framesPath;
+	int cacheInterval = 1;
+	int statsInterval = 0;
+	string statsPath;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+			scenePath = argv[++i];
+		}
+		else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+			steps = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-h") == 0 && i + 1 < argc) {
+			h = atof(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+			threads = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-s") == 0) {
+			serialBodies = true;
+		}
+		else if (strcmp(argv[i], "-k") == 0 && i + 1 < argc) {
+			const char *name = argv[++i];
+			if (strcmp(name, "scalar") == 0) {
+				simdLevel = SIMD_SCALAR;
+			}
+			else if (strcmp(name, "sse2") == 0) {
+				simdLevel = SIMD_SSE2;
+			}
+			else if (strcmp(name, "avx2") == 0) {
+				simdLevel = SIMD_AVX2;
+			}
+			else {
+				usage(argv[0]);
+				return 1;
+			}
+		}
+		else if (strcmp(argv[i], "-c") == 0) {
+			perCollider = true;
+		}
+		else if (strcmp(argv[i], "-b") == 0) {
+			allColliders = true;
+		}
+		else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc) {
+			recordPath = argv[++i];
+		}
+		else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+			replayPath = argv[++i];
+		}
+		else if (strcmp(argv[i], "-L") == 0 && i + 1 < argc) {
+			restorePath = argv[++i];
+		}
+		else if (strcmp(argv[i], "-S") == 0 && i + 1 < argc) {
+			savePath = argv[++i];
+		}
+		else if (strcmp(argv[i], "-C") == 0 && i + 1 < argc) {
+			cachePath = argv[++i];
+		}
+		else if (strcmp(argv[i], "-F") == 0 && i + 1 < argc) {
+			framesPath = argv[++i];
+		}
+		else if (strcmp(argv[i], "-K") == 0 && i + 1 < argc) {
+			cacheInterval = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+			statsInterval = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+			statsPath = argv[++i];
+		}
+		else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (steps <= 0 || cacheInterval <= 0 || (!recordPath.empty() && !replayPath.empty()) ||
+		(!restorePath.empty() && (!recordPath.empty() || !replayPath.empty()))) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	CollisionKernels::setLevel(simdLevel);
+
+	auto scene = make_shared<Scene>();
+	if (scenePath.empty()) {
+		scene->load();
+	}
+	else if (!scene->load(scenePath)) {
+		return 1;
+	}
+	if (threads > 0) {
+		scene->setThreadCount(threads);
+	}
+	scene->setParallelBodies(!serialBodies);
+	scene->setFusedCollision(!perCollider);
+	scene->setBroadphase(!allColliders);
+	if (h > 0.0) {
+		scene->setTimeStep(h);
+	}
+	scene->tare();
+	bool dumpStats = StepStats::enabled && (statsInterval > 0 || !statsPath.empty());
+	if (dumpStats) {
+		scene->setStatsDump(statsInterval, statsPath);
+	}
+
+	if (!restorePath.empty()) {
+		auto restoreStart = chrono::steady_clock::now();
+		if (!scene->loadCheckpoint(restorePath)) {
+			return 1;
+		}
+		double restoreSeconds = chrono::duration<double>(chrono::steady_clock::now() - restoreStart).count();
+		printf("restored:          %s (%.3f ms)\n", restorePath.c_str(), restoreSeconds * 1e3);
+	}
+	if (!recordPath.empty() && !scene->startRecording(recordPath)) {
+		return 1;
+	}
+	if (!replayPath.empty() && !scene->startReplay(replayPath)) {
+		return 1;
+	}
+
+	SimCacheWriter cache;
+	if (!cachePath.empty() && !cache.open(cachePath, *scene, cacheInterval)) {
+		return 1;
+	}
+	FrameRecorder frames;
+	if (!framesPath.empty() && !frames.open(framesPath, *scene, cacheInterval)) {
+		return 1;
+	}
+
+	int nParticles = scene->getParticleCount();
+	auto start = chrono::steady_clock::now();
+	if (!replayPath.empty()) {
+		steps = 0;
+		while (scene->replayStep()) {
+			cache.capture(*scene);
+			frames.capture(*scene);
+			steps++;
+		}
+		if (steps == 0) {
+			cerr << replayPath << " has no steps" << endl;
+			return 1;
+		}
+	}
+	else {
+		for (int i = 0; i < steps; i++) {
+			scene->step();
+			cache.capture(*scene);
+			frames.capture(*scene);
+		}
+	}
+	scene->stopRecording();
+	if (!cache.close() || !frames.close()) {
+		return 1;
+	}
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	if (!savePath.empty() && !scene->saveCheckpoint(savePath)) {
+		return 1;
+	}
+
+	printf("particles:         %d\n", nParticles);
+	printf("threads:           %d\n", scene->getThreadCount());
+	printf("collision kernels: %s\n", CollisionKernels::levelName(CollisionKernels::getLevel()));
+	printf("collision pass:    %s\n", perCollider ? "per collider" : "fused");
+	printf("steps:             %d\n", steps);
+	printf("h:                 %g\n", scene->getTimeStep());
+	printf("time (s):          %.3f\n", seconds);
+	printf("steps/sec:         %.1f\n", steps / seconds);
+	printf("ns/particle/step:  %.2f\n", seconds * 1e9 / (double(steps) * nParticles));
+	printf("checksum:          %016llx\n", (unsigned long long)checksum(*scene));
+	if (!cachePath.empty()) {
+		printf("cache:             %s, %llu frames, %llu dropped\n", cachePath.c_str(),
+			(unsigned long long)cache.getFrameCount(), (unsigned long long)cache.getDroppedFrames());
+	}
+	if (!framesPath.empty()) {
+		printf("frames:            %s, %llu frames\n", framesPath.c_str(), (unsigned long long)frames.getFrameCount());
+	}
+	const vector<double> &bodySeconds = scene->getBodyStepSeconds();
+	size_t nCloths = scene->getCloths().size();
+	for (size_t b = 0; b < bodySeconds.size(); b++) {
+		const char *kind = b < nCloths ? "cloth" : "soft body";
+		int index = int(b < nCloths ? b : b - nCloths);
+		int n = b < nCloths ? scene->getCloths()[index]->getParticles().size() : scene->getSoftBodies()[index]->getParticles().size();
+		const Broadphase &broadphase = b < nCloths ? scene->getCloths()[index]->getBroadphase() : scene->getSoftBodies()[index]->getBroadphase();
+		printf("  %s %d (%d particles): %.3f ms/step, colliders %d/%d on the last step\n", kind, index, n, bodySeconds[b] * 1e3 / steps,
+			broadphase.getCandidateCount(), broadphase.getColliderCount());
+	}
+	if (dumpStats) {
+		// Flush the last interval
+		scene->dumpStats();
+	}
+	if (StepStats::enabled) {
+		fflush(stdout);
+		scene->getStats().print(cout);
+	}
+	return 0;
+}
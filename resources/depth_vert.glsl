@@ -1,9 +1,10 @@
 #version 120
 
 attribute vec4 aPos;
+attribute mat4 aInstance;
 uniform mat4 lightVP;
 uniform mat4 M;
 
 void main() {
-	gl_Position = lightVP * (M * aPos);
+	gl_Position = lightVP * (M * aInstance * aPos);
 }
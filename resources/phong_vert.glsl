@@ -2,6 +2,7 @@
 
 attribute vec4 aPos;
 attribute vec3 aNor;
+attribute mat4 aInstance; // per-instance model matrix, identity for bodies
 uniform mat4 P;
 uniform mat4 V;
 uniform mat4 lightVP;
@@ -12,10 +13,11 @@ varying vec3 vNor;
 
 void main()
 {
-	vec4 posWorld = M * aPos;
+	mat4 MI = M * aInstance;
+	vec4 posWorld = MI * aPos;
 	vec4 posCam = V * posWorld;
 	gl_Position = P * posCam;
 	vPos = posCam.xyz;
-	vNor = normalize(mat3(V * M) * aNor);
+	vNor = normalize(mat3(V * MI) * aNor);
 	vLightSpacePos = (lightVP * posWorld).xyz;
 }
@@ -0,0 +1,39 @@
+#pragma once
+#ifndef Aabb_H
+#define Aabb_H
+
+#include <limits>
+
+#define EIGEN_DONT_ALIGN_STATICALLY
+#include <Eigen/Dense>
+
+// Axis-aligned bounding box, empty until grown
+struct Aabb
+{
+	Eigen::Vector3d min;
+	Eigen::Vector3d max;
+
+	Aabb() { reset(); }
+	void reset()
+	{
+		min.setConstant(std::numeric_limits<double>::infinity());
+		max.setConstant(-std::numeric_limits<double>::infinity());
+	}
+	void grow(const Eigen::Vector3d &x)
+	{
+		min = min.cwiseMin(x);
+		max = max.cwiseMax(x);
+	}
+	void inflate(double d)
+	{
+		min.array() -= d;
+		max.array() += d;
+	}
+	bool empty() const { return (min.array() > max.array()).any(); }
+	bool overlaps(const Aabb &o) const
+	{
+		return (min.array() <= o.max.array()).all() && (o.min.array() <= max.array()).all();
+	}
+};
+
+#endif
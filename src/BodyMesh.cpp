@@ -0,0 +1,131 @@
+#include <cassert>
+
+#define GLEW_STATIC
+#include <GL/glew.h>
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "BodyMesh.h"
+#include "MatrixStack.h"
+#include "Program.h"
+#include "RenderSnapshot.h"
+
+using namespace std;
+
+BodyMesh::BodyMesh() :
+	eleBufID(0),
+	posBufID(0),
+	norBufID(0),
+	texBufID(0),
+	eleBufSize(0),
+	posBufSize(0),
+	norBufSize(0),
+	eleCount(0),
+	eleVersion(0)
+{
+}
+
+BodyMesh::~BodyMesh()
+{
+}
+
+// Replaces the contents of a buffer, reallocating only if it has to grow
+static void streamBuffer(GLenum target, unsigned bufID, size_t &allocated, const void *data, size_t size)
+{
+	glBindBuffer(target, bufID);
+	if (size > allocated) {
+		glBufferData(target, size, data, GL_DYNAMIC_DRAW);
+		allocated = size;
+	}
+	else if (size > 0) {
+		glBufferSubData(target, 0, size, data);
+	}
+	glBindBuffer(target, 0);
+}
+
+void BodyMesh::init(const RenderSnapshot &snapshot, const vector<float> &texBuf, int maxTris)
+{
+	glGenBuffers(1, &posBufID);
+	glGenBuffers(1, &norBufID);
+	glGenBuffers(1, &eleBufID);
+	
+	glGenBuffers(1, &texBufID);
+	glBindBuffer(GL_ARRAY_BUFFER, texBufID);
+	glBufferData(GL_ARRAY_BUFFER, texBuf.size()*sizeof(float), texBuf.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	
+	// A soft body starts with its surface only and gains faces as cells
+	// open, so the element buffer is sized for every triangle id up front
+	eleBufSize = (size_t)maxTris*3*sizeof(unsigned int);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, eleBufID);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, eleBufSize, nullptr, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	
+	upload(snapshot);
+	
+	assert(glGetError() == GL_NO_ERROR);
+}
+
+void BodyMesh::upload(const RenderSnapshot &snapshot)
+{
+	// Elements only change when something breaks
+	bool newElements = snapshot.eleVersion != eleVersion;
+	upload(snapshot.posBuf.data(), snapshot.norBuf.data(), snapshot.posBuf.size() / 3,
+		newElements ? snapshot.eleBuf.data() : nullptr, (int)snapshot.eleBuf.size());
+	eleVersion = snapshot.eleVersion;
+}
+
+void BodyMesh::upload(const float *pos, const float *nor, size_t nVerts, const unsigned int *ele, int eleCount)
+{
+	streamBuffer(GL_ARRAY_BUFFER, posBufID, posBufSize, pos, nVerts*3*sizeof(float));
+	streamBuffer(GL_ARRAY_BUFFER, norBufID, norBufSize, nor, nVerts*3*sizeof(float));
+	if (ele) {
+		streamBuffer(GL_ELEMENT_ARRAY_BUFFER, eleBufID, eleBufSize, ele, eleCount*sizeof(unsigned int));
+		this->eleCount = eleCount;
+	}
+}
+
+void BodyMesh::draw(shared_ptr<MatrixStack> M, const shared_ptr<Program> p) const
+{
+	// Draw mesh
+	int kdFrontID = p->getUniform("kdFront");
+	if (kdFrontID != -1) {
+		glUniform3f(kdFrontID, 0.894f, 0.882f, 0.792f);
+	}
+	int kdBackID = p->getUniform("kdBack");
+	if (kdBackID != -1) {
+		glUniform3f(kdBackID, 0.776f, 0.843f, 0.835f);
+	}
+	M->pushMatrix();
+	glUniformMatrix4fv(p->getUniform("M"), 1, GL_FALSE, glm::value_ptr(M->topMatrix()));
+	int h_pos = p->getAttribute("aPos");
+	glEnableVertexAttribArray(h_pos);
+	glBindBuffer(GL_ARRAY_BUFFER, posBufID);
+	glVertexAttribPointer(h_pos, 3, GL_FLOAT, GL_FALSE, 0, (const void *)0);
+	int h_nor = p->getAttribute("aNor");
+	if (h_nor >= 0) {
+		glEnableVertexAttribArray(h_nor);
+		glBindBuffer(GL_ARRAY_BUFFER, norBufID);
+		glVertexAttribPointer(h_nor, 3, GL_FLOAT, GL_FALSE, 0, (const void *)0);
+	}
+	int h_tex = p->getAttribute("aTex");
+	if(h_tex >= 0) {
+		glEnableVertexAttribArray(h_tex);
+		glBindBuffer(GL_ARRAY_BUFFER, texBufID);
+		glVertexAttribPointer(h_tex, 2, GL_FLOAT, GL_FALSE, 0, (const void *)0);
+	}
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, eleBufID);
+	glDrawElements(GL_TRIANGLES, eleCount, GL_UNSIGNED_INT, 0);
+	if(h_tex >= 0) {
+		glDisableVertexAttribArray(h_tex);
+	}
+	if (h_nor >= 0) {
+		glDisableVertexAttribArray(h_nor);
+	}
+	glDisableVertexAttribArray(h_pos);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	M->popMatrix();
+}
@@ -0,0 +1,45 @@
+#pragma once
+#ifndef BodyMesh_H
+#define BodyMesh_H
+
+#include <vector>
+#include <memory>
+
+class MatrixStack;
+class Program;
+struct RenderSnapshot;
+
+/**
+ * GPU side of a deformable body (Cloth or SoftBody). The GL buffers are
+ * allocated once in init(); upload() streams a new snapshot into them with
+ * glBufferSubData, and draw() only binds and draws, so it can be called
+ * for several passes per frame without touching buffer storage.
+ */
+class BodyMesh
+{
+public:
+	BodyMesh();
+	virtual ~BodyMesh();
+	
+	// maxTris is the body's ElementList capacity
+	void init(const RenderSnapshot &snapshot, const std::vector<float> &texBuf, int maxTris);
+	void upload(const RenderSnapshot &snapshot);
+	// Streams raw buffers of nVerts vertices, e.g. straight from a mapped
+	// FrameFile. The elements are left as they are if ele is null.
+	void upload(const float *pos, const float *nor, size_t nVerts, const unsigned int *ele, int eleCount);
+	void draw(std::shared_ptr<MatrixStack> M, const std::shared_ptr<Program> p) const;
+	
+private:
+	unsigned eleBufID;
+	unsigned posBufID;
+	unsigned norBufID;
+	unsigned texBufID;
+	// Allocated sizes in bytes
+	size_t eleBufSize;
+	size_t posBufSize;
+	size_t norBufSize;
+	int eleCount;
+	unsigned long eleVersion; // of the snapshot last uploaded
+};
+
+#endif
@@ -0,0 +1,95 @@
+#include "Broadphase.h"
+#include "Particle.h"
+#include "Plane.h"
+#include "Cylinder.h"
+#include "Tetrahedron.h"
+#include "ConvexPolytope.h"
+
+using namespace std;
+using namespace Eigen;
+
+Broadphase::Broadphase() :
+	enabled(true),
+	margin(0.05),
+	colliderCount(0)
+{
+}
+
+Broadphase::~Broadphase()
+{
+}
+
+void Broadphase::build(
+	const Aabb &bounds,
+	double radius,
+	const vector< shared_ptr<Particle> > &spheres,
+	const vector< shared_ptr<Plane> > &planes,
+	const vector< shared_ptr<Cylinder> > &cylinders,
+	const vector< shared_ptr<Tetrahedron> > &tetrahedrons,
+	const vector< shared_ptr<ConvexPolytope> > &polytopes)
+{
+	colliderCount = (int)(spheres.size() + planes.size() + cylinders.size() + tetrahedrons.size() + polytopes.size());
+	if (!enabled) {
+		this->spheres = spheres;
+		this->planes = planes;
+		this->cylinders = cylinders;
+		this->tetrahedrons = tetrahedrons;
+		this->polytopes = polytopes;
+		return;
+	}
+
+	this->spheres.clear();
+	this->planes.clear();
+	this->cylinders.clear();
+	this->tetrahedrons.clear();
+	this->polytopes.clear();
+	if (bounds.empty()) {
+		// Every particle is fixed
+		return;
+	}
+	// Everything within reach of a particle this step
+	Aabb reach = bounds;
+	reach.inflate(radius + margin);
+	Vector3d center = 0.5 * (reach.min + reach.max);
+	Vector3d extent = 0.5 * (reach.max - reach.min);
+
+	for (const shared_ptr<Particle> &sphere : spheres) {
+		Aabb b;
+		b.grow(sphere->x);
+		b.inflate(sphere->r);
+		if (reach.overlaps(b)) {
+			this->spheres.push_back(sphere);
+		}
+	}
+	for (const shared_ptr<Plane> &plane : planes) {
+		// Signed distance of the box corner furthest behind the plane
+		double distance = (center - plane->x).dot(plane->n) - extent.dot(plane->n.cwiseAbs());
+		if (distance < 0.0) {
+			this->planes.push_back(plane);
+		}
+	}
+	for (const shared_ptr<Cylinder> &cylinder : cylinders) {
+		Aabb b;
+		b.grow(cylinder->x);
+		b.grow(cylinder->x + cylinder->h * cylinder->axis);
+		b.inflate(cylinder->r);
+		if (reach.overlaps(b)) {
+			this->cylinders.push_back(cylinder);
+		}
+	}
+	for (const shared_ptr<Tetrahedron> &tetrahedron : tetrahedrons) {
+		if (reach.overlaps(tetrahedron->getPolytope().getBounds())) {
+			this->tetrahedrons.push_back(tetrahedron);
+		}
+	}
+	for (const shared_ptr<ConvexPolytope> &polytope : polytopes) {
+		if (reach.overlaps(polytope->getBounds())) {
+			this->polytopes.push_back(polytope);
+		}
+	}
+}
+
+int Broadphase::getCandidateCount() const
+{
+	return (int)(spheres.size() + planes.size() + cylinders.size() + tetrahedrons.size() + polytopes.size());
+}
@@ -0,0 +1,65 @@
+#pragma once
+#ifndef Broadphase_H
+#define Broadphase_H
+
+#include <vector>
+#include <memory>
+
+#include "Aabb.h"
+
+class Particle;
+class Plane;
+class Cylinder;
+class Tetrahedron;
+class ConvexPolytope;
+
+/**
+ * Per-body collider culling. Each step the body's bounds, grown while
+ * integrating, are tested against the bounds of every collider, and only
+ * the colliders that may touch the body are handed to the collision stage.
+ *
+ * The body bounds are taken before constraint projection, so they are
+ * inflated by the largest particle radius plus a margin for how far the
+ * constraints may still move a particle within the step.
+ */
+class Broadphase
+{
+public:
+	Broadphase();
+	virtual ~Broadphase();
+
+	// When disabled every collider is a candidate
+	void setEnabled(bool enabled) { this->enabled = enabled; }
+	bool getEnabled() const { return enabled; }
+	void setMargin(double margin) { this->margin = margin; }
+
+	void build(
+		const Aabb &bounds,
+		double radius,
+		const std::vector< std::shared_ptr<Particle> > &spheres,
+		const std::vector< std::shared_ptr<Plane> > &planes,
+		const std::vector< std::shared_ptr<Cylinder> > &cylinders,
+		const std::vector< std::shared_ptr<Tetrahedron> > &tetrahedrons,
+		const std::vector< std::shared_ptr<ConvexPolytope> > &polytopes);
+
+	const std::vector< std::shared_ptr<Particle> > &getSpheres() const { return spheres; }
+	const std::vector< std::shared_ptr<Plane> > &getPlanes() const { return planes; }
+	const std::vector< std::shared_ptr<Cylinder> > &getCylinders() const { return cylinders; }
+	const std::vector< std::shared_ptr<Tetrahedron> > &getTetrahedrons() const { return tetrahedrons; }
+	const std::vector< std::shared_ptr<ConvexPolytope> > &getPolytopes() const { return polytopes; }
+	// Candidates and colliders seen by the last build
+	int getCandidateCount() const;
+	int getColliderCount() const { return colliderCount; }
+
+private:
+	bool enabled;
+	double margin;
+	int colliderCount;
+	std::vector< std::shared_ptr<Particle> > spheres;
+	std::vector< std::shared_ptr<Plane> > planes;
+	std::vector< std::shared_ptr<Cylinder> > cylinders;
+	std::vector< std::shared_ptr<Tetrahedron> > tetrahedrons;
+	std::vector< std::shared_ptr<ConvexPolytope> > polytopes;
+};
+
+#endif
@@ -0,0 +1,82 @@
+#include <iostream>
+#include <cstring>
+
+#include "Checkpoint.h"
+
+using namespace std;
+
+static const char MAGIC[8] = { 'S', 'I', 'M', 'C', 'K', 'P', 'T', '1' };
+
+bool CheckpointWriter::open(const string &path)
+{
+	this->path = path;
+	out.open(path, ios::binary | ios::trunc);
+	if (!out) {
+		cerr << "Cannot open " << path << endl;
+		return false;
+	}
+	out.write(MAGIC, sizeof(MAGIC));
+	return true;
+}
+
+bool CheckpointWriter::close()
+{
+	out.close();
+	if (!out) {
+		cerr << "Cannot write " << path << endl;
+		return false;
+	}
+	return true;
+}
+
+void CheckpointWriter::write(const void *data, size_t size)
+{
+	out.write(static_cast<const char *>(data), size);
+}
+
+CheckpointReader::CheckpointReader() :
+	offset(0),
+	failed(true)
+{
+}
+
+CheckpointReader::~CheckpointReader()
+{
+	close();
+}
+
+bool CheckpointReader::open(const string &path)
+{
+	close();
+	if (!file.open(path)) {
+		return false;
+	}
+	if (file.size() < sizeof(MAGIC) || memcmp(file.data(), MAGIC, sizeof(MAGIC)) != 0) {
+		cerr << path << " is not a checkpoint" << endl;
+		close();
+		return false;
+	}
+	offset = sizeof(MAGIC);
+	failed = false;
+	return true;
+}
+
+void CheckpointReader::close()
+{
+	file.close();
+	offset = 0;
+	failed = true;
+}
+
+bool CheckpointReader::read(void *dst, size_t n)
+{
+	if (failed || n > file.size() - offset) {
+		failed = true;
+		return false;
+	}
+	if (n > 0) {
+		memcpy(dst, file.data() + offset, n);
+		offset += n;
+	}
+	return true;
+}
@@ -0,0 +1,87 @@
+#pragma once
+#ifndef Checkpoint_H
+#define Checkpoint_H
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstddef>
+#include <cstdint>
+
+#include "MappedFile.h"
+
+/**
+ * Writes the raw bytes of a Scene checkpoint (see Scene::saveCheckpoint).
+ * Arrays are stored as their element count followed by their memory, so
+ * checkpoints are only portable between machines with the same byte order.
+ */
+class CheckpointWriter
+{
+public:
+	// Returns false and prints an error if the file cannot be created
+	bool open(const std::string &path);
+	// False if any write failed
+	bool close();
+
+	void write(const void *data, size_t size);
+	template <class T> void value(const T &v) { write(&v, sizeof(T)); }
+	template <class T> void array(const std::vector<T> &v)
+	{
+		value(uint64_t(v.size()));
+		write(v.data(), v.size() * sizeof(T));
+	}
+
+private:
+	std::ofstream out;
+	std::string path;
+};
+
+/**
+ * Reads a checkpoint by mapping the whole file into memory, so restoring
+ * large scenes is one copy per array straight from the page cache. Reads
+ * past the end or arrays of the wrong length set a sticky failure flag.
+ */
+class CheckpointReader
+{
+public:
+	CheckpointReader();
+	virtual ~CheckpointReader();
+
+	// Returns false and prints an error if the file cannot be mapped or is
+	// not a checkpoint
+	bool open(const std::string &path);
+	void close();
+	bool ok() const { return !failed; }
+
+	bool read(void *data, size_t size);
+	template <class T> bool value(T &v) { return read(&v, sizeof(T)); }
+	// The array must already have the stored length, since checkpoints only
+	// restore into a scene with the same layout
+	template <class T> bool array(std::vector<T> &v)
+	{
+		uint64_t n = 0;
+		if (!value(n) || n != v.size()) {
+			failed = true;
+			return false;
+		}
+		return read(v.data(), v.size() * sizeof(T));
+	}
+	// Reads an array of any length
+	template <class T> bool anyArray(std::vector<T> &v)
+	{
+		uint64_t n = 0;
+		if (!value(n) || n > (file.size() - offset) / sizeof(T)) {
+			failed = true;
+			return false;
+		}
+		v.resize(size_t(n));
+		return read(v.data(), v.size() * sizeof(T));
+	}
+
+private:
+	MappedFile file;
+	size_t offset;
+	bool failed;
+};
+
+#endif
@@ -1,16 +1,12 @@
 #include <iostream>
 #include <fstream>
 
-#define GLM_FORCE_RADIANS
-#include <glm/glm.hpp>
-#include <glm/gtc/type_ptr.hpp>
-
 #include "Cloth.h"
 #include "Particle.h"
 #include "Spring.h"
-#include "MatrixStack.h"
-#include "Program.h"
-#include "GLSL.h"
+#include "ThreadPool.h"
+#include "Checkpoint.h"
+#include "TriMesh.h"
 
 using namespace std;
 using namespace Eigen;
@@ -32,14 +28,16 @@ Cloth::Cloth(int rows, int cols,
 	assert(damping >= 0.0);
 	assert(pradius >= 0.0);
 	
-	this->rows = rows;
-	this->cols = cols;
+	this->fusedCollision = true;
 
-	cells.resize(rows - 1, vector<Quad>(cols - 1));
+	// Triangle t of cell (i, j) has id 2 * (i * (cols - 1) + j) + t
+	int nTris = 2 * (rows - 1) * (cols - 1);
+	tris.resize(nTris);
 	
 	// Create particles
 	int nVerts = rows*cols; // Total number of vertices
 	double particleM = mass / nVerts;
+	particles.reserve(nVerts);
 	for(int i = 0; i < rows; ++i) {
 		double posBeta = double(i) / (rows - 1);
 		for(int j = 0; j < cols; ++j) {
@@ -49,28 +47,14 @@ Cloth::Cloth(int rows, int cols,
 			Vector3d bottomEdgePos = (1.0 - posAlpha) * x10 + posAlpha * x11;
 			Vector3d pos = (1.0 - posBeta) * topEdgePos + posBeta * bottomEdgePos;
 
-			auto p = make_shared<Particle>();
-			p->x = pos;
-			p->v = Vector3d::Zero();
-			p->p = pos;
-			p->x0 = pos;
-			p->v0 = Vector3d::Zero();
-			p->m = particleM;
-			p->r = pradius;
-			p->d = damping;
-			if (i == 0 && (j == 0 || j == cols - 1)) {
-				p->fixed = true;
-			}
-			else {
-				p->fixed = false;
-			}
-			particles.push_back(p);
+			bool fixed = i == 0 && (j == 0 || j == cols - 1);
+			particles.add(pos, particleM, pradius, damping, fixed);
 		}
 	}
 
 	for (int i = 0; i < rows - 1; i++) {
 		for (int j = 0; j < cols - 1; j++) {
-			Quad &Q = cells[i][j];
+			Tri *Q = &tris[2 * (i * (cols - 1) + j)];
 
 			int a = i * cols		+ j;
 			int b = (i + 1) * cols	+ j;
@@ -78,105 +62,92 @@ Cloth::Cloth(int rows, int cols,
 			int d = i * cols		+ (j + 1);
 			
 			//abd
-			Q.tris[0].index0 = a;
-			Q.tris[0].index1 = b;
-			Q.tris[0].index2 = c;
+			Q[0].index0 = a;
+			Q[0].index1 = b;
+			Q[0].index2 = c;
 			//cdb
-			Q.tris[1].index0 = c;
-			Q.tris[1].index1 = d;
-			Q.tris[1].index2 = b;
+			Q[1].index0 = c;
+			Q[1].index1 = d;
+			Q[1].index2 = b;
 		}
 	}
 
 	// Create x springs
 	for (int i = 0; i < rows; i++) {
 		for (int j = 0; j < cols - 1; j++) {
-			auto spring = make_shared<Spring>(
-				particles.at(i * cols + j),
-				particles.at(i * cols + (j + 1)),
-				alpha
-			);
-			springs.push_back(spring);
-			if (i < rows - 1) {
-				cells.at(i).at(j).tris[0].edgeSprings[0] = spring;
-			}
-			if (i > 0) {
-				cells.at(i - 1).at(j).tris[1].edgeSprings[0] = spring;
-			}
+			constraints.addSpring(particles, i * cols + j, i * cols + (j + 1), alpha);
 		}
 	}
 	
 	// Create y springs
 	for (int i = 0; i < rows - 1; i++) {
 		for (int j = 0; j < cols; j++) {
-			auto spring = make_shared<Spring>(
-				particles.at(i * cols + j),
-				particles.at((i + 1) * cols + j),
-				alpha
-			);
-			springs.push_back(spring);
-			if (j < rows - 1) {
-				cells.at(i).at(j).tris[0].edgeSprings[1] = spring;
-			}
-			if (j > 0) {
-				cells.at(i).at(j - 1).tris[1].edgeSprings[1] = spring;
-			}
+			constraints.addSpring(particles, i * cols + j, (i + 1) * cols + j, alpha);
 		}
 	}
 
 	// Create shear springs
 	for (int i = 0; i < rows - 1; i++) {
 		for (int j = 0; j < cols - 1; j++) {
-			auto spring1 = make_shared<Spring>(
-				particles.at(i * cols + j),
-				particles.at((i + 1) * cols + (j + 1)),
-				alpha
-			);
-			springs.push_back(spring1);
-			auto spring2 = make_shared<Spring>(
-				particles.at((i + 1) * cols + j),
-				particles.at(i * cols + (j + 1)),
-				alpha
-			);
-			springs.push_back(spring2);
-			cells.at(i).at(j).tris[0].edgeSprings[2] = spring2;
-			cells.at(i).at(j).tris[1].edgeSprings[2] = spring2;
+			constraints.addSpring(particles, i * cols + j, (i + 1) * cols + (j + 1), alpha);
+			constraints.addSpring(particles, (i + 1) * cols + j, i * cols + (j + 1), alpha);
 		}
 	}
 
 	// Create x bending springs
 	for (int i = 0; i < rows; i++) {
 		for (int j = 0; j < cols - 2; j++) {
-			auto spring = make_shared<Spring>(
-				particles.at(i * cols + j),
-				particles.at(i * cols + (j + 2)),
-				alpha
-			);
-			springs.push_back(spring);
+			constraints.addSpring(particles, i * cols + j, i * cols + (j + 2), alpha);
 		}
 	}
 	
 	// Create y bending springs
 	for (int i = 0; i < rows - 2; i++) {
 		for (int j = 0; j < cols; j++) {
-			auto spring = make_shared<Spring>(
-				particles.at(i * cols + j),
-				particles.at((i + 2) * cols + j),
-				alpha
-			);
-			springs.push_back(spring);
+			constraints.addSpring(particles, i * cols + j, (i + 2) * cols + j, alpha);
+		}
+	}
+
+	constraints.sort();
+	constraints.color(nVerts);
+
+	// Edges of the rendered triangles
+	for (int i = 0; i < rows - 1; i++) {
+		for (int j = 0; j < cols - 1; j++) {
+			Tri *Q = &tris[2 * (i * (cols - 1) + j)];
+
+			int a = i * cols		+ j;
+			int b = (i + 1) * cols	+ j;
+			int c = (i + 1) * cols	+ (j + 1);
+			int d = i * cols		+ (j + 1);
+
+			// abd
+			Q[0].edgeSprings[0] = constraints.findSpring(a, d);
+			Q[0].edgeSprings[1] = constraints.findSpring(a, b);
+			Q[0].edgeSprings[2] = constraints.findSpring(b, d);
+			// bcd
+			Q[1].edgeSprings[0] = constraints.findSpring(b, c);
+			Q[1].edgeSprings[1] = constraints.findSpring(d, c);
+			Q[1].edgeSprings[2] = constraints.findSpring(b, d);
+		}
+	}
+
+	springTris.build(constraints.numSprings(), nTris, [&](int tri, int e) {
+		return tris[tri].edgeSprings[e];
+	});
+	// Wound so that the triangle normals point along +j x +i
+	elements.reset(nTris);
+	for (int i = 0; i < rows - 1; i++) {
+		for (int j = 0; j < cols - 1; j++) {
+			int tri = 2 * (i * (cols - 1) + j);
+			elements.insert(tri, i * cols + j, i * cols + (j + 1), (i + 1) * cols + j);
+			elements.insert(tri + 1, (i + 1) * cols + j, i * cols + (j + 1), (i + 1) * cols + (j + 1));
 		}
 	}
 	
 	// Build vertex buffers
-	posBuf.clear();
-	norBuf.clear();
 	texBuf.clear();
-	eleBuf.clear();
-	posBuf.resize(nVerts*3);
-	norBuf.resize(nVerts*3);
-	updatePosNor();
-	updateEle();
+	publish();
 	
 	// Texture coordinates (don't change)
 	for(int i = 0; i < rows; ++i) {
@@ -187,141 +158,267 @@ Cloth::Cloth(int rows, int cols,
 	}
 }
 
+Cloth::Cloth(const TriMesh &mesh,
+			 double mass,
+			 double alpha,
+			 double damping,
+			 double pradius)
+{
+	assert(!mesh.tris.empty());
+	assert(mass > 0.0);
+	assert(alpha >= 0.0);
+	assert(damping >= 0.0);
+	assert(pradius >= 0.0);
+
+	this->fusedCollision = true;
+
+	int nVerts = int(mesh.nodes.size());
+	int nTris = int(mesh.tris.size() / 3);
+	double particleM = mass / nVerts;
+	particles.reserve(nVerts);
+	for (const Vector3d &x : mesh.nodes) {
+		particles.add(x, particleM, pradius, damping, false);
+	}
+
+	// Edge e of a triangle joins corners triEdges[e] and faces corner
+	// opposite[e]
+	static const int triEdges[3][2] = { { 0, 1 }, { 0, 2 }, { 1, 2 } };
+	static const int opposite[3] = { 2, 1, 0 };
+
+	// Triangle edges bucketed by their lower vertex (CSR) and sorted by the
+	// higher one, so that the triangles sharing an edge are adjacent
+	struct EdgeSlot {
+		int hi;
+		int slot; // tri * 3 + e
+		bool operator<(const EdgeSlot &o) const { return hi != o.hi ? hi < o.hi : slot < o.slot; }
+	};
+	vector<int> slotStart(nVerts + 1, 0);
+	for (int t = 0; t < nTris; t++) {
+		const int *v = &mesh.tris[size_t(t) * 3];
+		for (int e = 0; e < 3; e++) {
+			slotStart[min(v[triEdges[e][0]], v[triEdges[e][1]]) + 1]++;
+		}
+	}
+	for (int i = 0; i < nVerts; i++) {
+		slotStart[i + 1] += slotStart[i];
+	}
+	vector<EdgeSlot> slots(slotStart.back());
+	{
+		vector<int> fill(slotStart.begin(), slotStart.end() - 1);
+		for (int t = 0; t < nTris; t++) {
+			const int *v = &mesh.tris[size_t(t) * 3];
+			for (int e = 0; e < 3; e++) {
+				int i0 = v[triEdges[e][0]];
+				int i1 = v[triEdges[e][1]];
+				slots[fill[min(i0, i1)]++] = { max(i0, i1), t * 3 + e };
+			}
+		}
+	}
+
+	// Springs: the unique edges, plus a bending spring between the opposite
+	// corners of each pair of triangles sharing an edge. Both go into one
+	// CSR of higher neighbors that is sorted and deduplicated per vertex, so
+	// spring k is the k-th entry and sort() has nothing to move.
+	vector<int> springStart(nVerts + 1, 0);
+	vector<int> springEnd;
+	springEnd.reserve(slots.size() / 2 * 3);
+	vector<int> springLo; // lower vertex of each entry of springEnd
+	springLo.reserve(springEnd.capacity());
+	for (int i = 0; i < nVerts; i++) {
+		sort(slots.begin() + slotStart[i], slots.begin() + slotStart[i + 1]);
+		for (int k = slotStart[i]; k < slotStart[i + 1]; ) {
+			int run = k + 1;
+			while (run < slotStart[i + 1] && slots[run].hi == slots[k].hi) {
+				run++;
+			}
+			springLo.push_back(i);
+			springEnd.push_back(slots[k].hi);
+			// Only manifold edges bend
+			if (run - k == 2) {
+				int o0 = mesh.tris[slots[k].slot / 3 * 3 + opposite[slots[k].slot % 3]];
+				int o1 = mesh.tris[slots[k + 1].slot / 3 * 3 + opposite[slots[k + 1].slot % 3]];
+				if (o0 != o1) {
+					springLo.push_back(min(o0, o1));
+					springEnd.push_back(max(o0, o1));
+				}
+			}
+			k = run;
+		}
+	}
+	slots = vector<EdgeSlot>();
+	slotStart = vector<int>();
+	for (int lo : springLo) {
+		springStart[lo + 1]++;
+	}
+	for (int i = 0; i < nVerts; i++) {
+		springStart[i + 1] += springStart[i];
+	}
+	vector<int> neighbors(springEnd.size());
+	{
+		vector<int> fill(springStart.begin(), springStart.end() - 1);
+		for (size_t k = 0; k < springEnd.size(); k++) {
+			neighbors[fill[springLo[k]]++] = springEnd[k];
+		}
+	}
+	springLo = vector<int>();
+	springEnd = vector<int>();
+	int nSprings = 0;
+	for (int i = 0; i < nVerts; i++) {
+		int begin = springStart[i];
+		int end = springStart[i + 1];
+		sort(neighbors.begin() + begin, neighbors.begin() + end);
+		springStart[i] = nSprings;
+		for (int k = begin; k < end; k++) {
+			if (k == begin || neighbors[k] != neighbors[k - 1]) {
+				neighbors[nSprings++] = neighbors[k];
+				constraints.addSpring(particles, i, neighbors[k], alpha);
+			}
+		}
+	}
+	springStart[nVerts] = nSprings;
+
+	constraints.sort();
+	constraints.color(nVerts);
+
+	tris.resize(nTris);
+	elements.reset(nTris);
+	for (int t = 0; t < nTris; t++) {
+		const int *v = &mesh.tris[size_t(t) * 3];
+		Tri &T = tris[t];
+		T.index0 = v[0];
+		T.index1 = v[1];
+		T.index2 = v[2];
+		for (int e = 0; e < 3; e++) {
+			int i0 = min(v[triEdges[e][0]], v[triEdges[e][1]]);
+			int i1 = max(v[triEdges[e][0]], v[triEdges[e][1]]);
+			T.edgeSprings[e] = int(lower_bound(neighbors.begin() + springStart[i0],
+				neighbors.begin() + springStart[i0 + 1], i1) - neighbors.begin());
+		}
+		elements.insert(t, v[0], v[1], v[2]);
+	}
+	springTris.build(constraints.numSprings(), nTris, [&](int tri, int e) {
+		return tris[tri].edgeSprings[e];
+	});
+
+	// Build vertex buffers
+	texBuf.clear();
+	publish();
+
+	// Texture coordinates from the file, or x and y across the bounding box
+	if (!mesh.texcoords.empty()) {
+		texBuf = mesh.texcoords;
+	}
+	else {
+		Vector3d lo = mesh.nodes[0];
+		Vector3d hi = mesh.nodes[0];
+		for (const Vector3d &x : mesh.nodes) {
+			lo = lo.cwiseMin(x);
+			hi = hi.cwiseMax(x);
+		}
+		Vector3d extent = (hi - lo).cwiseMax(Vector3d::Constant(1e-12));
+		texBuf.reserve(nVerts * 2);
+		for (const Vector3d &x : mesh.nodes) {
+			texBuf.push_back(float((x(0) - lo(0)) / extent(0)));
+			texBuf.push_back(float((x(1) - lo(1)) / extent(1)));
+		}
+	}
+}
+
 Cloth::~Cloth()
 {
 }
 
+void Cloth::setThreadPool(shared_ptr<ThreadPool> pool)
+{
+	threadPool = pool;
+}
+
 void Cloth::tare()
 {
-	for(auto p : particles) {
-		p->tare();
-	}
+	particles.tare();
 }
 
 void Cloth::reset()
 {
-	for(auto p : particles) {
-		p->reset();
-	}
+	particles.reset();
+}
+
+void Cloth::publish()
+{
+	updatePosNor();
+	updateEle();
+	snapshots.publish();
 }
 
 void Cloth::updatePosNor()
 {
+	RenderSnapshot &snapshot = snapshots.writeBuffer();
+	vector<float> &posBuf = snapshot.posBuf;
+	vector<float> &norBuf = snapshot.norBuf;
+	posBuf.resize(particles.size() * 3);
+	norBuf.resize(particles.size() * 3);
+
 	// Position
-	for(int i = 0; i < rows; ++i) {
-		for(int j = 0; j < cols; ++j) {
-			int k = i*cols + j;
-			Vector3d x = particles[k]->x; // updated position
-			posBuf[3*k+0] = float(x(0));
-			posBuf[3*k+1] = float(x(1));
-			posBuf[3*k+2] = float(x(2));
-		}
+	int n = particles.size();
+	for(int k = 0; k < n; ++k) {
+		const Vector3d &x = particles.x[k]; // updated position
+		posBuf[3*k+0] = float(x(0));
+		posBuf[3*k+1] = float(x(1));
+		posBuf[3*k+2] = float(x(2));
 	}
 	
-	// Normal
-	for(int i = 0; i < rows; ++i) {
-		for(int j = 0; j < cols; ++j) {
-			// Each particle has four neighbors
-			//
-			//      v1
-			//     / | \
-			// u0 /__|__\ u1
-			//    \  |  /
-			//     \ | /
-			//      v0
-			//
-			// Use these four triangles to compute the normal
-			int k = i*cols + j;
-			int ku0 = k - 1;
-			int ku1 = k + 1;
-			int kv0 = k - cols;
-			int kv1 = k + cols;
-			Vector3d x = particles[k]->x;
-			Vector3d xu0, xu1, xv0, xv1, dx0, dx1, c;
-			Vector3d nor(0.0, 0.0, 0.0);
-			int count = 0;
-			// Top-right triangle
-			if(j != cols-1 && i != rows-1) {
-				xu1 = particles[ku1]->x;
-				xv1 = particles[kv1]->x;
-				dx0 = xu1 - x;
-				dx1 = xv1 - x;
-				c = dx0.cross(dx1);
-				nor += c.normalized();
-				++count;
-			}
-			// Top-left triangle
-			if(j != 0 && i != rows-1) {
-				xu1 = particles[kv1]->x;
-				xv1 = particles[ku0]->x;
-				dx0 = xu1 - x;
-				dx1 = xv1 - x;
-				c = dx0.cross(dx1);
-				nor += c.normalized();
-				++count;
-			}
-			// Bottom-left triangle
-			if(j != 0 && i != 0) {
-				xu1 = particles[ku0]->x;
-				xv1 = particles[kv0]->x;
-				dx0 = xu1 - x;
-				dx1 = xv1 - x;
-				c = dx0.cross(dx1);
-				nor += c.normalized();
-				++count;
-			}
-			// Bottom-right triangle
-			if(j != cols-1 && i != 0) {
-				xu1 = particles[kv0]->x;
-				xv1 = particles[ku1]->x;
-				dx0 = xu1 - x;
-				dx1 = xv1 - x;
-				c = dx0.cross(dx1);
-				nor += c.normalized();
-				++count;
-			}
-			nor /= count;
-			nor.normalize();
-			norBuf[3*k+0] = float(nor(0));
-			norBuf[3*k+1] = float(nor(1));
-			norBuf[3*k+2] = float(nor(2));
-		}
+	// Normal: area-weighted sum over the drawn triangles, so broken
+	// triangles do not bend the normals at a tear
+	vector<Vector3d> normalAccumulator(n, Vector3d::Zero());
+	const vector<unsigned int> &ele = elements.indices();
+	for(size_t t = 0; t < ele.size(); t += 3) {
+		const Vector3d &x0 = particles.x[ele[t+0]];
+		const Vector3d &x1 = particles.x[ele[t+1]];
+		const Vector3d &x2 = particles.x[ele[t+2]];
+		Vector3d triNormal = (x1 - x0).cross(x2 - x0);
+		normalAccumulator[ele[t+0]] += triNormal;
+		normalAccumulator[ele[t+1]] += triNormal;
+		normalAccumulator[ele[t+2]] += triNormal;
+	}
+	for(int k = 0; k < n; ++k) {
+		Vector3d nor = normalAccumulator[k].stableNormalized();
+		norBuf[3*k+0] = float(nor(0));
+		norBuf[3*k+1] = float(nor(1));
+		norBuf[3*k+2] = float(nor(2));
 	}
 }
 
-// TODO: can rewrite this to take better advantage of tri struct. be careful not
-// to add to much compute when doing so.
-void Cloth::updateEle() {
-	eleBuf.clear();
-	for (int i = 0; i < rows - 1; i++) {
-		for (int j = 0; j < cols - 1; j++) {
-			bool brokenEdge = false;
-			for (int edge = 0; edge < 3; edge++) {
-				if (cells.at(i).at(j).tris[0].edgeSprings[edge]->broken) {
-					brokenEdge = true;
-					break;
-				}
-			}
-			if (!brokenEdge) {
-				eleBuf.push_back(i * cols + j);
-				eleBuf.push_back((i + 1) * cols + j);
-				eleBuf.push_back(i * cols + (j + 1));
-			}
+void Cloth::updateEle()
+{
+	// Only copies when a fracture changed the elements since this slot
+	RenderSnapshot &snapshot = snapshots.writeBuffer();
+	elements.copyTo(snapshot.eleBuf, snapshot.eleVersion);
+}
 
-			brokenEdge = false;
-			for (int edge = 0; edge < 3; edge++) {
-				if (cells.at(i).at(j).tris[1].edgeSprings[edge]->broken) {
-					brokenEdge = true;
-					break;
-				}
-			}
-			if (!brokenEdge) {
-				eleBuf.push_back(i * cols + (j + 1));
-				eleBuf.push_back((i + 1) * cols + j);
-				eleBuf.push_back((i + 1) * cols + (j + 1));
-			}
-		}
+void Cloth::applyFractures()
+{
+	for (uint32_t s : constraints.getFractures()) {
+		springTris.forEach(s, [&](int tri) {
+			tris[tri].broken = true;
+			elements.erase(tri);
+		});
+	}
+	constraints.clearFractures();
+}
+
+void Cloth::save(CheckpointWriter &out) const
+{
+	particles.save(out);
+	constraints.save(out);
+}
+
+bool Cloth::load(CheckpointReader &in)
+{
+	if (!particles.load(in) || !constraints.load(in)) {
+		return false;
 	}
+	applyFractures();
+	return true;
 }
 
 void Cloth::step(
@@ -331,226 +428,90 @@ void Cloth::step(
 	const std::vector< std::shared_ptr<Particle> > spheres,
 	const std::vector< std::shared_ptr<Plane> > planes,
 	const std::vector< std::shared_ptr<Cylinder> > cylinders,
-	const std::vector< std::shared_ptr<Tetrahedron> > tetrahedrons
+	const std::vector< std::shared_ptr<Tetrahedron> > tetrahedrons,
+	const std::vector< std::shared_ptr<ConvexPolytope> > polytopes
 ) {
+	STEP_TIMER_BEGIN(stats);
+
 	vector<Vector3d> windForces(particles.size(), Vector3d::Zero());
-	for (int i = 0; i < rows - 1; i++) {
-		for (int j = 0; j < cols - 1; j++) {
-			const Quad &Q = cells[i][j];
-			for (int t = 0; t < 2; t++) {
-				const Tri &T = Q.tris[t];
-
-				Vector3d &x0 = particles[T.index0]->x;
-				Vector3d &x1 = particles[T.index1]->x;
-				Vector3d &x2 = particles[T.index2]->x;
-
-				Vector3d normal = (x1 - x0).cross(x2 - x0);
-				double area = normal.norm();
-				normal.normalize();
-				double pressure = normal.dot(wind);
-				Vector3d triForce = normal * (pressure * area);
-				
-				windForces[T.index0] += triForce / 3.0;
-				windForces[T.index1] += triForce / 3.0;
-				windForces[T.index2] += triForce / 3.0;
-			}
-		}
+	for (const Tri &T : tris) {
+		const Vector3d &x0 = particles.x[T.index0];
+		const Vector3d &x1 = particles.x[T.index1];
+		const Vector3d &x2 = particles.x[T.index2];
+
+		Vector3d normal = (x1 - x0).cross(x2 - x0);
+		double area = normal.norm();
+		normal.normalize();
+		double pressure = normal.dot(wind);
+		Vector3d triForce = normal * (pressure * area);
+		
+		windForces[T.index0] += triForce / 3.0;
+		windForces[T.index1] += triForce / 3.0;
+		windForces[T.index2] += triForce / 3.0;
 	}
-
-	for (int i = 0; i < particles.size(); i++) {
-		shared_ptr<Particle> particle = particles.at(i);
-		if (particle->fixed) {
-			particle->v = particle->v0;
+	STEP_TIMER_LAP(PHASE_WIND);
+
+	int n = particles.size();
+	vector<Vector3d> &X = particles.x;
+	// Bounds of the particles that can collide, for the broadphase
+	Aabb bounds;
+	double maxRadius = 0.0;
+	for (int i = 0; i < n; i++) {
+		if (particles.fixed[i]) {
+			particles.v[i] = particles.v0[i];
 			continue;
 		}
 
-		Vector3d particleForce = particle->m * grav 
-			- particle->d * particle->v 
-			+ windForces[i];
-		particle->v += (h / particle->m) * particleForce;
-		particle->p = particle->x;
-		particle->x += h * particle->v;
+		// a = g + (wind - d v) / m
+		Vector3d &v = particles.v[i];
+		v += h * (grav + particles.w[i] * (windForces[i] - particles.d[i] * v));
+		particles.p[i] = X[i];
+		X[i] += h * v;
+		bounds.grow(X[i]);
+		maxRadius = max(maxRadius, particles.r[i]);
 	}
+	STEP_TIMER_LAP(PHASE_INTEGRATE);
 
-	for (shared_ptr<Spring> spring : springs) {
-		if (spring->broken) {
-			continue;
-		}
-
-		Vector3d deltax = spring->p1->x - spring->p0->x;
-		double l = deltax.norm();
-		if (l >= spring->L * 2.5) {
-			spring->broken = true;
-			continue;
-		}
+	constraints.projectSprings(particles, h, threadPool.get());
+	applyFractures();
+	STEP_TIMER_LAP(PHASE_SPRINGS);
 
-		double C = l - spring->L;
-		Vector3d deltaC0 = -deltax / l;
-		Vector3d deltaC1 = deltax / l;
+	broadphase.build(bounds, maxRadius, spheres, planes, cylinders, tetrahedrons, polytopes);
+	STEP_TIMER_LAP(PHASE_BROADPHASE);
 
-		double w0 = 1.0 / spring->p0->m;
-		double w1 = 1.0 / spring->p1->m;
-		double lambda = -C / (w0 + w1 + spring->alpha / (h * h));
-
-		if (!spring->p0->fixed) {
-			spring->p0->x += lambda * w0 * deltaC0;
-		}
-		if (!spring->p1->fixed) {
-			spring->p1->x += lambda * w1 * deltaC1;
-		}
+	if (fusedCollision) {
+		colliders.build(broadphase.getSpheres(), broadphase.getPlanes(), broadphase.getCylinders(),
+			broadphase.getTetrahedrons(), broadphase.getPolytopes());
+		CollisionKernels::collide(particles, colliders);
+		STEP_TIMER_LAP(PHASE_COLLIDERS);
 	}
-
-	for (shared_ptr<Particle> sphere : spheres) {
-		for (shared_ptr<Particle> particle : particles) {
-			if (particle->fixed) {
-				continue;
-			}
-
-			if ((particle->x - sphere->x).norm() < particle->r + sphere->r) {
-				particle->x = (sphere->r + particle->r) * (particle->x - sphere->x).normalized() + sphere->x;
-			}
+	else {
+		for (shared_ptr<Particle> sphere : broadphase.getSpheres()) {
+			CollisionKernels::collide(particles, *sphere);
 		}
-	}
-
-	for (shared_ptr<Plane> plane : planes) {
-		for (shared_ptr<Particle> particle : particles) {
-			if (particle->fixed) {
-				continue;
-			}
+		STEP_TIMER_LAP(PHASE_SPHERES);
 
-			double distance = (particle->x - plane->x).dot(plane->n);
-			if (distance < particle->r) {
-				particle->x = particle->x - plane->n * (distance - particle->r);
-			}
+		for (shared_ptr<Plane> plane : broadphase.getPlanes()) {
+			CollisionKernels::collide(particles, *plane);
 		}
-	}
-
-	for (shared_ptr<Cylinder> cylinder : cylinders) {
-		for (shared_ptr<Particle> particle : particles) {
-			if (particle->fixed) {
-				continue;
-			}
-
-			double topDistance = (particle->x - (cylinder->x + cylinder->h * cylinder->axis)).dot(cylinder->axis) - particle->r;
-			double bottomDistance = (particle->x - cylinder->x).dot(-cylinder->axis) - particle->r;
+		STEP_TIMER_LAP(PHASE_PLANES);
 
-			Vector3d d = particle->x - cylinder->x;
-			d = d - (d.dot(cylinder->axis)) * cylinder->axis;
-			double radialDistance = d.norm() - cylinder->r - particle->r;
-
-			if (topDistance < 0.0 && bottomDistance < 0.0 && radialDistance < 0.0) {
-				if (topDistance > bottomDistance && topDistance > radialDistance) {
-					// Move above cylinder
-					particle->x = particle->x - cylinder->axis * topDistance;
-				}
-				else if (bottomDistance > radialDistance) {
-					// Move below cylinder
-					particle->x = particle->x + cylinder->axis * bottomDistance;
-				}
-				else {
-					// Move beside cylinder
-					particle->x = particle->x - d.normalized() * radialDistance;
-				}
-			}
+		for (shared_ptr<Cylinder> cylinder : broadphase.getCylinders()) {
+			CollisionKernels::collide(particles, *cylinder);
 		}
-	}
+		STEP_TIMER_LAP(PHASE_CYLINDERS);
 
-	for (shared_ptr<Tetrahedron> tetrahedron : tetrahedrons) {
-		std::array<Face, 4> faces = tetrahedron->getFaces();
-		for (shared_ptr<Particle> particle : particles) {
-			if (particle->fixed) {
-				continue;
-			}
-			
-			double constexpr negInfinity = -std::numeric_limits<double>::infinity();
-			double maxDistance = negInfinity;
-			int maxDistanceIndex = -1;
-			for (int i = 0; i < faces.size(); i++) {
-				double distance = (particle->x - faces[i].x).dot(faces[i].n) - particle->r;
-				if (distance > maxDistance) {
-					maxDistance = distance;
-					maxDistanceIndex = i;
-				}
-			}
-			if (maxDistance < 0.0) {
-				particle->x = particle->x - maxDistance * faces[maxDistanceIndex].n;
-			}
+		for (shared_ptr<Tetrahedron> tetrahedron : broadphase.getTetrahedrons()) {
+			CollisionKernels::collide(particles, tetrahedron->getPolytope());
+		}
+		for (shared_ptr<ConvexPolytope> polytope : broadphase.getPolytopes()) {
+			CollisionKernels::collide(particles, *polytope);
 		}
+		STEP_TIMER_LAP(PHASE_POLYTOPES);
 	}
 
-	for (shared_ptr<Particle> particle : particles) {
-		particle->v = (1 / h) * (particle->x - particle->p);
+	for (int i = 0; i < n; i++) {
+		particles.v[i] = (1 / h) * (X[i] - particles.p[i]);
 	}
-}
-
-void Cloth::init()
-{
-	glGenBuffers(1, &posBufID);
-	glBindBuffer(GL_ARRAY_BUFFER, posBufID);
-	glBufferData(GL_ARRAY_BUFFER, posBuf.size()*sizeof(float), &posBuf[0], GL_DYNAMIC_DRAW);
-	
-	glGenBuffers(1, &norBufID);
-	glBindBuffer(GL_ARRAY_BUFFER, norBufID);
-	glBufferData(GL_ARRAY_BUFFER, norBuf.size()*sizeof(float), &norBuf[0], GL_DYNAMIC_DRAW);
-	
-	glGenBuffers(1, &texBufID);
-	glBindBuffer(GL_ARRAY_BUFFER, texBufID);
-	glBufferData(GL_ARRAY_BUFFER, texBuf.size()*sizeof(float), &texBuf[0], GL_STATIC_DRAW);
-	
-	glGenBuffers(1, &eleBufID);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, eleBufID);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, eleBuf.size()*sizeof(unsigned int), &eleBuf[0], GL_DYNAMIC_DRAW);
-	
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-	
-	assert(glGetError() == GL_NO_ERROR);
-}
-
-void Cloth::draw(shared_ptr<MatrixStack> M, const shared_ptr<Program> p) {
-	updatePosNor();
-	updateEle();
-
-	// Draw mesh
-	int kdFrontID = p->getUniform("kdFront");
-	if (kdFrontID != -1) {
-		glUniform3f(kdFrontID, 0.894f, 0.882f, 0.792f);
-	}
-	int kdBackID = p->getUniform("kdBack");
-	if (kdBackID != -1) {
-		glUniform3f(kdBackID, 0.776f, 0.843f, 0.835f);
-	}
-	M->pushMatrix();
-	glUniformMatrix4fv(p->getUniform("M"), 1, GL_FALSE, glm::value_ptr(M->topMatrix()));
-	int h_pos = p->getAttribute("aPos");
-	glEnableVertexAttribArray(h_pos);
-	glBindBuffer(GL_ARRAY_BUFFER, posBufID);
-	glBufferData(GL_ARRAY_BUFFER, posBuf.size()*sizeof(float), &posBuf[0], GL_DYNAMIC_DRAW);
-	glVertexAttribPointer(h_pos, 3, GL_FLOAT, GL_FALSE, 0, (const void *)0);
-	int h_nor = p->getAttribute("aNor");
-	if (h_nor >= 0) {
-		glEnableVertexAttribArray(h_nor);
-		glBindBuffer(GL_ARRAY_BUFFER, norBufID);
-		glBufferData(GL_ARRAY_BUFFER, norBuf.size() * sizeof(float), &norBuf[0], GL_DYNAMIC_DRAW);
-		glVertexAttribPointer(h_nor, 3, GL_FLOAT, GL_FALSE, 0, (const void *)0);
-	}
-	int h_tex = p->getAttribute("aTex");
-	if(h_tex >= 0) {
-		glEnableVertexAttribArray(h_tex);
-		glBindBuffer(GL_ARRAY_BUFFER, texBufID);
-		glVertexAttribPointer(h_tex, 2, GL_FLOAT, GL_FALSE, 0, (const void *)0);
-	}
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, eleBufID);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, eleBuf.size()*sizeof(unsigned int), &eleBuf[0], GL_DYNAMIC_DRAW);
-	glDrawElements(GL_TRIANGLES, eleBuf.size(), GL_UNSIGNED_INT, 0);
-	if(h_tex >= 0) {
-		glDisableVertexAttribArray(h_tex);
-	}
-	if (h_nor >= 0) {
-		glDisableVertexAttribArray(h_nor);
-	}
-	glDisableVertexAttribArray(h_pos);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-	M->popMatrix();
+	STEP_TIMER_LAP(PHASE_VELOCITY);
 }
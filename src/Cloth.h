@@ -12,12 +12,22 @@
 #include "Plane.h"
 #include "Cylinder.h"
 #include "Tetrahedron.h"
-#include "Spring.h"
+#include "ConvexPolytope.h"
+#include "ParticleStore.h"
+#include "ConstraintTable.h"
 #include "Tri.h"
+#include "ElementList.h"
+#include "StepStats.h"
+#include "TripleBuffer.h"
+#include "RenderSnapshot.h"
+#include "CollisionKernels.h"
+#include "Broadphase.h"
 
 class Particle;
-class MatrixStack;
-class Program;
+class ThreadPool;
+class CheckpointWriter;
+class CheckpointReader;
+class TriMesh;
 
 class Cloth
 {
@@ -33,12 +43,31 @@ public:
 		  double alpha,
 		  double damping,
 		  double pradius);
+	// Arbitrary triangle mesh, e.g. a garment. Every triangle edge becomes
+	// a spring, and so does every pair of vertices across an edge shared by
+	// two triangles, to resist bending. No particles are fixed.
+	Cloth(const TriMesh &mesh,
+		  double mass,
+		  double alpha,
+		  double damping,
+		  double pradius);
 	virtual ~Cloth();
 	
+	void setThreadPool(std::shared_ptr<ThreadPool> pool);
+	// Resolve all colliders in one pass over the particles (the default)
+	// instead of one pass per collider. Both give the same positions.
+	void setFusedCollision(bool enabled) { fusedCollision = enabled; }
+	// Skip colliders nowhere near the body (on by default)
+	void setBroadphase(bool enabled) { broadphase.setEnabled(enabled); }
+	const Broadphase &getBroadphase() const { return broadphase; }
 	void tare();
 	void reset();
-	void updatePosNor();
-	void updateEle();
+	// Sim thread: write positions, normals and elements for the renderer
+	void publish();
+	// Particle state and broken springs, for Scene checkpoints. load needs
+	// a body with no broken springs, e.g. a freshly constructed one.
+	void save(CheckpointWriter &out) const;
+	bool load(CheckpointReader &in);
 	void step(
 		double h, 
 		const Eigen::Vector3d &grav, 
@@ -46,27 +75,40 @@ public:
 		const std::vector< std::shared_ptr<Particle> > spheres, 
 		const std::vector< std::shared_ptr<Plane> > planes,
 		const std::vector< std::shared_ptr<Cylinder> > cylinders,
-		const std::vector< std::shared_ptr<Tetrahedron> > tetrahedrons
+		const std::vector< std::shared_ptr<Tetrahedron> > tetrahedrons,
+		const std::vector< std::shared_ptr<ConvexPolytope> > polytopes
 	);
 	
-	void init();
-	void draw(std::shared_ptr<MatrixStack> M, const std::shared_ptr<Program> p);
+	const ParticleStore &getParticles() const { return particles; }
+	ParticleStore &getParticles() { return particles; }
+	// Triangles as drawn, with broken ones left out
+	const ElementList &getElements() const { return elements; }
+	const StepStats &getStats() const { return stats; }
+	void clearStats() { stats.clear(); }
+	const std::vector<float> &getTexBuf() const { return texBuf; }
+	// Render thread: picks up the latest published snapshot, never blocks.
+	// Returns false if there was nothing new since the last call.
+	bool acquireSnapshot() { return snapshots.acquire(); }
+	const RenderSnapshot &getSnapshot() const { return snapshots.readBuffer(); }
 	
 private:
-	int rows;
-	int cols;
-	std::vector< std::shared_ptr<Particle> > particles;
-	std::vector< std::shared_ptr<Spring> > springs;
-	std::vector< std::vector<Quad> > cells;
+	void updatePosNor();
+	void updateEle();
+	void applyFractures();
+
+	ParticleStore particles;
+	ConstraintTable constraints;
+	std::shared_ptr<ThreadPool> threadPool;
+	bool fusedCollision;
+	Broadphase broadphase;
+	ColliderList colliders;
+	StepStats stats;
+	std::vector<Tri> tris; // indexed by triangle id
+	SpringTriIndex springTris;
+	ElementList elements; // unbroken triangles
 	
-	std::vector<unsigned int> eleBuf;
-	std::vector<float> posBuf;
-	std::vector<float> norBuf;
+	TripleBuffer<RenderSnapshot> snapshots;
 	std::vector<float> texBuf;
-	unsigned eleBufID;
-	unsigned posBufID;
-	unsigned norBufID;
-	unsigned texBufID;
 };
 
 #endif
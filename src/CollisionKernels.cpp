@@ -0,0 +1,200 @@
+#include "CollisionKernels.h"
+#include "ParticleStore.h"
+#include "Particle.h"
+#include "Plane.h"
+#include "Cylinder.h"
+#include "Tetrahedron.h"
+#include "ConvexPolytope.h"
+
+using namespace std;
+using namespace Eigen;
+
+namespace {
+
+SimdLevel detectLevel()
+{
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+	__builtin_cpu_init();
+	if (avx2CollisionKernels() && __builtin_cpu_supports("avx2")) {
+		return SIMD_AVX2;
+	}
+#endif
+	if (sse2CollisionKernels()) {
+		return SIMD_SSE2;
+	}
+	return SIMD_SCALAR;
+}
+
+const CollisionKernelTable *tableFor(SimdLevel level)
+{
+	switch (level) {
+	case SIMD_AVX2:
+		return avx2CollisionKernels();
+	case SIMD_SSE2:
+		return sse2CollisionKernels();
+	default:
+		return scalarCollisionKernels();
+	}
+}
+
+SimdLevel &currentLevel()
+{
+	static SimdLevel level = CollisionKernels::getSupportedLevel();
+	return level;
+}
+
+const CollisionKernelTable &kernels()
+{
+	return *tableFor(currentLevel());
+}
+
+// The kernels treat the position array as packed xyz triples
+static_assert(sizeof(Vector3d) == 3 * sizeof(double), "Vector3d must be unpadded");
+
+double *positions(ParticleStore &particles)
+{
+	return particles.x.empty() ? nullptr : particles.x[0].data();
+}
+
+void copy3(double *out, const Vector3d &v)
+{
+	out[0] = v(0);
+	out[1] = v(1);
+	out[2] = v(2);
+}
+
+SphereParams sphereParams(const Particle &sphere)
+{
+	SphereParams s;
+	copy3(s.c, sphere.x);
+	s.r = sphere.r;
+	return s;
+}
+
+PlaneParams planeParams(const Plane &plane)
+{
+	PlaneParams p;
+	copy3(p.x, plane.x);
+	copy3(p.n, plane.n);
+	return p;
+}
+
+CylinderParams cylinderParams(const Cylinder &cylinder)
+{
+	CylinderParams c;
+	copy3(c.x, cylinder.x);
+	copy3(c.top, cylinder.x + cylinder.h * cylinder.axis);
+	copy3(c.axis, cylinder.axis);
+	c.r = cylinder.r;
+	return c;
+}
+
+PolytopeParams polytopeParams(const ConvexPolytope &polytope)
+{
+	PolytopeParams p;
+	p.halfSpaces = polytope.getHalfSpaces().data();
+	p.nPlanes = polytope.getPlaneCount();
+	return p;
+}
+
+}
+
+void ColliderList::build(
+	const vector< shared_ptr<Particle> > &spheres,
+	const vector< shared_ptr<Plane> > &planes,
+	const vector< shared_ptr<Cylinder> > &cylinders,
+	const vector< shared_ptr<Tetrahedron> > &tetrahedrons,
+	const vector< shared_ptr<ConvexPolytope> > &polytopes)
+{
+	this->spheres.clear();
+	for (const shared_ptr<Particle> &sphere : spheres) {
+		this->spheres.push_back(sphereParams(*sphere));
+	}
+	this->planes.clear();
+	for (const shared_ptr<Plane> &plane : planes) {
+		this->planes.push_back(planeParams(*plane));
+	}
+	this->cylinders.clear();
+	for (const shared_ptr<Cylinder> &cylinder : cylinders) {
+		this->cylinders.push_back(cylinderParams(*cylinder));
+	}
+	// Polytopes without planes (degenerate tetrahedra or meshes) are skipped
+	this->polytopes.clear();
+	for (const shared_ptr<Tetrahedron> &tetrahedron : tetrahedrons) {
+		if (tetrahedron->getPolytope().getPlaneCount() > 0) {
+			this->polytopes.push_back(polytopeParams(tetrahedron->getPolytope()));
+		}
+	}
+	for (const shared_ptr<ConvexPolytope> &polytope : polytopes) {
+		if (polytope->getPlaneCount() > 0) {
+			this->polytopes.push_back(polytopeParams(*polytope));
+		}
+	}
+}
+
+ColliderSet ColliderList::set() const
+{
+	ColliderSet set;
+	set.spheres = spheres.data();
+	set.nSpheres = (int)spheres.size();
+	set.planes = planes.data();
+	set.nPlanes = (int)planes.size();
+	set.cylinders = cylinders.data();
+	set.nCylinders = (int)cylinders.size();
+	set.polytopes = polytopes.data();
+	set.nPolytopes = (int)polytopes.size();
+	return set;
+}
+
+void CollisionKernels::collide(ParticleStore &particles, const Particle &sphere)
+{
+	kernels().sphere(positions(particles), particles.r.data(), particles.fixed.data(), particles.size(), sphereParams(sphere));
+}
+
+void CollisionKernels::collide(ParticleStore &particles, const Plane &plane)
+{
+	kernels().plane(positions(particles), particles.r.data(), particles.fixed.data(), particles.size(), planeParams(plane));
+}
+
+void CollisionKernels::collide(ParticleStore &particles, const Cylinder &cylinder)
+{
+	kernels().cylinder(positions(particles), particles.r.data(), particles.fixed.data(), particles.size(), cylinderParams(cylinder));
+}
+
+void CollisionKernels::collide(ParticleStore &particles, const ConvexPolytope &polytope)
+{
+	kernels().polytope(positions(particles), particles.r.data(), particles.fixed.data(), particles.size(), polytopeParams(polytope));
+}
+
+void CollisionKernels::collide(ParticleStore &particles, const ColliderList &colliders)
+{
+	kernels().fused(positions(particles), particles.r.data(), particles.fixed.data(), particles.size(), colliders.set());
+}
+
+SimdLevel CollisionKernels::getLevel()
+{
+	return currentLevel();
+}
+
+SimdLevel CollisionKernels::getSupportedLevel()
+{
+	static SimdLevel supported = detectLevel();
+	return supported;
+}
+
+void CollisionKernels::setLevel(SimdLevel level)
+{
+	currentLevel() = level < getSupportedLevel() ? level : getSupportedLevel();
+}
+
+const char *CollisionKernels::levelName(SimdLevel level)
+{
+	switch (level) {
+	case SIMD_AVX2:
+		return "avx2";
+	case SIMD_SSE2:
+		return "sse2";
+	default:
+		return "scalar";
+	}
+}
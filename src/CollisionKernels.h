@@ -0,0 +1,127 @@
+#pragma once
+#ifndef CollisionKernels_H
+#define CollisionKernels_H
+
+#include <vector>
+#include <memory>
+
+class ParticleStore;
+class Particle;
+class Plane;
+class Cylinder;
+class Tetrahedron;
+class ConvexPolytope;
+
+// Collider parameters as plain doubles, so that the SIMD kernels can be
+// compiled without Eigen (see CollisionKernelsSimd.h)
+struct SphereParams
+{
+	double c[3];
+	double r;
+};
+
+struct PlaneParams
+{
+	double x[3];
+	double n[3];
+};
+
+struct CylinderParams
+{
+	double x[3];
+	double top[3]; // x + h * axis
+	double axis[3];
+	double r;
+};
+
+struct PolytopeParams
+{
+	const double *halfSpaces; // nx, ny, nz, d per plane (see ConvexPolytope)
+	int nPlanes;
+};
+
+// All colliders a body is tested against, in the order they are applied
+struct ColliderSet
+{
+	const SphereParams *spheres;
+	int nSpheres;
+	const PlaneParams *planes;
+	int nPlanes;
+	const CylinderParams *cylinders;
+	int nCylinders;
+	const PolytopeParams *polytopes; // tetrahedrons first
+	int nPolytopes;
+};
+
+// One kernel per collider type, plus one that runs a whole ColliderSet in a
+// single pass. Each pushes the non-fixed particles out of
+// the collider. x holds n packed xyz triples, r and fixed hold n entries.
+struct CollisionKernelTable
+{
+	void (*sphere)(double *x, const double *r, const char *fixed, int n, const SphereParams &s);
+	void (*plane)(double *x, const double *r, const char *fixed, int n, const PlaneParams &p);
+	void (*cylinder)(double *x, const double *r, const char *fixed, int n, const CylinderParams &c);
+	void (*polytope)(double *x, const double *r, const char *fixed, int n, const PolytopeParams &p);
+	void (*fused)(double *x, const double *r, const char *fixed, int n, const ColliderSet &set);
+};
+
+/**
+ * Owns the parameters of a scene's colliders for the fused kernel. Rebuilt
+ * every step, since held objects move. Polytope planes are referenced, not
+ * copied, so the colliders must outlive the collision call.
+ */
+class ColliderList
+{
+public:
+	void build(
+		const std::vector< std::shared_ptr<Particle> > &spheres,
+		const std::vector< std::shared_ptr<Plane> > &planes,
+		const std::vector< std::shared_ptr<Cylinder> > &cylinders,
+		const std::vector< std::shared_ptr<Tetrahedron> > &tetrahedrons,
+		const std::vector< std::shared_ptr<ConvexPolytope> > &polytopes);
+	ColliderSet set() const;
+
+private:
+	std::vector<SphereParams> spheres;
+	std::vector<PlaneParams> planes;
+	std::vector<CylinderParams> cylinders;
+	std::vector<PolytopeParams> polytopes;
+};
+
+enum SimdLevel {
+	SIMD_SCALAR,
+	SIMD_SSE2,
+	SIMD_AVX2
+};
+
+/**
+ * Particle-collider resolution over a body's particle arrays. The kernels
+ * run 1, 2 (SSE2) or 4 (AVX2) particles at a time; the widest level the
+ * CPU supports is picked at startup. All levels give bitwise identical
+ * results, since they perform the same operations in the same order.
+ */
+class CollisionKernels
+{
+public:
+	static void collide(ParticleStore &particles, const Particle &sphere);
+	static void collide(ParticleStore &particles, const Plane &plane);
+	static void collide(ParticleStore &particles, const Cylinder &cylinder);
+	static void collide(ParticleStore &particles, const ConvexPolytope &polytope);
+	// Every collider in one pass over the particles. Same result as calling
+	// collide for each sphere, plane, cylinder and polytope in order.
+	static void collide(ParticleStore &particles, const ColliderList &colliders);
+
+	static SimdLevel getLevel();
+	static SimdLevel getSupportedLevel();
+	// Clamped to the supported level. Not thread safe; set before stepping.
+	static void setLevel(SimdLevel level);
+	static const char *levelName(SimdLevel level);
+};
+
+// Defined in CollisionKernelsScalar/Sse2/Avx2.cpp. The SIMD tables are null
+// when the compiler cannot target that instruction set.
+const CollisionKernelTable *scalarCollisionKernels();
+const CollisionKernelTable *sse2CollisionKernels();
+const CollisionKernelTable *avx2CollisionKernels();
+
+#endif
@@ -0,0 +1,85 @@
+// Compiled with AVX2 enabled (see CMakeLists.txt) and only called after a
+// runtime check, so nothing here may be shared with other translation units.
+#include "CollisionKernelsSimd.h"
+
+#ifdef __AVX2__
+
+#include <immintrin.h>
+
+namespace {
+
+// Four particles per step
+struct Avx2Ops
+{
+	enum { W = 4 };
+	typedef __m256d D;
+	typedef __m256d M;
+
+	static D set1(double a) { return _mm256_set1_pd(a); }
+	static D load(const double *p) { return _mm256_loadu_pd(p); }
+	static void load3(const double *p, D &x, D &y, D &z)
+	{
+		D a = _mm256_loadu_pd(p);     // x0 y0 z0 x1
+		D b = _mm256_loadu_pd(p + 4); // y1 z1 x2 y2
+		D c = _mm256_loadu_pd(p + 8); // z2 x3 y3 z3
+		D xy = _mm256_permute2f128_pd(a, b, 0x30); // x0 y0 x2 y2
+		D zx = _mm256_permute2f128_pd(a, c, 0x21); // z0 x1 z2 x3
+		D yz = _mm256_permute2f128_pd(b, c, 0x30); // y1 z1 y3 z3
+		x = _mm256_shuffle_pd(xy, zx, 0xA);
+		y = _mm256_shuffle_pd(xy, yz, 0x5);
+		z = _mm256_shuffle_pd(zx, yz, 0xA);
+	}
+	static M live(const char *fixed)
+	{
+		int bytes;
+		__builtin_memcpy(&bytes, fixed, sizeof(bytes));
+		__m256i f = _mm256_cvtepi8_epi64(_mm_cvtsi32_si128(bytes));
+		return _mm256_castsi256_pd(_mm256_cmpeq_epi64(f, _mm256_setzero_si256()));
+	}
+	static D add(D a, D b) { return _mm256_add_pd(a, b); }
+	static D sub(D a, D b) { return _mm256_sub_pd(a, b); }
+	static D mul(D a, D b) { return _mm256_mul_pd(a, b); }
+	static D div(D a, D b) { return _mm256_div_pd(a, b); }
+	static D sqrt(D a) { return _mm256_sqrt_pd(a); }
+	static M lt(D a, D b) { return _mm256_cmp_pd(a, b, _CMP_LT_OQ); }
+	static M gt(D a, D b) { return _mm256_cmp_pd(a, b, _CMP_GT_OQ); }
+	static M none() { return _mm256_setzero_pd(); }
+	static M land(M a, M b) { return _mm256_and_pd(a, b); }
+	static M lor(M a, M b) { return _mm256_or_pd(a, b); }
+	static M landnot(M a, M b) { return _mm256_andnot_pd(b, a); }
+	static bool any(M m) { return _mm256_movemask_pd(m) != 0; }
+	static D select(M m, D a, D b) { return _mm256_blendv_pd(b, a, m); }
+	// Inverse of load3, writing only the triples of lanes set in m
+	static void store3(double *p, M m, D x, D y, D z)
+	{
+		D xy = _mm256_shuffle_pd(x, y, 0x0); // x0 y0 x2 y2
+		D zx = _mm256_shuffle_pd(z, x, 0xA); // z0 x1 z2 x3
+		D yz = _mm256_shuffle_pd(y, z, 0xF); // y1 z1 y3 z3
+		D a = _mm256_permute2f128_pd(xy, zx, 0x20);
+		D b = _mm256_permute2f128_pd(yz, xy, 0x30);
+		D c = _mm256_permute2f128_pd(zx, yz, 0x31);
+		// Spread each lane's mask over its three doubles
+		__m256i ma = _mm256_castpd_si256(_mm256_permute4x64_pd(m, 0x40)); // m0 m0 m0 m1
+		__m256i mb = _mm256_castpd_si256(_mm256_permute4x64_pd(m, 0xA5)); // m1 m1 m2 m2
+		__m256i mc = _mm256_castpd_si256(_mm256_permute4x64_pd(m, 0xFE)); // m2 m3 m3 m3
+		_mm256_maskstore_pd(p, ma, a);
+		_mm256_maskstore_pd(p + 4, mb, b);
+		_mm256_maskstore_pd(p + 8, mc, c);
+	}
+};
+
+}
+
+const CollisionKernelTable *avx2CollisionKernels()
+{
+	return &WideKernels<Avx2Ops>::table;
+}
+
+#else
+
+const CollisionKernelTable *avx2CollisionKernels()
+{
+	return nullptr;
+}
+
+#endif
@@ -0,0 +1,13 @@
+#include "CollisionKernelsSimd.h"
+
+const CollisionKernelTable *scalarCollisionKernels()
+{
+	static const CollisionKernelTable table = {
+		&CollisionKernelsT<ScalarOps>::sphere,
+		&CollisionKernelsT<ScalarOps>::plane,
+		&CollisionKernelsT<ScalarOps>::cylinder,
+		&CollisionKernelsT<ScalarOps>::polytope,
+		&CollisionKernelsT<ScalarOps>::fused
+	};
+	return &table;
+}
@@ -0,0 +1,336 @@
+#pragma once
+#ifndef CollisionKernelsSimd_H
+#define CollisionKernelsSimd_H
+
+// Collision kernels written once against a small lane-ops interface and
+// instantiated per instruction set (scalar, SSE2, AVX2). Each .cpp that
+// includes this is compiled with its own target flags, so this header must
+// not pull in Eigen or other shared inline code, and everything in it has
+// internal linkage.
+//
+// The operation order mirrors the original Eigen expressions (dot products
+// as (x + y) + z, normalized() as v / sqrt(|v|^2)), so all instantiations
+// produce the same bits.
+//
+// Ops must provide:
+//   W                      lanes per step
+//   D, M                   value and mask types
+//   set1, load, load3      broadcast, load n doubles, load n xyz triples
+//   live(fixed)            lanes whose fixed flag is 0
+//   add, sub, mul, div, sqrt
+//   lt, gt                 compares
+//   none, land, lor, landnot  mask logic (landnot(a, b) = a & !b)
+//   any(m), select(m, a, b) (m ? a : b), store3(p, m, x, y, z)
+
+#include <cmath>
+#include <limits>
+
+#include "CollisionKernels.h"
+
+namespace {
+
+template <typename Ops>
+struct CollisionKernelsT
+{
+	typedef typename Ops::D D;
+	typedef typename Ops::M M;
+
+	static D dot(D x, D y, D z, D nx, D ny, D nz)
+	{
+		return Ops::add(Ops::add(Ops::mul(x, nx), Ops::mul(y, ny)), Ops::mul(z, nz));
+	}
+
+	// Each resolver pushes the live lanes of p out of one collider and
+	// returns the lanes it moved
+
+	static M sphereLanes(D &px, D &py, D &pz, D ri, M live, const SphereParams &s)
+	{
+		D cx = Ops::set1(s.c[0]);
+		D cy = Ops::set1(s.c[1]);
+		D cz = Ops::set1(s.c[2]);
+		D R = Ops::set1(s.r);
+		D dx = Ops::sub(px, cx);
+		D dy = Ops::sub(py, cy);
+		D dz = Ops::sub(pz, cz);
+		D d2 = dot(dx, dy, dz, dx, dy, dz);
+		D dist = Ops::sqrt(d2);
+		M hit = Ops::land(Ops::lt(dist, Ops::add(ri, R)), live);
+		if (!Ops::any(hit)) {
+			return hit;
+		}
+		// (R + r) * d.normalized() + c
+		M nonzero = Ops::gt(d2, Ops::set1(0.0));
+		D scale = Ops::add(R, ri);
+		D nx = Ops::select(nonzero, Ops::div(dx, dist), dx);
+		D ny = Ops::select(nonzero, Ops::div(dy, dist), dy);
+		D nz = Ops::select(nonzero, Ops::div(dz, dist), dz);
+		px = Ops::select(hit, Ops::add(Ops::mul(scale, nx), cx), px);
+		py = Ops::select(hit, Ops::add(Ops::mul(scale, ny), cy), py);
+		pz = Ops::select(hit, Ops::add(Ops::mul(scale, nz), cz), pz);
+		return hit;
+	}
+
+	static M planeLanes(D &px, D &py, D &pz, D ri, M live, const PlaneParams &p)
+	{
+		D nx = Ops::set1(p.n[0]);
+		D ny = Ops::set1(p.n[1]);
+		D nz = Ops::set1(p.n[2]);
+		D distance = dot(
+			Ops::sub(px, Ops::set1(p.x[0])),
+			Ops::sub(py, Ops::set1(p.x[1])),
+			Ops::sub(pz, Ops::set1(p.x[2])),
+			nx, ny, nz);
+		M hit = Ops::land(Ops::lt(distance, ri), live);
+		if (!Ops::any(hit)) {
+			return hit;
+		}
+		// x - n * (distance - r)
+		D depth = Ops::sub(distance, ri);
+		px = Ops::select(hit, Ops::sub(px, Ops::mul(nx, depth)), px);
+		py = Ops::select(hit, Ops::sub(py, Ops::mul(ny, depth)), py);
+		pz = Ops::select(hit, Ops::sub(pz, Ops::mul(nz, depth)), pz);
+		return hit;
+	}
+
+	static M cylinderLanes(D &px, D &py, D &pz, D ri, M live, const CylinderParams &c)
+	{
+		D ax = Ops::set1(c.axis[0]);
+		D ay = Ops::set1(c.axis[1]);
+		D az = Ops::set1(c.axis[2]);
+		D zero = Ops::set1(0.0);
+		D topDistance = Ops::sub(dot(
+			Ops::sub(px, Ops::set1(c.top[0])),
+			Ops::sub(py, Ops::set1(c.top[1])),
+			Ops::sub(pz, Ops::set1(c.top[2])),
+			ax, ay, az), ri);
+		D dx = Ops::sub(px, Ops::set1(c.x[0]));
+		D dy = Ops::sub(py, Ops::set1(c.x[1]));
+		D dz = Ops::sub(pz, Ops::set1(c.x[2]));
+		D bottomDistance = Ops::sub(dot(dx, dy, dz,
+			Ops::set1(-c.axis[0]), Ops::set1(-c.axis[1]), Ops::set1(-c.axis[2])), ri);
+		// Radial offset from the axis
+		D along = dot(dx, dy, dz, ax, ay, az);
+		dx = Ops::sub(dx, Ops::mul(along, ax));
+		dy = Ops::sub(dy, Ops::mul(along, ay));
+		dz = Ops::sub(dz, Ops::mul(along, az));
+		D d2 = dot(dx, dy, dz, dx, dy, dz);
+		D dNorm = Ops::sqrt(d2);
+		D radialDistance = Ops::sub(Ops::sub(dNorm, Ops::set1(c.r)), ri);
+
+		M hit = Ops::land(Ops::land(Ops::lt(topDistance, zero), Ops::lt(bottomDistance, zero)), Ops::lt(radialDistance, zero));
+		hit = Ops::land(hit, live);
+		if (!Ops::any(hit)) {
+			return hit;
+		}
+
+		// Move above, below or beside the cylinder, whichever is closest
+		M above = Ops::land(Ops::gt(topDistance, bottomDistance), Ops::gt(topDistance, radialDistance));
+		M below = Ops::landnot(Ops::gt(bottomDistance, radialDistance), above);
+		M nonzero = Ops::gt(d2, zero);
+		D ux = Ops::select(nonzero, Ops::div(dx, dNorm), dx);
+		D uy = Ops::select(nonzero, Ops::div(dy, dNorm), dy);
+		D uz = Ops::select(nonzero, Ops::div(dz, dNorm), dz);
+		D qx = Ops::sub(px, Ops::mul(ux, radialDistance));
+		D qy = Ops::sub(py, Ops::mul(uy, radialDistance));
+		D qz = Ops::sub(pz, Ops::mul(uz, radialDistance));
+		qx = Ops::select(below, Ops::add(px, Ops::mul(ax, bottomDistance)), qx);
+		qy = Ops::select(below, Ops::add(py, Ops::mul(ay, bottomDistance)), qy);
+		qz = Ops::select(below, Ops::add(pz, Ops::mul(az, bottomDistance)), qz);
+		qx = Ops::select(above, Ops::sub(px, Ops::mul(ax, topDistance)), qx);
+		qy = Ops::select(above, Ops::sub(py, Ops::mul(ay, topDistance)), qy);
+		qz = Ops::select(above, Ops::sub(pz, Ops::mul(az, topDistance)), qz);
+		px = Ops::select(hit, qx, px);
+		py = Ops::select(hit, qy, py);
+		pz = Ops::select(hit, qz, pz);
+		return hit;
+	}
+
+	static M polytopeLanes(D &px, D &py, D &pz, D ri, M live, const PolytopeParams &p)
+	{
+		// No planes (an empty or degenerate mesh) bounds nothing
+		if (p.nPlanes == 0) {
+			return Ops::none();
+		}
+		D zero = Ops::set1(0.0);
+		// Deepest plane wins; the first one on ties
+		D maxDistance = Ops::set1(-std::numeric_limits<double>::infinity());
+		D mx = zero;
+		D my = zero;
+		D mz = zero;
+		for (int k = 0; k < p.nPlanes; k++) {
+			const double *h = p.halfSpaces + 4 * k;
+			D nx = Ops::set1(h[0]);
+			D ny = Ops::set1(h[1]);
+			D nz = Ops::set1(h[2]);
+			D distance = Ops::sub(Ops::sub(dot(px, py, pz, nx, ny, nz), Ops::set1(h[3])), ri);
+			M deeper = Ops::gt(distance, maxDistance);
+			maxDistance = Ops::select(deeper, distance, maxDistance);
+			mx = Ops::select(deeper, nx, mx);
+			my = Ops::select(deeper, ny, my);
+			mz = Ops::select(deeper, nz, mz);
+		}
+		M hit = Ops::land(Ops::lt(maxDistance, zero), live);
+		if (!Ops::any(hit)) {
+			return hit;
+		}
+		px = Ops::select(hit, Ops::sub(px, Ops::mul(maxDistance, mx)), px);
+		py = Ops::select(hit, Ops::sub(py, Ops::mul(maxDistance, my)), py);
+		pz = Ops::select(hit, Ops::sub(pz, Ops::mul(maxDistance, mz)), pz);
+		return hit;
+	}
+
+	// One pass over the particles per collider
+	template <typename Params, M (*resolve)(D &, D &, D &, D, M, const Params &)>
+	static void sweep(double *x, const double *r, const char *fixed, int n, const Params &params)
+	{
+		for (int i = 0; i < n; i += Ops::W) {
+			D px, py, pz;
+			Ops::load3(x + 3 * i, px, py, pz);
+			M hit = resolve(px, py, pz, Ops::load(r + i), Ops::live(fixed + i), params);
+			if (Ops::any(hit)) {
+				Ops::store3(x + 3 * i, hit, px, py, pz);
+			}
+		}
+	}
+
+	static void sphere(double *x, const double *r, const char *fixed, int n, const SphereParams &s)
+	{
+		sweep<SphereParams, &sphereLanes>(x, r, fixed, n, s);
+	}
+
+	static void plane(double *x, const double *r, const char *fixed, int n, const PlaneParams &p)
+	{
+		sweep<PlaneParams, &planeLanes>(x, r, fixed, n, p);
+	}
+
+	static void cylinder(double *x, const double *r, const char *fixed, int n, const CylinderParams &c)
+	{
+		sweep<CylinderParams, &cylinderLanes>(x, r, fixed, n, c);
+	}
+
+	static void polytope(double *x, const double *r, const char *fixed, int n, const PolytopeParams &p)
+	{
+		sweep<PolytopeParams, &polytopeLanes>(x, r, fixed, n, p);
+	}
+
+	// A single pass over the particles: each group of lanes is loaded once,
+	// run through every collider in the per-collider order and stored once.
+	// Particles are independent, so the result is the same as sweeping each
+	// collider in turn.
+	static void fused(double *x, const double *r, const char *fixed, int n, const ColliderSet &set)
+	{
+		for (int i = 0; i < n; i += Ops::W) {
+			D px, py, pz;
+			Ops::load3(x + 3 * i, px, py, pz);
+			D ri = Ops::load(r + i);
+			M live = Ops::live(fixed + i);
+			M moved = Ops::none();
+			for (int k = 0; k < set.nSpheres; k++) {
+				moved = Ops::lor(moved, sphereLanes(px, py, pz, ri, live, set.spheres[k]));
+			}
+			for (int k = 0; k < set.nPlanes; k++) {
+				moved = Ops::lor(moved, planeLanes(px, py, pz, ri, live, set.planes[k]));
+			}
+			for (int k = 0; k < set.nCylinders; k++) {
+				moved = Ops::lor(moved, cylinderLanes(px, py, pz, ri, live, set.cylinders[k]));
+			}
+			for (int k = 0; k < set.nPolytopes; k++) {
+				moved = Ops::lor(moved, polytopeLanes(px, py, pz, ri, live, set.polytopes[k]));
+			}
+			if (Ops::any(moved)) {
+				Ops::store3(x + 3 * i, moved, px, py, pz);
+			}
+		}
+	}
+};
+
+// Runs the wide kernel over whole groups of Ops::W particles and the
+// scalar kernel over the remainder
+template <typename Ops, typename Scalar, typename Params>
+void runKernel(
+	void (*wide)(double *, const double *, const char *, int, const Params &),
+	void (*tail)(double *, const double *, const char *, int, const Params &),
+	double *x, const double *r, const char *fixed, int n, const Params &params)
+{
+	int body = n - n % Ops::W;
+	wide(x, r, fixed, body, params);
+	tail(x + 3 * body, r + body, fixed + body, n - body, params);
+}
+
+// Plain C++ lanes of width 1, used for the scalar level and for tails
+struct ScalarOps
+{
+	enum { W = 1 };
+	typedef double D;
+	typedef bool M;
+
+	static D set1(double a) { return a; }
+	static D load(const double *p) { return *p; }
+	static void load3(const double *p, D &x, D &y, D &z) { x = p[0]; y = p[1]; z = p[2]; }
+	static M live(const char *fixed) { return *fixed == 0; }
+	static D add(D a, D b) { return a + b; }
+	static D sub(D a, D b) { return a - b; }
+	static D mul(D a, D b) { return a * b; }
+	static D div(D a, D b) { return a / b; }
+	static D sqrt(D a) { return std::sqrt(a); }
+	static M lt(D a, D b) { return a < b; }
+	static M gt(D a, D b) { return a > b; }
+	static M none() { return false; }
+	static M land(M a, M b) { return a && b; }
+	static M lor(M a, M b) { return a || b; }
+	static M landnot(M a, M b) { return a && !b; }
+	static bool any(M m) { return m; }
+	static D select(M m, D a, D b) { return m ? a : b; }
+	static void store3(double *p, M m, D x, D y, D z)
+	{
+		if (m) {
+			p[0] = x;
+			p[1] = y;
+			p[2] = z;
+		}
+	}
+};
+
+// Table for a wide Ops type, finishing each body with scalar lanes
+template <typename Ops>
+struct WideKernels
+{
+	typedef CollisionKernelsT<Ops> Wide;
+	typedef CollisionKernelsT<ScalarOps> Tail;
+
+	static void sphere(double *x, const double *r, const char *fixed, int n, const SphereParams &s)
+	{
+		runKernel<Ops, ScalarOps>(&Wide::sphere, &Tail::sphere, x, r, fixed, n, s);
+	}
+	static void plane(double *x, const double *r, const char *fixed, int n, const PlaneParams &p)
+	{
+		runKernel<Ops, ScalarOps>(&Wide::plane, &Tail::plane, x, r, fixed, n, p);
+	}
+	static void cylinder(double *x, const double *r, const char *fixed, int n, const CylinderParams &c)
+	{
+		runKernel<Ops, ScalarOps>(&Wide::cylinder, &Tail::cylinder, x, r, fixed, n, c);
+	}
+	static void polytope(double *x, const double *r, const char *fixed, int n, const PolytopeParams &p)
+	{
+		runKernel<Ops, ScalarOps>(&Wide::polytope, &Tail::polytope, x, r, fixed, n, p);
+	}
+	static void fused(double *x, const double *r, const char *fixed, int n, const ColliderSet &set)
+	{
+		runKernel<Ops, ScalarOps>(&Wide::fused, &Tail::fused, x, r, fixed, n, set);
+	}
+
+	static const CollisionKernelTable table;
+};
+
+template <typename Ops>
+const CollisionKernelTable WideKernels<Ops>::table = {
+	&WideKernels<Ops>::sphere,
+	&WideKernels<Ops>::plane,
+	&WideKernels<Ops>::cylinder,
+	&WideKernels<Ops>::polytope,
+	&WideKernels<Ops>::fused
+};
+
+}
+
+#endif
@@ -0,0 +1,80 @@
+#include "CollisionKernelsSimd.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+
+#include <emmintrin.h>
+
+namespace {
+
+// Two particles per step
+struct Sse2Ops
+{
+	enum { W = 2 };
+	typedef __m128d D;
+	typedef __m128d M;
+
+	static D set1(double a) { return _mm_set1_pd(a); }
+	static D load(const double *p) { return _mm_loadu_pd(p); }
+	static void load3(const double *p, D &x, D &y, D &z)
+	{
+		D a = _mm_loadu_pd(p);     // x0 y0
+		D b = _mm_loadu_pd(p + 2); // z0 x1
+		D c = _mm_loadu_pd(p + 4); // y1 z1
+		x = _mm_shuffle_pd(a, b, 0x2);
+		y = _mm_shuffle_pd(a, c, 0x1);
+		z = _mm_shuffle_pd(b, c, 0x2);
+	}
+	static M live(const char *fixed)
+	{
+		return _mm_cmpeq_pd(_mm_set_pd(fixed[1], fixed[0]), _mm_setzero_pd());
+	}
+	static D add(D a, D b) { return _mm_add_pd(a, b); }
+	static D sub(D a, D b) { return _mm_sub_pd(a, b); }
+	static D mul(D a, D b) { return _mm_mul_pd(a, b); }
+	static D div(D a, D b) { return _mm_div_pd(a, b); }
+	static D sqrt(D a) { return _mm_sqrt_pd(a); }
+	static M lt(D a, D b) { return _mm_cmplt_pd(a, b); }
+	static M gt(D a, D b) { return _mm_cmpgt_pd(a, b); }
+	static M none() { return _mm_setzero_pd(); }
+	static M land(M a, M b) { return _mm_and_pd(a, b); }
+	static M lor(M a, M b) { return _mm_or_pd(a, b); }
+	static M landnot(M a, M b) { return _mm_andnot_pd(b, a); }
+	static bool any(M m) { return _mm_movemask_pd(m) != 0; }
+	static D select(M m, D a, D b) { return _mm_or_pd(_mm_and_pd(m, a), _mm_andnot_pd(m, b)); }
+	static void store3(double *p, M m, D x, D y, D z)
+	{
+		int bits = _mm_movemask_pd(m);
+		if (bits == 0x3) {
+			_mm_storeu_pd(p, _mm_shuffle_pd(x, y, 0x0));
+			_mm_storeu_pd(p + 2, _mm_shuffle_pd(z, x, 0x2));
+			_mm_storeu_pd(p + 4, _mm_shuffle_pd(y, z, 0x3));
+			return;
+		}
+		if (bits & 0x1) {
+			_mm_storel_pd(p, x);
+			_mm_storel_pd(p + 1, y);
+			_mm_storel_pd(p + 2, z);
+		}
+		if (bits & 0x2) {
+			_mm_storeh_pd(p + 3, x);
+			_mm_storeh_pd(p + 4, y);
+			_mm_storeh_pd(p + 5, z);
+		}
+	}
+};
+
+}
+
+const CollisionKernelTable *sse2CollisionKernels()
+{
+	return &WideKernels<Sse2Ops>::table;
+}
+
+#else
+
+const CollisionKernelTable *sse2CollisionKernels()
+{
+	return nullptr;
+}
+
+#endif
@@ -0,0 +1,433 @@
+#include <algorithm>
+#include <cassert>
+#include <numeric>
+
+#include "ConstraintTable.h"
+#include "ParticleStore.h"
+#include "ThreadPool.h"
+#include "Checkpoint.h"
+
+using namespace std;
+using namespace Eigen;
+
+size_t BitSet::count() const
+{
+	size_t c = 0;
+	for (uint64_t word : words) {
+		while (word) {
+			word &= word - 1;
+			++c;
+		}
+	}
+	return c;
+}
+
+ConstraintTable::ConstraintTable()
+{
+}
+
+ConstraintTable::~ConstraintTable()
+{
+}
+
+int ConstraintTable::addSpring(const ParticleStore &particles, int i0, int i1, double alpha)
+{
+	assert(i0 != i1);
+	if (i0 > i1) {
+		swap(i0, i1);
+	}
+	Spring spring;
+	spring.i0 = uint32_t(i0);
+	spring.i1 = uint32_t(i1);
+	spring.L = (particles.x0[i1] - particles.x0[i0]).norm();
+	spring.alpha = alpha;
+	springs.push_back(spring);
+	springBroken.resize(springs.size());
+	return numSprings() - 1;
+}
+
+int ConstraintTable::addVolume(const ParticleStore &particles, int i0, int i1, int i2, int i3, double alpha)
+{
+	int i[4] = { i0, i1, i2, i3 };
+	int edgeSprings[6];
+	int edges[6][2] = { {i0, i1}, {i0, i2}, {i0, i3}, {i1, i2}, {i1, i3}, {i2, i3} };
+	for (int e = 0; e < 6; e++) {
+		edgeSprings[e] = findSpring(edges[e][0], edges[e][1]);
+		assert(edgeSprings[e] >= 0);
+	}
+	return addVolume(particles, i, edgeSprings, alpha);
+}
+
+int ConstraintTable::addVolume(const ParticleStore &particles, const int i[4], const int edgeSprings[6], double alpha)
+{
+	const Vector3d &x0 = particles.x0[i[0]];
+	const Vector3d &x1 = particles.x0[i[1]];
+	const Vector3d &x2 = particles.x0[i[2]];
+	const Vector3d &x3 = particles.x0[i[3]];
+
+	Volume volume;
+	for (int k = 0; k < 4; k++) {
+		volume.i[k] = uint32_t(i[k]);
+	}
+	for (int e = 0; e < 6; e++) {
+		volume.springs[e] = uint32_t(edgeSprings[e]);
+	}
+	volume.volume0 = (1.0 / 6.0) * ((x1 - x0).cross(x2 - x0)).dot(x3 - x0);
+	volume.alpha = alpha;
+	volumes.push_back(volume);
+	volumeBroken.resize(volumes.size());
+	return numVolumes() - 1;
+}
+
+void ConstraintTable::sort()
+{
+	// Springs by (i0, i1)
+	vector<int> order(springs.size());
+	iota(order.begin(), order.end(), 0);
+	stable_sort(order.begin(), order.end(), [&](int a, int b) {
+		const Spring &sa = springs[a];
+		const Spring &sb = springs[b];
+		return sa.i0 != sb.i0 ? sa.i0 < sb.i0 : sa.i1 < sb.i1;
+	});
+	vector<uint32_t> newIndex(springs.size());
+	vector<Spring> sortedSprings(springs.size());
+	BitSet sortedSpringBroken;
+	sortedSpringBroken.resize(springs.size());
+	for (size_t k = 0; k < order.size(); k++) {
+		newIndex[order[k]] = uint32_t(k);
+		sortedSprings[k] = springs[order[k]];
+		if (springBroken.test(order[k])) {
+			sortedSpringBroken.set(k);
+		}
+	}
+	springs.swap(sortedSprings);
+	springBroken = sortedSpringBroken;
+	for (Volume &volume : volumes) {
+		for (int e = 0; e < 6; e++) {
+			volume.springs[e] = newIndex[volume.springs[e]];
+		}
+	}
+
+	// Volumes by lowest particle index
+	order.resize(volumes.size());
+	iota(order.begin(), order.end(), 0);
+	auto minIndex = [&](int v) {
+		const uint32_t *i = volumes[v].i;
+		return min(min(i[0], i[1]), min(i[2], i[3]));
+	};
+	stable_sort(order.begin(), order.end(), [&](int a, int b) {
+		return minIndex(a) < minIndex(b);
+	});
+	vector<Volume> sortedVolumes(volumes.size());
+	BitSet sortedVolumeBroken;
+	sortedVolumeBroken.resize(volumes.size());
+	for (size_t k = 0; k < order.size(); k++) {
+		sortedVolumes[k] = volumes[order[k]];
+		if (volumeBroken.test(order[k])) {
+			sortedVolumeBroken.set(k);
+		}
+	}
+	volumes.swap(sortedVolumes);
+	volumeBroken = sortedVolumeBroken;
+
+	// Volumes using each spring
+	springVolumeStart.assign(springs.size() + 1, 0);
+	for (const Volume &volume : volumes) {
+		for (int e = 0; e < 6; e++) {
+			springVolumeStart[volume.springs[e] + 1]++;
+		}
+	}
+	for (size_t k = 0; k < springs.size(); k++) {
+		springVolumeStart[k + 1] += springVolumeStart[k];
+	}
+	springVolumes.resize(springVolumeStart.back());
+	vector<int> fill(springVolumeStart.begin(), springVolumeStart.end() - 1);
+	for (size_t v = 0; v < volumes.size(); v++) {
+		for (int e = 0; e < 6; e++) {
+			springVolumes[fill[volumes[v].springs[e]]++] = int(v);
+		}
+	}
+}
+
+int ConstraintTable::findSpring(int i0, int i1) const
+{
+	if (i0 > i1) {
+		swap(i0, i1);
+	}
+	auto it = lower_bound(springs.begin(), springs.end(), make_pair(uint32_t(i0), uint32_t(i1)),
+		[](const Spring &s, const pair<uint32_t, uint32_t> &key) {
+			return s.i0 != key.first ? s.i0 < key.first : s.i1 < key.second;
+		});
+	if (it == springs.end() || it->i0 != uint32_t(i0) || it->i1 != uint32_t(i1)) {
+		return -1;
+	}
+	return int(it - springs.begin());
+}
+
+bool ConstraintTable::hasBrokenEdge(int v) const
+{
+	const uint32_t *s = volumes[v].springs;
+	for (int e = 0; e < 6; e++) {
+		if (springBroken.test(s[e])) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// Assigns each constraint the lowest color not yet used at any of its
+// particles. colorsUsed holds one bitmask of wordsPerParticle words per
+// particle, sized from the worst-case color count for the given degree.
+template <int N, class IndexFn, class SkipFn>
+static void greedyColor(
+	int nParticles,
+	int nConstraints,
+	IndexFn index,
+	SkipFn skip,
+	vector< vector<uint32_t> > &colors,
+	vector<int> &colorOf,
+	vector<int> &slot)
+{
+	vector<int> degree(nParticles, 0);
+	for (int c = 0; c < nConstraints; c++) {
+		for (int k = 0; k < N; k++) {
+			degree[index(c, k)]++;
+		}
+	}
+	int maxDegree = nParticles > 0 ? *max_element(degree.begin(), degree.end()) : 0;
+	int maxColors = N * max(maxDegree - 1, 0) + 1;
+	int words = (maxColors + 63) / 64;
+	vector<uint64_t> colorsUsed(size_t(nParticles) * words, 0);
+
+	colors.clear();
+	colorOf.assign(nConstraints, -1);
+	slot.assign(nConstraints, -1);
+	for (int c = 0; c < nConstraints; c++) {
+		if (skip(c)) {
+			continue;
+		}
+		uint32_t idx[N];
+		for (int k = 0; k < N; k++) {
+			idx[k] = index(c, k);
+		}
+		int color = -1;
+		for (int w = 0; w < words && color < 0; w++) {
+			uint64_t used = 0;
+			for (int k = 0; k < N; k++) {
+				used |= colorsUsed[size_t(idx[k]) * words + w];
+			}
+			if (~used) {
+				int bit = 0;
+				while ((used >> bit) & 1) {
+					bit++;
+				}
+				color = w * 64 + bit;
+			}
+		}
+		assert(color >= 0);
+		for (int k = 0; k < N; k++) {
+			colorsUsed[size_t(idx[k]) * words + color / 64] |= uint64_t(1) << (color % 64);
+		}
+		if (color >= (int)colors.size()) {
+			colors.resize(color + 1);
+		}
+		colorOf[c] = color;
+		slot[c] = (int)colors[color].size();
+		colors[color].push_back(uint32_t(c));
+	}
+}
+
+void ConstraintTable::color(int nParticles)
+{
+	greedyColor<2>(nParticles, numSprings(),
+		[this](int s, int k) { return k == 0 ? springs[s].i0 : springs[s].i1; },
+		[this](int s) { return springBroken.test(s); },
+		springColors, springColorOf, springSlot);
+	greedyColor<4>(nParticles, numVolumes(),
+		[this](int v, int k) { return volumes[v].i[k]; },
+		[this](int v) { return volumeBroken.test(v) || hasBrokenEdge(v); },
+		volumeColors, volumeColorOf, volumeSlot);
+}
+
+static void removeFromColor(int c, vector< vector<uint32_t> > &colors, vector<int> &colorOf, vector<int> &slot)
+{
+	int color = colorOf[c];
+	if (color < 0) {
+		return;
+	}
+	vector<uint32_t> &members = colors[color];
+	int last = members.back();
+	members[slot[c]] = last;
+	slot[last] = slot[c];
+	members.pop_back();
+	colorOf[c] = -1;
+	slot[c] = -1;
+}
+
+void ConstraintTable::uncolorSpring(int s)
+{
+	removeFromColor(s, springColors, springColorOf, springSlot);
+}
+
+void ConstraintTable::uncolorVolume(int v)
+{
+	removeFromColor(v, volumeColors, volumeColorOf, volumeSlot);
+}
+
+void ConstraintTable::breakSpring(int s)
+{
+	springBroken.set(s);
+	uncolorSpring(s);
+	fractures.push_back(uint32_t(s));
+	breakOrder.push_back(uint32_t(s));
+	for (int k = springVolumeStart[s]; k < springVolumeStart[s + 1]; k++) {
+		int v = springVolumes[k];
+		if (!volumeBroken.test(v)) {
+			volumeBroken.set(v);
+			uncolorVolume(v);
+		}
+	}
+}
+
+void ConstraintTable::save(CheckpointWriter &out) const
+{
+	out.array(breakOrder);
+	out.array(springBroken.words);
+	out.array(volumeBroken.words);
+}
+
+bool ConstraintTable::load(CheckpointReader &in)
+{
+	vector<uint32_t> order;
+	if (!breakOrder.empty() || !in.anyArray(order)) {
+		return false;
+	}
+	for (uint32_t s : order) {
+		if (s >= springs.size() || springBroken.test(s)) {
+			return false;
+		}
+		breakSpring(int(s));
+	}
+	// The flags follow from the break order; the stored ones catch a
+	// checkpoint from a body with different springs
+	vector<uint64_t> springWords(springBroken.words.size());
+	vector<uint64_t> volumeWords(volumeBroken.words.size());
+	return in.array(springWords) && in.array(volumeWords) &&
+		springWords == springBroken.words && volumeWords == volumeBroken.words;
+}
+
+void ConstraintTable::projectSprings(ParticleStore &particles, double h, ThreadPool *pool)
+{
+	vector<Vector3d> &X = particles.x;
+	const vector<double> &W = particles.w;
+	const vector<char> &fixed = particles.fixed;
+	double hh = h * h;
+	brokenScratch.resize(pool ? pool->size() : 1);
+
+	for (size_t c = 0; c < springColors.size(); c++) {
+		const vector<uint32_t> &members = springColors[c];
+		ThreadPool::parallelFor(pool, (int)members.size(), [&](int begin, int end, int worker) {
+			for (int k = begin; k < end; k++) {
+				int s = members[k];
+				const Spring &spring = springs[s];
+				Vector3d &x0 = X[spring.i0];
+				Vector3d &x1 = X[spring.i1];
+				Vector3d deltax = x1 - x0;
+				double l = deltax.norm();
+				if (l >= spring.L * 2.5) {
+					brokenScratch[worker].push_back(uint32_t(s));
+					continue;
+				}
+
+				double C = l - spring.L;
+				Vector3d deltaC0 = -deltax / l;
+				Vector3d deltaC1 = deltax / l;
+
+				double w0 = W[spring.i0];
+				double w1 = W[spring.i1];
+				double lambda = -C / (w0 + w1 + spring.alpha / hh);
+
+				if (!fixed[spring.i0]) {
+					x0 += lambda * w0 * deltaC0;
+				}
+				if (!fixed[spring.i1]) {
+					x1 += lambda * w1 * deltaC1;
+				}
+			}
+		}, 512);
+
+		// Chunks go to whichever worker is free, so sort the breaks to keep
+		// the fracture order (and what follows from it) independent of
+		// scheduling and thread count
+		vector<uint32_t> &broken = brokenScratch[0];
+		for (size_t w = 1; w < brokenScratch.size(); w++) {
+			broken.insert(broken.end(), brokenScratch[w].begin(), brokenScratch[w].end());
+			brokenScratch[w].clear();
+		}
+		std::sort(broken.begin(), broken.end());
+		for (uint32_t s : broken) {
+			breakSpring(s);
+		}
+		broken.clear();
+	}
+}
+
+void ConstraintTable::projectVolumes(ParticleStore &particles, double h, ThreadPool *pool)
+{
+	vector<Vector3d> &X = particles.x;
+	const vector<double> &W = particles.w;
+	const vector<char> &fixed = particles.fixed;
+	double hh = h * h;
+
+	// Broken volumes were already taken out of their colors by breakSpring
+	for (size_t c = 0; c < volumeColors.size(); c++) {
+		const vector<uint32_t> &members = volumeColors[c];
+		ThreadPool::parallelFor(pool, (int)members.size(), [&](int begin, int end, int) {
+			for (int k = begin; k < end; k++) {
+				int v = members[k];
+				const Volume &volume = volumes[v];
+				int i0 = volume.i[0];
+				int i1 = volume.i[1];
+				int i2 = volume.i[2];
+				int i3 = volume.i[3];
+				const Vector3d &x0 = X[i0];
+				const Vector3d &x1 = X[i1];
+				const Vector3d &x2 = X[i2];
+				const Vector3d &x3 = X[i3];
+
+				double volumeCurrent = (1.0 / 6.0) * ((x1 - x0).cross(x2 - x0)).dot(x3 - x0);
+				double C = 6.0 * (volumeCurrent - volume.volume0);
+
+				Vector3d deltaC0 = (x3 - x1).cross(x2 - x1);
+				Vector3d deltaC1 = (x2 - x0).cross(x3 - x0);
+				Vector3d deltaC2 = (x3 - x0).cross(x1 - x0);
+				Vector3d deltaC3 = (x1 - x0).cross(x2 - x0);
+
+				double w0 = W[i0];
+				double w1 = W[i1];
+				double w2 = W[i2];
+				double w3 = W[i3];
+
+				double lambda = -C /
+					(w0 * deltaC0.squaredNorm() +
+						w1 * deltaC1.squaredNorm() +
+						w2 * deltaC2.squaredNorm() +
+						w3 * deltaC3.squaredNorm() +
+						volume.alpha / hh);
+
+				if (!fixed[i0]) {
+					X[i0] += lambda * w0 * deltaC0;
+				}
+				if (!fixed[i1]) {
+					X[i1] += lambda * w1 * deltaC1;
+				}
+				if (!fixed[i2]) {
+					X[i2] += lambda * w2 * deltaC2;
+				}
+				if (!fixed[i3]) {
+					X[i3] += lambda * w3 * deltaC3;
+				}
+			}
+		}, 256);
+	}
+}
@@ -0,0 +1,114 @@
+#pragma once
+#ifndef ConstraintTable_H
+#define ConstraintTable_H
+
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+
+#include "Spring.h"
+#include "Volume.h"
+
+class ParticleStore;
+class ThreadPool;
+class CheckpointWriter;
+class CheckpointReader;
+
+/**
+ * Fixed-size bitset sized at runtime, one bit per constraint.
+ */
+class BitSet
+{
+public:
+	BitSet() : n(0) {}
+	void resize(size_t size) { n = size; words.resize((size + 63) / 64, 0); }
+	size_t size() const { return n; }
+	bool test(size_t i) const { return (words[i >> 6] >> (i & 63)) & 1; }
+	void set(size_t i) { words[i >> 6] |= uint64_t(1) << (i & 63); }
+	void reset(size_t i) { words[i >> 6] &= ~(uint64_t(1) << (i & 63)); }
+	void clear() { std::fill(words.begin(), words.end(), 0); }
+	size_t count() const;
+
+	std::vector<uint64_t> words;
+private:
+	size_t n;
+};
+
+/**
+ * Packed, index-based springs and tetra volumes of one body, with broken
+ * bitsets kept alongside. After sort() springs are ordered by particle
+ * index pair and volumes by their lowest particle index so that the solver
+ * walks the particle arrays mostly forward.
+ */
+class ConstraintTable
+{
+public:
+	ConstraintTable();
+	virtual ~ConstraintTable();
+
+	int addSpring(const ParticleStore &particles, int i0, int i1, double alpha);
+	// Edge springs must already exist and the springs must be sorted.
+	int addVolume(const ParticleStore &particles, int i0, int i1, int i2, int i3, double alpha);
+	// Same, with the springs of edges 01, 02, 03, 12, 13 and 23 given
+	int addVolume(const ParticleStore &particles, const int i[4], const int edgeSprings[6], double alpha);
+	void sort();
+	// Index of the spring between two particles, or -1. Requires sort().
+	int findSpring(int i0, int i1) const;
+
+	int numSprings() const { return (int)springs.size(); }
+	int numVolumes() const { return (int)volumes.size(); }
+	bool isSpringBroken(int s) const { return springBroken.test(s); }
+	bool isVolumeBroken(int v) const { return volumeBroken.test(v); }
+	bool hasBrokenEdge(int v) const;
+
+	// Springs that broke since the last clearFractures(), in break order.
+	// Volumes on a broken spring are broken along with it.
+	const std::vector<uint32_t> &getFractures() const { return fractures; }
+	void clearFractures() { fractures.clear(); }
+
+	// Broken flags and the order the springs broke in. load replays the
+	// breaks on an unbroken table, so the fracture list (and whatever the
+	// body builds from it) comes out as it did in the saved run.
+	void save(CheckpointWriter &out) const;
+	bool load(CheckpointReader &in);
+
+	// Greedy graph coloring: no two springs (or two volumes) in the same
+	// color share a particle, so each color can be projected in parallel.
+	void color(int nParticles);
+	// Drop broken constraints from their colors. The coloring stays valid
+	// since removing constraints cannot introduce conflicts.
+	void uncolorSpring(int s);
+	void uncolorVolume(int v);
+
+	// One XPBD sweep over the springs / volumes, color by color. Springs
+	// stretched past 2.5 times their rest length break and are recorded
+	// in the fracture list, in spring order whatever the thread count.
+	// pool may be null.
+	void projectSprings(ParticleStore &particles, double h, ThreadPool *pool);
+	void projectVolumes(ParticleStore &particles, double h, ThreadPool *pool);
+
+	std::vector<Spring> springs;
+	std::vector<Volume> volumes;
+	BitSet springBroken;
+	BitSet volumeBroken;
+
+	std::vector< std::vector<uint32_t> > springColors;
+	std::vector< std::vector<uint32_t> > volumeColors;
+
+private:
+	void breakSpring(int s);
+
+	std::vector<int> springColorOf; // -1 if uncolored
+	std::vector<int> springSlot;    // position within its color
+	std::vector<int> volumeColorOf;
+	std::vector<int> volumeSlot;
+	// Springs found broken by each worker during a parallel pass
+	std::vector< std::vector<uint32_t> > brokenScratch;
+	std::vector<uint32_t> fractures;
+	std::vector<uint32_t> breakOrder; // every spring broken so far
+	// Volumes using each spring, CSR, rebuilt by sort()
+	std::vector<int> springVolumeStart;
+	std::vector<int> springVolumes;
+};
+
+#endif
@@ -0,0 +1,73 @@
+#include <cmath>
+
+#include "ConvexPolytope.h"
+
+using namespace std;
+using namespace Eigen;
+
+ConvexPolytope::ConvexPolytope()
+{
+}
+
+ConvexPolytope::~ConvexPolytope()
+{
+}
+
+void ConvexPolytope::build(const vector<Vector3d> &vertices, const vector< array<int, 3> > &tris)
+{
+	halfSpaces.clear();
+	bounds.reset();
+	if (vertices.empty()) {
+		return;
+	}
+	Vector3d centroid = Vector3d::Zero();
+	for (const Vector3d &x : vertices) {
+		bounds.grow(x);
+		centroid += x;
+	}
+	centroid /= double(vertices.size());
+	double scale = (bounds.max - bounds.min).norm();
+
+	for (const array<int, 3> &tri : tris) {
+		const Vector3d &p0 = vertices[tri[0]];
+		Vector3d n = (vertices[tri[1]] - p0).cross(vertices[tri[2]] - p0);
+		if (n.norm() <= 1e-12 * scale * scale) {
+			// Degenerate triangle
+			continue;
+		}
+		n.normalize();
+		if (n.dot(centroid - p0) > 0.0) {
+			n *= -1.0;
+		}
+		double d = n.dot(p0);
+
+		// Skip triangles in a plane we already have
+		bool found = false;
+		for (size_t k = 0; k < halfSpaces.size() && !found; k += 4) {
+			Vector3d m(halfSpaces[k], halfSpaces[k + 1], halfSpaces[k + 2]);
+			found = n.dot(m) > 1.0 - 1e-9 && abs(d - halfSpaces[k + 3]) <= 1e-6 * scale;
+		}
+		if (!found) {
+			halfSpaces.push_back(n(0));
+			halfSpaces.push_back(n(1));
+			halfSpaces.push_back(n(2));
+			halfSpaces.push_back(d);
+		}
+	}
+}
+
+void ConvexPolytope::setMesh(const vector<float> &posBuf, const vector<unsigned int> &eleBuf, const Matrix4d &E)
+{
+	vector<Vector3d> vertices;
+	vector< array<int, 3> > tris;
+	int nVerts = (int)posBuf.size() / 3;
+	vertices.reserve(nVerts);
+	for (int i = 0; i < nVerts; i++) {
+		Vector4d x(posBuf[3 * i], posBuf[3 * i + 1], posBuf[3 * i + 2], 1.0);
+		vertices.push_back((E * x).head<3>());
+	}
+	for (size_t i = 0; i + 2 < eleBuf.size(); i += 3) {
+		tris.push_back({ { int(eleBuf[i]), int(eleBuf[i + 1]), int(eleBuf[i + 2]) } });
+	}
+	build(vertices, tris);
+}
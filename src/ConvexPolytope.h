@@ -0,0 +1,45 @@
+#pragma once
+#ifndef ConvexPolytope_H
+#define ConvexPolytope_H
+
+#include <vector>
+#include <array>
+
+#define EIGEN_DONT_ALIGN_STATICALLY
+#include <Eigen/Dense>
+
+#include "Aabb.h"
+
+/**
+ * Convex collider stored as the intersection of half-spaces n.dot(x) <= d
+ * with unit outward normals n. Built once from a closed convex triangle
+ * mesh; triangles lying in the same plane share a half-space, so e.g. a
+ * cube has 6. A particle inside is pushed out through the nearest plane.
+ */
+class ConvexPolytope
+{
+public:
+	EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+	ConvexPolytope();
+	virtual ~ConvexPolytope();
+
+	// Triangles as indices into vertices. Winding does not matter; normals
+	// are oriented away from the centroid of the vertices.
+	void build(const std::vector<Eigen::Vector3d> &vertices, const std::vector< std::array<int, 3> > &tris);
+	// Indexed triangles as in Shape, placed by E
+	void setMesh(const std::vector<float> &posBuf, const std::vector<unsigned int> &eleBuf,
+		const Eigen::Matrix4d &E = Eigen::Matrix4d::Identity());
+
+	// 0 for an empty or fully degenerate mesh, which collides with nothing
+	int getPlaneCount() const { return (int)(halfSpaces.size() / 4); }
+	// nx, ny, nz, d for each plane
+	const std::vector<double> &getHalfSpaces() const { return halfSpaces; }
+	const Aabb &getBounds() const { return bounds; }
+
+private:
+	std::vector<double> halfSpaces;
+	Aabb bounds;
+};
+
+#endif
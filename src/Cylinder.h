@@ -1,31 +1,12 @@
 #ifndef CYLINDER_H
 #define CYLINDER_H
 
-#include <memory>
-
 #define EIGEN_DONT_ALIGN_STATICALLY
 #include <Eigen/Dense>
 
-#define GLEW_STATIC
-#include <GL/glew.h>
-#include <GLFW/glfw3.h>
-
-#define GLM_FORCE_RADIANS
-#include <glm/glm.hpp>
-#include <glm/gtc/type_ptr.hpp>
-
-#define _USE_MATH_DEFINES
-#include <math.h>
-
-#include "Shape.h"
-#include "Program.h"
-#include "MatrixStack.h"
-
 class Cylinder {
-	const std::shared_ptr<Shape> cylinder;
 public:
-	Cylinder(const std::shared_ptr<Shape> shape);
-	void draw(std::shared_ptr<MatrixStack> M, const std::shared_ptr<Program> prog) const;
+	Cylinder();
 
 	double r; // radius
 	double h; // height
@@ -0,0 +1,66 @@
+#include <cassert>
+
+#include "ElementList.h"
+
+using namespace std;
+
+ElementList::ElementList() :
+	version(1)
+{
+}
+
+ElementList::~ElementList()
+{
+}
+
+void ElementList::reset(int capacity)
+{
+	elements.clear();
+	triOf.clear();
+	slotOf.assign(capacity, -1);
+	version++;
+}
+
+void ElementList::insert(int tri, unsigned int i0, unsigned int i1, unsigned int i2)
+{
+	assert(tri >= 0 && tri < (int)slotOf.size());
+	if (slotOf[tri] >= 0) {
+		return;
+	}
+	slotOf[tri] = (int)triOf.size();
+	triOf.push_back(tri);
+	elements.push_back(i0);
+	elements.push_back(i1);
+	elements.push_back(i2);
+	version++;
+}
+
+void ElementList::erase(int tri)
+{
+	assert(tri >= 0 && tri < (int)slotOf.size());
+	int slot = slotOf[tri];
+	if (slot < 0) {
+		return;
+	}
+	int last = (int)triOf.size() - 1;
+	if (slot != last) {
+		int moved = triOf[last];
+		triOf[slot] = moved;
+		slotOf[moved] = slot;
+		for (int k = 0; k < 3; k++) {
+			elements[3 * slot + k] = elements[3 * last + k];
+		}
+	}
+	triOf.pop_back();
+	elements.resize(3 * last);
+	slotOf[tri] = -1;
+	version++;
+}
+
+void ElementList::copyTo(vector<unsigned int> &out, unsigned long &outVersion) const
+{
+	if (outVersion != version) {
+		out = elements;
+		outVersion = version;
+	}
+}
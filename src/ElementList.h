@@ -0,0 +1,83 @@
+#pragma once
+#ifndef ElementList_H
+#define ElementList_H
+
+#include <vector>
+
+/**
+ * Triangle index buffer that is patched in place as triangles appear or
+ * break, instead of being rebuilt every frame. Triangles are identified by
+ * a body-specific id in [0, capacity). Every change bumps the version, so
+ * consumers can skip copying and uploading when nothing happened.
+ */
+class ElementList
+{
+public:
+	ElementList();
+	virtual ~ElementList();
+
+	// Empties the list and sets the range of triangle ids
+	void reset(int capacity);
+	// Appends a triangle unless it is already present
+	void insert(int tri, unsigned int i0, unsigned int i1, unsigned int i2);
+	// Removes a triangle if present by moving the last one into its slot
+	void erase(int tri);
+	bool contains(int tri) const { return slotOf[tri] >= 0; }
+
+	int size() const { return (int)triOf.size(); }
+	int capacity() const { return (int)slotOf.size(); }
+	const std::vector<unsigned int> &indices() const { return elements; }
+	unsigned long getVersion() const { return version; }
+	// Copies the indices into out if its version is stale
+	void copyTo(std::vector<unsigned int> &out, unsigned long &outVersion) const;
+
+private:
+	std::vector<unsigned int> elements; // 3 per triangle
+	std::vector<int> slotOf;            // triangle id -> slot, -1 if absent
+	std::vector<int> triOf;             // slot -> triangle id
+	unsigned long version;
+};
+
+/**
+ * For each spring, the triangles that have it as an edge (CSR), so that a
+ * fracture can find its triangles without scanning the body.
+ */
+class SpringTriIndex
+{
+public:
+	// edgeSpring(tri, e) returns the spring of edge e in [0, 3) of tri
+	template <typename F>
+	void build(int nSprings, int nTris, F edgeSpring)
+	{
+		start.assign(nSprings + 1, 0);
+		for (int t = 0; t < nTris; t++) {
+			for (int e = 0; e < 3; e++) {
+				start[edgeSpring(t, e) + 1]++;
+			}
+		}
+		for (int s = 0; s < nSprings; s++) {
+			start[s + 1] += start[s];
+		}
+		tris.resize(start.back());
+		std::vector<int> fill(start.begin(), start.end() - 1);
+		for (int t = 0; t < nTris; t++) {
+			for (int e = 0; e < 3; e++) {
+				tris[fill[edgeSpring(t, e)]++] = t;
+			}
+		}
+	}
+
+	template <typename F>
+	void forEach(int s, F fn) const
+	{
+		for (int k = start[s]; k < start[s + 1]; k++) {
+			fn(tris[k]);
+		}
+	}
+
+private:
+	std::vector<int> start;
+	std::vector<int> tris;
+};
+
+#endif
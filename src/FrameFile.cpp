@@ -0,0 +1,285 @@
+#include <iostream>
+#include <cstring>
+#include <algorithm>
+
+#include "FrameFile.h"
+#include "Scene.h"
+#include "Cloth.h"
+#include "SoftBody.h"
+
+using namespace std;
+using namespace Eigen;
+
+static const char MAGIC[8] = { 'S', 'I', 'M', 'F', 'R', 'M', 'S', '2' };
+static const char ELE_MAGIC[8] = { 'S', 'I', 'M', 'F', 'E', 'L', 'E', '1' };
+
+// Frame layout: uint64 step, double t, then per body uint64 offset of its
+// elements in path.ele, uint32 element version, uint32 element count and
+// float positions[3 * particles], padded to a multiple of 8 bytes.
+// path.ele is ELE_MAGIC followed by uint32 element lists.
+static const size_t FRAME_HEADER = sizeof(uint64_t) + sizeof(double);
+static const size_t BODY_HEADER = sizeof(uint64_t) + 2 * sizeof(uint32_t);
+
+static size_t bodyBlockSize(uint32_t nParticles)
+{
+	return BODY_HEADER + nParticles * 3 * sizeof(float);
+}
+
+static size_t padTo8(size_t size)
+{
+	return (size + 7) & ~size_t(7);
+}
+
+template <typename T>
+static void put(char *dst, const T &v)
+{
+	memcpy(dst, &v, sizeof(T));
+}
+
+template <typename T>
+static T get(const char *src)
+{
+	T v;
+	memcpy(&v, src, sizeof(T));
+	return v;
+}
+
+FrameRecorder::FrameRecorder() :
+	interval(1),
+	steps(0),
+	frames(0),
+	eleSize(0)
+{
+}
+
+bool FrameRecorder::open(const string &path, const Scene &scene, int interval)
+{
+	close();
+	this->path = path;
+	out.open(path, ios::binary | ios::trunc);
+	if (!out) {
+		cerr << "Cannot open " << path << endl;
+		return false;
+	}
+	eleOut.open(path + ".ele", ios::binary | ios::trunc);
+	if (!eleOut) {
+		cerr << "Cannot open " << path << ".ele" << endl;
+		out.close();
+		return false;
+	}
+	eleOut.write(ELE_MAGIC, sizeof(ELE_MAGIC));
+	eleSize = sizeof(ELE_MAGIC);
+	this->interval = max(1, interval);
+	steps = 0;
+	frames = 0;
+
+	vector<uint32_t> particleCounts;
+	for (shared_ptr<Cloth> cloth : scene.getCloths()) {
+		particleCounts.push_back(uint32_t(cloth->getParticles().size()));
+	}
+	for (shared_ptr<SoftBody> softBody : scene.getSoftBodies()) {
+		particleCounts.push_back(uint32_t(softBody->getParticles().size()));
+	}
+	// Nothing written yet, so the first capture writes every list
+	eleVersions.assign(particleCounts.size(), ~0ul);
+	eleOffsets.assign(particleCounts.size(), 0);
+	eleCounts.assign(particleCounts.size(), 0);
+
+	vector<char> header(sizeof(MAGIC) + 2 * sizeof(uint32_t) + sizeof(double) + particleCounts.size() * sizeof(uint32_t));
+	char *p = header.data();
+	memcpy(p, MAGIC, sizeof(MAGIC));
+	p += sizeof(MAGIC);
+	put(p, uint32_t(particleCounts.size()));
+	put(p + sizeof(uint32_t), uint32_t(this->interval));
+	put(p + 2 * sizeof(uint32_t), scene.getTimeStep());
+	p += 2 * sizeof(uint32_t) + sizeof(double);
+	size_t size = FRAME_HEADER;
+	for (size_t b = 0; b < particleCounts.size(); b++) {
+		put(p, particleCounts[b]);
+		p += sizeof(uint32_t);
+		size += bodyBlockSize(particleCounts[b]);
+	}
+	out.write(header.data(), header.size());
+	// Padding stays zero
+	frame.assign(padTo8(size), 0);
+	return true;
+}
+
+void FrameRecorder::capture(const Scene &scene)
+{
+	if (!isOpen() || ++steps % interval != 0) {
+		return;
+	}
+	vector<const ParticleStore *> stores;
+	vector<const ElementList *> lists;
+	for (shared_ptr<Cloth> cloth : scene.getCloths()) {
+		stores.push_back(&cloth->getParticles());
+		lists.push_back(&cloth->getElements());
+	}
+	for (shared_ptr<SoftBody> softBody : scene.getSoftBodies()) {
+		stores.push_back(&softBody->getParticles());
+		lists.push_back(&softBody->getElements());
+	}
+
+	char *p = frame.data();
+	put(p, steps);
+	put(p + sizeof(uint64_t), scene.getTime());
+	p += FRAME_HEADER;
+	for (size_t b = 0; b < stores.size(); b++) {
+		const vector<Vector3d> &x = stores[b]->x;
+		if (lists[b]->getVersion() != eleVersions[b]) {
+			const vector<unsigned int> &ele = lists[b]->indices();
+			eleOut.write(reinterpret_cast<const char *>(ele.data()), ele.size() * sizeof(unsigned int));
+			eleVersions[b] = lists[b]->getVersion();
+			eleOffsets[b] = eleSize;
+			eleCounts[b] = uint32_t(ele.size());
+			eleSize += ele.size() * sizeof(unsigned int);
+		}
+		put(p, eleOffsets[b]);
+		put(p + sizeof(uint64_t), uint32_t(eleVersions[b]));
+		put(p + sizeof(uint64_t) + sizeof(uint32_t), eleCounts[b]);
+		float *pos = reinterpret_cast<float *>(p + BODY_HEADER);
+		for (size_t i = 0; i < x.size(); i++) {
+			pos[3 * i + 0] = float(x[i](0));
+			pos[3 * i + 1] = float(x[i](1));
+			pos[3 * i + 2] = float(x[i](2));
+		}
+		p += bodyBlockSize(uint32_t(x.size()));
+	}
+	out.write(frame.data(), frame.size());
+	frames++;
+}
+
+bool FrameRecorder::close()
+{
+	if (!isOpen()) {
+		return true;
+	}
+	out.close();
+	eleOut.close();
+	if (!out || !eleOut) {
+		cerr << "Cannot write " << path << endl;
+		return false;
+	}
+	return true;
+}
+
+FrameFile::FrameFile() :
+	interval(1),
+	h(0.0),
+	headerSize(0),
+	frameSize(0),
+	frameCount(0)
+{
+}
+
+bool FrameFile::open(const string &path)
+{
+	close();
+	if (!file.open(path)) {
+		return false;
+	}
+	const char *p = file.data();
+	size_t fixedHeader = sizeof(MAGIC) + 2 * sizeof(uint32_t) + sizeof(double);
+	if (file.size() < fixedHeader || memcmp(p, MAGIC, sizeof(MAGIC)) != 0) {
+		cerr << path << " is not a frame file" << endl;
+		close();
+		return false;
+	}
+	p += sizeof(MAGIC);
+	uint32_t nBodies = get<uint32_t>(p);
+	interval = int(get<uint32_t>(p + sizeof(uint32_t)));
+	h = get<double>(p + 2 * sizeof(uint32_t));
+	p += 2 * sizeof(uint32_t) + sizeof(double);
+	headerSize = fixedHeader + size_t(nBodies) * sizeof(uint32_t);
+	if (file.size() < headerSize) {
+		cerr << path << " is not a frame file" << endl;
+		close();
+		return false;
+	}
+
+	frameSize = FRAME_HEADER;
+	for (uint32_t b = 0; b < nBodies; b++) {
+		uint32_t nParticles = get<uint32_t>(p);
+		p += sizeof(uint32_t);
+		particleCounts.push_back(nParticles);
+		bodyOffsets.push_back(frameSize);
+		frameSize += bodyBlockSize(nParticles);
+	}
+	frameSize = padTo8(frameSize);
+
+	if (!eleFile.open(path + ".ele")) {
+		close();
+		return false;
+	}
+	if (eleFile.size() < sizeof(ELE_MAGIC) || memcmp(eleFile.data(), ELE_MAGIC, sizeof(ELE_MAGIC)) != 0) {
+		cerr << path << ".ele is not a frame element file" << endl;
+		close();
+		return false;
+	}
+
+	// A partly written last frame is ignored, and so are frames whose
+	// elements did not make it to path.ele. Offsets only grow, so only the
+	// last frames need checking.
+	frameCount = (file.size() - headerSize) / frameSize;
+	while (frameCount > 0 && !elementsValid(frameCount - 1)) {
+		frameCount--;
+	}
+	return true;
+}
+
+bool FrameFile::elementsValid(size_t f) const
+{
+	for (size_t b = 0; b < bodyOffsets.size(); b++) {
+		const char *body = frameData(f) + bodyOffsets[b];
+		uint64_t offset = get<uint64_t>(body);
+		uint64_t count = get<uint32_t>(body + sizeof(uint64_t) + sizeof(uint32_t));
+		if (offset < sizeof(ELE_MAGIC) || offset % sizeof(uint32_t) != 0 ||
+			offset + count * sizeof(uint32_t) > eleFile.size()) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void FrameFile::close()
+{
+	file.close();
+	eleFile.close();
+	headerSize = 0;
+	frameSize = 0;
+	frameCount = 0;
+	particleCounts.clear();
+	bodyOffsets.clear();
+}
+
+uint64_t FrameFile::getStep(size_t f) const
+{
+	return get<uint64_t>(frameData(f));
+}
+
+double FrameFile::getTime(size_t f) const
+{
+	return get<double>(frameData(f) + sizeof(uint64_t));
+}
+
+const float *FrameFile::getPositions(size_t f, int body) const
+{
+	return reinterpret_cast<const float *>(frameData(f) + bodyOffsets[body] + BODY_HEADER);
+}
+
+const unsigned int *FrameFile::getElements(size_t f, int body) const
+{
+	uint64_t offset = get<uint64_t>(frameData(f) + bodyOffsets[body]);
+	return reinterpret_cast<const unsigned int *>(eleFile.data() + offset);
+}
+
+int FrameFile::getElementCount(size_t f, int body) const
+{
+	return int(get<uint32_t>(frameData(f) + bodyOffsets[body] + sizeof(uint64_t) + sizeof(uint32_t)));
+}
+
+uint32_t FrameFile::getElementVersion(size_t f, int body) const
+{
+	return get<uint32_t>(frameData(f) + bodyOffsets[body] + sizeof(uint64_t));
+}
@@ -0,0 +1,102 @@
+#pragma once
+#ifndef FrameFile_H
+#define FrameFile_H
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstddef>
+#include <cstdint>
+
+#include "MappedFile.h"
+
+class Scene;
+
+/**
+ * Fixed-layout recording of body frames for playback without simulating.
+ * Every frame has the same size: for each body (cloths first, then soft
+ * bodies) its packed xyz float positions and a reference to its element
+ * list, so frame i lives at a fixed offset and can be used straight from a
+ * mapping. Element lists only change when something breaks, so they go to
+ * a second file, path.ele, and only when a body's list has changed; frames
+ * point at the last list written for each body.
+ *
+ * Frames are written as they are captured and the frame count follows
+ * from the file size, so a recording cut short is still playable.
+ */
+class FrameRecorder
+{
+public:
+	FrameRecorder();
+
+	// Every interval-th capture() is kept. Returns false and prints an
+	// error if the file cannot be created.
+	bool open(const std::string &path, const Scene &scene, int interval = 1);
+	// Call after each Scene::step
+	void capture(const Scene &scene);
+	// False if any write failed
+	bool close();
+	bool isOpen() const { return out.is_open(); }
+	uint64_t getFrameCount() const { return frames; }
+
+private:
+	std::ofstream out;
+	std::ofstream eleOut;
+	std::string path;
+	int interval;
+	uint64_t steps;
+	uint64_t frames;
+	uint64_t eleSize; // bytes written to path.ele
+	// Per body: the element list last written to path.ele
+	std::vector<unsigned long> eleVersions;
+	std::vector<uint64_t> eleOffsets;
+	std::vector<uint32_t> eleCounts;
+	std::vector<char> frame;
+};
+
+/**
+ * Maps a FrameRecorder file and its path.ele. The accessors point into the
+ * mappings; the bytes are only read from disk when a frame is first
+ * touched.
+ */
+class FrameFile
+{
+public:
+	FrameFile();
+
+	// Returns false and prints an error if the file is not a frame file
+	bool open(const std::string &path);
+	void close();
+
+	size_t getFrameCount() const { return frameCount; }
+	int getBodyCount() const { return (int)particleCounts.size(); }
+	int getParticleCount(int body) const { return (int)particleCounts[body]; }
+	int getInterval() const { return interval; }
+	double getTimeStep() const { return h; }
+
+	uint64_t getStep(size_t f) const;
+	double getTime(size_t f) const;
+	const float *getPositions(size_t f, int body) const;
+	const unsigned int *getElements(size_t f, int body) const;
+	int getElementCount(size_t f, int body) const;
+	// ElementList version the elements were copied from. Within a file, two
+	// frames with the same version have the same elements.
+	uint32_t getElementVersion(size_t f, int body) const;
+
+private:
+	const char *frameData(size_t f) const { return file.data() + headerSize + f * frameSize; }
+
+	bool elementsValid(size_t f) const;
+
+	MappedFile file;
+	MappedFile eleFile;
+	int interval;
+	double h;
+	size_t headerSize;
+	size_t frameSize;
+	size_t frameCount;
+	std::vector<uint32_t> particleCounts;
+	std::vector<size_t> bodyOffsets; // within a frame
+};
+
+#endif
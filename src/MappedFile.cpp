@@ -0,0 +1,76 @@
+#include <iostream>
+#include <fstream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "MappedFile.h"
+
+using namespace std;
+
+MappedFile::MappedFile() :
+	ptr(nullptr),
+	length(0)
+{
+}
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+bool MappedFile::open(const string &path)
+{
+	close();
+#ifndef _WIN32
+	int fd = ::open(path.c_str(), O_RDONLY);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) != 0 || st.st_size == 0) {
+		cerr << "Cannot open " << path << endl;
+		if (fd >= 0) {
+			::close(fd);
+		}
+		return false;
+	}
+	void *mapped = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (mapped == MAP_FAILED) {
+		cerr << "Cannot map " << path << endl;
+		return false;
+	}
+	ptr = static_cast<const char *>(mapped);
+	length = size_t(st.st_size);
+#else
+	ifstream in(path, ios::binary | ios::ate);
+	if (!in || in.tellg() <= 0) {
+		cerr << "Cannot open " << path << endl;
+		return false;
+	}
+	buffer.resize(size_t(in.tellg()));
+	in.seekg(0);
+	if (!in.read(buffer.data(), buffer.size())) {
+		cerr << "Cannot read " << path << endl;
+		buffer.clear();
+		return false;
+	}
+	ptr = buffer.data();
+	length = buffer.size();
+#endif
+	return true;
+}
+
+void MappedFile::close()
+{
+#ifndef _WIN32
+	if (ptr) {
+		munmap(const_cast<char *>(ptr), length);
+	}
+#endif
+	buffer.clear();
+	ptr = nullptr;
+	length = 0;
+}
@@ -0,0 +1,36 @@
+#pragma once
+#ifndef MappedFile_H
+#define MappedFile_H
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+/**
+ * Read-only view of a whole file. Mapped with mmap where available, so
+ * pages are only read from disk (or the page cache) when touched; on other
+ * platforms the file is read into memory.
+ */
+class MappedFile
+{
+public:
+	MappedFile();
+	virtual ~MappedFile();
+	MappedFile(const MappedFile &) = delete;
+	MappedFile &operator=(const MappedFile &) = delete;
+
+	// Returns false and prints an error if the file cannot be read
+	bool open(const std::string &path);
+	void close();
+	bool isOpen() const { return ptr != nullptr; }
+
+	const char *data() const { return ptr; }
+	size_t size() const { return length; }
+
+private:
+	const char *ptr;
+	size_t length;
+	std::vector<char> buffer; // file contents where mmap is not available
+};
+
+#endif
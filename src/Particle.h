@@ -8,21 +8,15 @@
 #define EIGEN_DONT_ALIGN_STATICALLY
 #include <Eigen/Dense>
 
-class Shape;
-class Program;
-class MatrixStack;
-
 class Particle
 {
 public:
 	EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 	
 	Particle();
-	Particle(const std::shared_ptr<Shape> shape);
 	virtual ~Particle();
 	void tare();
 	void reset();
-	void draw(std::shared_ptr<MatrixStack> M, const std::shared_ptr<Program> p) const;
 	
 	double r; // radius
 	double m; // mass
@@ -33,9 +27,6 @@ public:
 	Eigen::Vector3d p;  // previous position
 	Eigen::Vector3d v;  // velocity
 	bool fixed;
-	
-private:
-	const std::shared_ptr<Shape> sphere;
 };
 
 #endif
@@ -0,0 +1,69 @@
+#include <cassert>
+
+#include "ParticleStore.h"
+#include "Checkpoint.h"
+
+using namespace std;
+using namespace Eigen;
+
+ParticleStore::ParticleStore()
+{
+}
+
+ParticleStore::~ParticleStore()
+{
+}
+
+void ParticleStore::reserve(int n)
+{
+	x.reserve(n);
+	p.reserve(n);
+	v.reserve(n);
+	x0.reserve(n);
+	v0.reserve(n);
+	w.reserve(n);
+	r.reserve(n);
+	d.reserve(n);
+	fixed.reserve(n);
+}
+
+int ParticleStore::add(const Vector3d &pos, double mass, double radius, double damping, bool isFixed)
+{
+	assert(mass > 0.0);
+	x.push_back(pos);
+	p.push_back(pos);
+	v.push_back(Vector3d::Zero());
+	x0.push_back(pos);
+	v0.push_back(Vector3d::Zero());
+	w.push_back(1.0 / mass);
+	r.push_back(radius);
+	d.push_back(damping);
+	fixed.push_back(isFixed ? 1 : 0);
+	return size() - 1;
+}
+
+void ParticleStore::tare()
+{
+	x0 = x;
+	v0 = v;
+}
+
+void ParticleStore::reset()
+{
+	x = x0;
+	v = v0;
+}
+
+void ParticleStore::save(CheckpointWriter &out) const
+{
+	out.array(x);
+	out.array(p);
+	out.array(v);
+	out.array(x0);
+	out.array(v0);
+}
+
+bool ParticleStore::load(CheckpointReader &in)
+{
+	return in.array(x) && in.array(p) && in.array(v) && in.array(x0) && in.array(v0);
+}
@@ -0,0 +1,45 @@
+#pragma once
+#ifndef ParticleStore_H
+#define ParticleStore_H
+
+#include <vector>
+
+#define EIGEN_DONT_ALIGN_STATICALLY
+#include <Eigen/Dense>
+
+class CheckpointWriter;
+class CheckpointReader;
+
+/**
+ * Contiguous structure-of-arrays storage for the particles of a body.
+ * Every attribute lives in its own array so that solver passes stream
+ * through memory instead of chasing one heap block per particle.
+ */
+class ParticleStore
+{
+public:
+	ParticleStore();
+	virtual ~ParticleStore();
+
+	void reserve(int n);
+	int add(const Eigen::Vector3d &pos, double mass, double radius, double damping, bool isFixed);
+	int size() const { return (int)x.size(); }
+	void tare();
+	void reset();
+	// Positions and velocities only; mass, radius, damping and fixed come
+	// from the body's constructor. load fails if the sizes differ.
+	void save(CheckpointWriter &out) const;
+	bool load(CheckpointReader &in);
+
+	std::vector<Eigen::Vector3d> x;  // position
+	std::vector<Eigen::Vector3d> p;  // previous position
+	std::vector<Eigen::Vector3d> v;  // velocity
+	std::vector<Eigen::Vector3d> x0; // initial position
+	std::vector<Eigen::Vector3d> v0; // initial velocity
+	std::vector<double> w; // inverse mass
+	std::vector<double> r; // radius
+	std::vector<double> d; // damping
+	std::vector<char> fixed;
+};
+
+#endif
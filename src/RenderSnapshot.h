@@ -0,0 +1,33 @@
+#pragma once
+#ifndef RenderSnapshot_H
+#define RenderSnapshot_H
+
+#include <vector>
+
+/**
+ * Everything the renderer needs from a body after a step: vertex positions
+ * and normals, and the element list with broken triangles left out.
+ * Published by the simulation thread through a TripleBuffer.
+ */
+struct RenderSnapshot
+{
+	std::vector<float> posBuf;
+	std::vector<float> norBuf;
+	std::vector<unsigned int> eleBuf;
+	unsigned long eleVersion = 0; // ElementList version eleBuf was copied from
+};
+
+/**
+ * Placement of the scene's colliders after a step, so that the renderer
+ * never reads collider lists the simulation thread may be changing (the
+ * held object is added and removed there).
+ */
+struct ColliderSnapshot
+{
+	std::vector<float> spheres;      // x, y, z, r per sphere
+	std::vector<float> planes;       // x, y, z per plane
+	std::vector<float> cylinders;    // x, y, z, axis x, y, z, r, h per cylinder
+	std::vector<float> tetrahedrons; // four corners, x, y, z each, per tetrahedron
+};
+
+#endif
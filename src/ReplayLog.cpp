@@ -0,0 +1,136 @@
+#include <iostream>
+#include <cstring>
+
+#include "ReplayLog.h"
+
+using namespace std;
+using namespace Eigen;
+
+static const char MAGIC[8] = { 'S', 'I', 'M', 'R', 'P', 'L', 'Y', '1' };
+
+ReplayLog::ReplayLog() :
+	recording(false),
+	replaying(false)
+{
+}
+
+ReplayLog::~ReplayLog()
+{
+	close();
+}
+
+bool ReplayLog::openWrite(const string &path)
+{
+	close();
+	out.open(path, ios::binary | ios::trunc);
+	if (!out) {
+		cerr << "Cannot open " << path << endl;
+		return false;
+	}
+	out.write(MAGIC, sizeof(MAGIC));
+	recording = true;
+	return true;
+}
+
+bool ReplayLog::openRead(const string &path)
+{
+	close();
+	in.open(path, ios::binary);
+	char magic[sizeof(MAGIC)];
+	if (!in || !in.read(magic, sizeof(magic)) || memcmp(magic, MAGIC, sizeof(MAGIC)) != 0) {
+		cerr << path << " is not a replay log" << endl;
+		in.close();
+		return false;
+	}
+	replaying = true;
+	return true;
+}
+
+void ReplayLog::close()
+{
+	if (out.is_open()) {
+		out.close();
+	}
+	if (in.is_open()) {
+		in.close();
+	}
+	recording = false;
+	replaying = false;
+}
+
+static void writeVector(ofstream &out, const Vector3d &v)
+{
+	out.write(reinterpret_cast<const char *>(v.data()), 3 * sizeof(double));
+}
+
+static bool readVector(ifstream &in, Vector3d &v)
+{
+	return (bool)in.read(reinterpret_cast<char *>(v.data()), 3 * sizeof(double));
+}
+
+void ReplayLog::write(const ReplayEvent &event)
+{
+	if (!recording) {
+		return;
+	}
+	char type = (char)event.type;
+	out.write(&type, 1);
+	switch (event.type) {
+	case REPLAY_SEED:
+		out.write(reinterpret_cast<const char *>(&event.seed), sizeof(event.seed));
+		break;
+	case REPLAY_TIMESTEP:
+		out.write(reinterpret_cast<const char *>(&event.h), sizeof(event.h));
+		break;
+	case REPLAY_KEY:
+		out.write(&event.key, 1);
+		break;
+	case REPLAY_VIEWPOINT:
+		writeVector(out, event.a);
+		writeVector(out, event.b);
+		break;
+	case REPLAY_WIND:
+		writeVector(out, event.a);
+		break;
+	case REPLAY_STEP:
+		break;
+	}
+}
+
+bool ReplayLog::read(ReplayEvent &event)
+{
+	if (!replaying) {
+		return false;
+	}
+	char type;
+	if (!in.read(&type, 1)) {
+		return false;
+	}
+	event.type = (ReplayEventType)type;
+	bool ok = true;
+	switch (event.type) {
+	case REPLAY_SEED:
+		ok = (bool)in.read(reinterpret_cast<char *>(&event.seed), sizeof(event.seed));
+		break;
+	case REPLAY_TIMESTEP:
+		ok = (bool)in.read(reinterpret_cast<char *>(&event.h), sizeof(event.h));
+		break;
+	case REPLAY_KEY:
+		ok = (bool)in.read(&event.key, 1);
+		break;
+	case REPLAY_VIEWPOINT:
+		ok = readVector(in, event.a) && readVector(in, event.b);
+		break;
+	case REPLAY_WIND:
+		ok = readVector(in, event.a);
+		break;
+	case REPLAY_STEP:
+		break;
+	default:
+		ok = false;
+	}
+	if (!ok) {
+		cerr << "Corrupt replay log" << endl;
+	}
+	return ok;
+}
@@ -0,0 +1,61 @@
+#pragma once
+#ifndef ReplayLog_H
+#define ReplayLog_H
+
+#include <string>
+#include <fstream>
+#include <cstdint>
+
+#define EIGEN_DONT_ALIGN_STATICALLY
+#include <Eigen/Dense>
+
+enum ReplayEventType {
+	REPLAY_SEED,      // seed passed to srand
+	REPLAY_TIMESTEP,  // Scene time step
+	REPLAY_KEY,       // keyboard command (see Scene::pressKey)
+	REPLAY_VIEWPOINT, // eye and forward for placing held objects
+	REPLAY_WIND,      // new wind target drawn during the next step
+	REPLAY_STEP       // one Scene::step
+};
+
+struct ReplayEvent
+{
+	ReplayEventType type;
+	uint32_t seed;
+	double h;
+	char key;
+	Eigen::Vector3d a; // eye or wind target
+	Eigen::Vector3d b; // forward
+};
+
+/**
+ * Binary log of everything outside the simulation that a Scene run depends
+ * on, in the order it happened. Replaying it on a freshly loaded scene
+ * repeats the run bit for bit. Doubles are stored raw, so logs are only
+ * portable between machines with the same byte order.
+ */
+class ReplayLog
+{
+public:
+	ReplayLog();
+	virtual ~ReplayLog();
+
+	// Both return false and print an error if the file cannot be used
+	bool openWrite(const std::string &path);
+	bool openRead(const std::string &path);
+	void close();
+	bool isRecording() const { return recording; }
+	bool isReplaying() const { return replaying; }
+
+	void write(const ReplayEvent &event);
+	// False at the end of the log
+	bool read(ReplayEvent &event);
+
+private:
+	std::ofstream out;
+	std::ifstream in;
+	bool recording;
+	bool replaying;
+};
+
+#endif
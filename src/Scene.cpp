@@ -1,11 +1,14 @@
 #include <iostream>
+#include <ctime>
+#include <chrono>
+#include <algorithm>
 
-#include "GLSL.h"
 #include "Scene.h"
 #include "Particle.h"
 #include "Cloth.h"
-#include "Shape.h"
-#include "Program.h"
+#include "ThreadPool.h"
+#include "Checkpoint.h"
+#include "SceneFile.h"
 
 #define _USE_MATH_DEFINES
 #include <math.h> 
@@ -22,7 +25,19 @@ Scene::Scene() :
 	windTarget(0.0, 0.0, 0.0),
 	prevWindTarget(0.0, 0.0, 0.0),
 	windN(3000), // currently 10 seconds
-	windI(0)
+	windI(0),
+	seedValue(1),
+	randDraws(0),
+	heldObject(NONE),
+	eye(0.0, 0.0, 0.0),
+	forward(0.0, 0.0, -1.0),
+	threadCount(0),
+	parallelBodies(true),
+	fusedCollision(true),
+	broadphase(true),
+	selfCollision(true),
+	parallelHashBuild(true),
+	statsDumpInterval(0)
 {
 }
 
@@ -30,11 +45,11 @@ Scene::~Scene()
 {
 }
 
-void Scene::load(const string &RESOURCE_DIR)
+void Scene::load()
 {
 	// Units: meters, kilograms, seconds
 	h = 1e-3;
-	
+
 	grav << 0.0, -9.8, 0.0;
 	
 	int rows = 15;
@@ -48,21 +63,21 @@ void Scene::load(const string &RESOURCE_DIR)
 	Vector3d x10(-0.25, 0.5, -0.5);
 	Vector3d x11(0.25, 0.5, -0.5);
 	shared_ptr<Cloth> sphereCloth = make_shared<Cloth>(rows, cols, x00, x01, x10, x11, mass, alpha, damping, pradius);
-	cloths.push_back(sphereCloth);
+	addCloth(sphereCloth);
 
 	x00 = Vector3d(-1.25, 0.5, 0.0);
 	x01 = Vector3d(-0.75, 0.5, 0.0);
 	x10 = Vector3d(-1.25, 0.5, -0.5);
 	x11 = Vector3d(-0.75, 0.5, -0.5);
 	shared_ptr<Cloth> cutCloth = make_shared<Cloth>(rows, cols, x00, x01, x10, x11, mass, alpha, damping, pradius);
-	cloths.push_back(cutCloth);
+	addCloth(cutCloth);
 
 	x00 = Vector3d(-2.0, 1.0, 0.0);
 	x01 = Vector3d(-2.0, 0.5, 0.0);
 	x10 = Vector3d(-3.0, 1.0, 0.0);
 	x11 = Vector3d(-3.0, 0.5, 0.0);
 	shared_ptr<Cloth> windCloth = make_shared<Cloth>(2 * rows, 2 * cols, x00, x01, x10, x11, mass, alpha, damping, pradius);
-	cloths.push_back(windCloth);
+	addCloth(windCloth);
 
 	Vector3d x000(0.5, 0.5, 0.5);
 	Vector3d x111(0.75, 0.75, 0.75);
@@ -77,50 +92,83 @@ void Scene::load(const string &RESOURCE_DIR)
 		1e-3,
 		pradius
 	);
-	softBodies.push_back(testBody);
-	
-	sphereShape = make_shared<Shape>();
-	sphereShape->loadMesh(RESOURCE_DIR + "sphere2.obj");
+	addSoftBody(testBody);
 
-	planeShape = make_shared<Shape>();
-	planeShape->loadMesh(RESOURCE_DIR + "square.obj");
-
-	cylinderShape = make_shared<Shape>();
-	cylinderShape->loadMesh(RESOURCE_DIR + "cylinder.obj");
-
-	tetrahedronShape = make_shared<Shape>();
-	tetrahedronShape->loadMesh(RESOURCE_DIR + "tetrahedron.obj");
+	setThreadCount(threadCount);
 	
-	auto sphere = make_shared<Particle>(sphereShape);
-	spheres.push_back(sphere);
+	auto sphere = make_shared<Particle>();
 	sphere->r = 0.1;
 	sphere->x = Vector3d(0.0, 0.2, 0.0);
+	addSphere(sphere, 0.5, 0.5);
 
-	auto ground = make_shared<Plane>(planeShape);
-	planes.push_back(ground);
+	auto ground = make_shared<Plane>();
+	addPlane(ground);
 
-	auto flagpole = make_shared<Cylinder>(cylinderShape);
-	cylinders.push_back(flagpole);
+	auto flagpole = make_shared<Cylinder>();
 	flagpole->r = 0.025;
 	flagpole->h = 1.1;
 	flagpole->x = Vector3d(-1.975, 0.0, 0.0);
+	addCylinder(flagpole);
 
 	heldObject = NONE;
 }
 
-void Scene::init()
+bool Scene::load(const string &path)
 {
-	sphereShape->init();
-	planeShape->init();
-	cylinderShape->init();
-	tetrahedronShape->init();
-	for (shared_ptr<Cloth> cloth : cloths) {
-		cloth->init();
+	// Defaults for what the file leaves out, as in the default scene
+	h = 1e-3;
+	grav << 0.0, -9.8, 0.0;
+	if (!SceneFile::read(path, *this)) {
+		return false;
 	}
-	for (shared_ptr<SoftBody> softBody : softBodies) {
-		softBody->init();
+	setThreadCount(threadCount);
+	heldObject = NONE;
+	return true;
+}
+
+void Scene::addCloth(shared_ptr<Cloth> cloth)
+{
+	cloth->setThreadPool(threadPool);
+	cloth->setFusedCollision(fusedCollision);
+	cloth->setBroadphase(broadphase);
+	cloths.push_back(cloth);
+}
+
+void Scene::addSoftBody(shared_ptr<SoftBody> softBody)
+{
+	softBody->setThreadPool(threadPool);
+	softBody->setFusedCollision(fusedCollision);
+	softBody->setBroadphase(broadphase);
+	softBodies.push_back(softBody);
+}
+
+void Scene::addSphere(shared_ptr<Particle> sphere, double swingAmplitude, double swingFrequency)
+{
+	spheres.push_back(sphere);
+	if (swingAmplitude != 0.0) {
+		Swing swing;
+		swing.sphere = sphere;
+		swing.z0 = sphere->x(2);
+		swing.amplitude = swingAmplitude;
+		swing.frequency = swingFrequency;
+		swings.push_back(swing);
 	}
-	srand(time(0));
+}
+
+void Scene::init()
+{
+	seed((unsigned)time(0));
+}
+
+void Scene::seed(unsigned seed)
+{
+	seedValue = seed;
+	srand(seed);
+	randDraws = 0;
+	ReplayEvent event;
+	event.type = REPLAY_SEED;
+	event.seed = seed;
+	replayLog.write(event);
 }
 
 void Scene::tare()
@@ -150,40 +198,46 @@ void Scene::reset()
 	}
 }
 
-void Scene::step(const std::shared_ptr<Camera> camera)
+void Scene::step()
 {
+	// Dump the previous interval here so that its last step is fully counted
+	if (StepStats::enabled && statsDumpInterval > 0 && stats.steps % statsDumpInterval == 0) {
+		dumpStats();
+	}
+	STEP_TIMER_BEGIN(stats);
+
+	ReplayEvent stepEvent;
+	stepEvent.type = REPLAY_STEP;
+	replayLog.write(stepEvent);
+
 	t += h;
 	
-	// Move the sphere
-	
-	auto s = spheres.at(0);
-	s->x(2) = 0.5 * sin(0.5*t);
+	// Move the swinging spheres
+	for (const Swing &swing : swings) {
+		swing.sphere->x(2) = swing.z0 + swing.amplitude * sin(swing.frequency * t);
+	}
 
 	switch (heldObject) {
 	case SPHERE: {
 		auto heldSphere = spheres.back();
-		glm::vec3 cameraTranslation = camera->getTranslation() + normalize(camera->getForward());
-		heldSphere->x = Eigen::Vector3d(cameraTranslation.x, cameraTranslation.y, cameraTranslation.z);
+		heldSphere->x = eye + forward.normalized();
 		break;
 	}
-	case TETRAHEDRON:
+	case TETRAHEDRON: {
 		auto heldTetrahedron = tetrahedrons.back();
 
-		glm::vec3 forward = normalize(camera->getForward());
-		glm::vec3 up(0.0f, 1.0f, 0.0f);
-		glm::vec3 right = normalize(cross(forward, up));
-		up = normalize(cross(right, forward));
-		glm::vec3 translation = camera->getTranslation();
-
-		glm::vec3 p0 = translation + forward * 1.5f;
-		glm::vec3 p1 = translation + forward + right * 0.1f - up * 0.1f;
-		glm::vec3 p2 = translation + forward + right * 0.2f - up * 0.1f;
-		glm::vec3 p3 = translation + forward + right * 0.15f - up * 0.25f;
-		
-		heldTetrahedron->x[0] = Eigen::Vector3d(p0.x, p0.y, p0.z);
-		heldTetrahedron->x[1] = Eigen::Vector3d(p1.x, p1.y, p1.z);
-		heldTetrahedron->x[2] = Eigen::Vector3d(p2.x, p2.y, p2.z);
-		heldTetrahedron->x[3] = Eigen::Vector3d(p3.x, p3.y, p3.z);
+		Vector3d f = forward.normalized();
+		Vector3d up(0.0, 1.0, 0.0);
+		Vector3d right = f.cross(up).normalized();
+		up = right.cross(f).normalized();
+
+		heldTetrahedron->x[0] = eye + f * 1.5;
+		heldTetrahedron->x[1] = eye + f + right * 0.1 - up * 0.1;
+		heldTetrahedron->x[2] = eye + f + right * 0.2 - up * 0.1;
+		heldTetrahedron->x[3] = eye + f + right * 0.15 - up * 0.25;
+		break;
+	}
+	case NONE:
 		break;
 	}
 	
@@ -191,25 +245,403 @@ void Scene::step(const std::shared_ptr<Camera> camera)
 	windI++;
 	if (windI == windN) {
 		prevWindTarget = windTarget;
-		double windMagnitude = windMaxMagnitude * rand() / RAND_MAX;
-		double windDirection = 2.0 * M_PI * rand() / RAND_MAX;
-		windTarget = Vector3d(windMagnitude * cos(windDirection), 0.0, windMagnitude * sin(windDirection));
+		ReplayEvent windEvent;
+		if (replayLog.isReplaying()) {
+			if (!replayLog.read(windEvent) || windEvent.type != REPLAY_WIND) {
+				cerr << "Replay log is out of sync; stopping the replay" << endl;
+				replayLog.close();
+			}
+			else {
+				windTarget = windEvent.a;
+			}
+		}
+		if (!replayLog.isReplaying()) {
+			double windMagnitude = windMaxMagnitude * rand() / RAND_MAX;
+			double windDirection = 2.0 * M_PI * rand() / RAND_MAX;
+			windTarget = Vector3d(windMagnitude * cos(windDirection), 0.0, windMagnitude * sin(windDirection));
+			randDraws += 2;
+			windEvent.type = REPLAY_WIND;
+			windEvent.a = windTarget;
+			replayLog.write(windEvent);
+		}
 
 		windI = 0;
 	}
 	double alpha = min(1.0, 2.0 * double(windI) / double(windN));
 	wind = prevWindTarget * (1.0 - alpha) + windTarget * alpha;
 
-	// Simulate the cloths
+	// Refresh the cached half-spaces of moved tetrahedrons
+	for (shared_ptr<Tetrahedron> tetrahedron : tetrahedrons) {
+		tetrahedron->update();
+	}
+
+	// Simulate the bodies. They only share the colliders, which are read
+	// only here, so they can step concurrently; each body's own parallel
+	// loops then run inline on the worker that steps it. With fewer bodies
+	// than workers that would leave cores idle behind the heaviest body, so
+	// the bodies then step in turn, each using the whole pool.
+	int nCloths = (int)cloths.size();
+	int nBodies = nCloths + (int)softBodies.size();
+	bodyStepSeconds.resize(nBodies, 0.0);
+	bool concurrentBodies = parallelBodies && threadPool && nBodies >= threadPool->size();
+	ThreadPool *bodyPool = concurrentBodies ? threadPool.get() : nullptr;
+	ThreadPool::parallelFor(bodyPool, nBodies, [&](int begin, int end, int) {
+		for (int b = begin; b < end; b++) {
+			auto start = chrono::steady_clock::now();
+			if (b < nCloths) {
+				cloths[b]->step(h, grav, wind, spheres, planes, cylinders, tetrahedrons, polytopes);
+			}
+			else {
+				softBodies[b - nCloths]->step(h, grav, wind, spheres, planes, cylinders, tetrahedrons, polytopes);
+			}
+			bodyStepSeconds[b] += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+		}
+	}, 1);
+
+	if (selfCollision) {
+		STEP_TIMER_SKIP();
+		collideCloths();
+		STEP_TIMER_LAP(PHASE_SELF_COLLISION);
+	}
+}
+
+void Scene::setThreadCount(int n)
+{
+	threadCount = n;
+	threadPool = make_shared<ThreadPool>(n);
+	for (shared_ptr<Cloth> cloth : cloths) {
+		cloth->setThreadPool(threadPool);
+	}
+	for (shared_ptr<SoftBody> softBody : softBodies) {
+		softBody->setThreadPool(threadPool);
+	}
+}
+
+void Scene::setFusedCollision(bool enabled)
+{
+	fusedCollision = enabled;
+	for (shared_ptr<Cloth> cloth : cloths) {
+		cloth->setFusedCollision(enabled);
+	}
+	for (shared_ptr<SoftBody> softBody : softBodies) {
+		softBody->setFusedCollision(enabled);
+	}
+}
+
+void Scene::setBroadphase(bool enabled)
+{
+	broadphase = enabled;
+	for (shared_ptr<Cloth> cloth : cloths) {
+		cloth->setBroadphase(enabled);
+	}
+	for (shared_ptr<SoftBody> softBody : softBodies) {
+		softBody->setBroadphase(enabled);
+	}
+}
+
+int Scene::getThreadCount() const
+{
+	return threadPool ? threadPool->size() : 1;
+}
+
+void Scene::publish()
+{
+	for (shared_ptr<Cloth> cloth : cloths) {
+		cloth->publish();
+	}
+	for (shared_ptr<SoftBody> softBody : softBodies) {
+		softBody->publish();
+	}
+
+	ColliderSnapshot &colliders = colliderSnapshots.writeBuffer();
+	colliders.spheres.clear();
+	for (shared_ptr<Particle> sphere : spheres) {
+		const Vector3d &x = sphere->x;
+		colliders.spheres.insert(colliders.spheres.end(), { float(x(0)), float(x(1)), float(x(2)), float(sphere->r) });
+	}
+	colliders.planes.clear();
+	for (shared_ptr<Plane> plane : planes) {
+		const Vector3d &x = plane->x;
+		colliders.planes.insert(colliders.planes.end(), { float(x(0)), float(x(1)), float(x(2)) });
+	}
+	colliders.cylinders.clear();
+	for (shared_ptr<Cylinder> cylinder : cylinders) {
+		const Vector3d &x = cylinder->x;
+		const Vector3d &a = cylinder->axis;
+		colliders.cylinders.insert(colliders.cylinders.end(), { float(x(0)), float(x(1)), float(x(2)),
+			float(a(0)), float(a(1)), float(a(2)), float(cylinder->r), float(cylinder->h) });
+	}
+	colliders.tetrahedrons.clear();
+	for (shared_ptr<Tetrahedron> tetrahedron : tetrahedrons) {
+		for (const Vector3d &x : tetrahedron->x) {
+			colliders.tetrahedrons.insert(colliders.tetrahedrons.end(), { float(x(0)), float(x(1)), float(x(2)) });
+		}
+	}
+	colliderSnapshots.publish();
+}
+
+void Scene::collideCloths()
+{
+	vector<const ParticleStore *> stores;
+	double maxRadius = 0.0;
+	for (shared_ptr<Cloth> cloth : cloths) {
+		const ParticleStore &particles = cloth->getParticles();
+		stores.push_back(&particles);
+		for (double r : particles.r) {
+			maxRadius = max(maxRadius, r);
+		}
+	}
+	if (maxRadius <= 0.0) {
+		return;
+	}
+
+	// Any two touching particles are at most one cell apart
+	clothHash.build(stores, 2.0 * maxRadius, parallelHashBuild ? threadPool.get() : nullptr);
+
+	// Push overlapping pairs apart by inverse mass. This runs after the
+	// cloths' velocity update, so the velocities take the same correction.
+	for (int a = 0; a < clothHash.size(); a++) {
+		ParticleStore &A = cloths[clothHash.body(a)]->getParticles();
+		int i = clothHash.local(a);
+		clothHash.query(A.x[i], [&](int b) {
+			if (b <= a) {
+				return;
+			}
+			ParticleStore &B = cloths[clothHash.body(b)]->getParticles();
+			int j = clothHash.local(b);
+			double wa = A.fixed[i] ? 0.0 : A.w[i];
+			double wb = B.fixed[j] ? 0.0 : B.w[j];
+			if (wa + wb == 0.0) {
+				return;
+			}
+
+			double minDistance = A.r[i] + B.r[j];
+			Vector3d d = A.x[i] - B.x[j];
+			double distance2 = d.squaredNorm();
+			if (distance2 >= minDistance * minDistance || distance2 == 0.0) {
+				return;
+			}
+			// Neighbors that already overlap in the rest shape are held
+			// apart by springs instead
+			if (&A == &B && (A.x0[i] - A.x0[j]).squaredNorm() < minDistance * minDistance) {
+				return;
+			}
+
+			double distance = sqrt(distance2);
+			Vector3d correction = d * ((minDistance - distance) / (distance * (wa + wb)));
+			A.x[i] += wa * correction;
+			A.v[i] += (wa / h) * correction;
+			B.x[j] -= wb * correction;
+			B.v[j] -= (wb / h) * correction;
+		});
+	}
+}
+
+void Scene::setViewpoint(const Vector3d &eye, const Vector3d &forward)
+{
+	if (eye == this->eye && forward == this->forward) {
+		return;
+	}
+	this->eye = eye;
+	this->forward = forward;
+	ReplayEvent event;
+	event.type = REPLAY_VIEWPOINT;
+	event.a = eye;
+	event.b = forward;
+	replayLog.write(event);
+}
+
+void Scene::pressKey(char key)
+{
+	ReplayEvent event;
+	event.type = REPLAY_KEY;
+	event.key = key;
+	replayLog.write(event);
+	switch (key) {
+	case 'r':
+		reset();
+		break;
+	case '0':
+		setHeldObject(NONE);
+		break;
+	case '1':
+		setHeldObject(SPHERE);
+		break;
+	case '2':
+		setHeldObject(TETRAHEDRON);
+		break;
+	}
+}
+
+bool Scene::startRecording(const string &path)
+{
+	if (!replayLog.openWrite(path)) {
+		return false;
+	}
+	ReplayEvent event;
+	event.type = REPLAY_TIMESTEP;
+	event.h = h;
+	replayLog.write(event);
+	seed(seedValue);
+	return true;
+}
+
+bool Scene::startReplay(const string &path)
+{
+	return replayLog.openRead(path);
+}
+
+bool Scene::replayStep()
+{
+	ReplayEvent event;
+	while (replayLog.isReplaying() && replayLog.read(event)) {
+		switch (event.type) {
+		case REPLAY_SEED:
+			seedValue = event.seed;
+			srand(event.seed);
+			randDraws = 0;
+			break;
+		case REPLAY_TIMESTEP:
+			h = event.h;
+			break;
+		case REPLAY_KEY:
+			pressKey(event.key);
+			break;
+		case REPLAY_VIEWPOINT:
+			setViewpoint(event.a, event.b);
+			break;
+		case REPLAY_WIND:
+			cerr << "Replay log is out of sync; stopping the replay" << endl;
+			replayLog.close();
+			return false;
+		case REPLAY_STEP:
+			step();
+			return true;
+		}
+	}
+	replayLog.close();
+	return false;
+}
+
+bool Scene::saveCheckpoint(const string &path) const
+{
+	CheckpointWriter out;
+	if (!out.open(path)) {
+		return false;
+	}
+	out.value(t);
+	out.value(h);
+	out.value(wind);
+	out.value(windTarget);
+	out.value(prevWindTarget);
+	out.value(windI);
+	out.value(seedValue);
+	out.value(randDraws);
+	out.value(int32_t(heldObject));
+	out.value(eye);
+	out.value(forward);
+
+	// The held object is recreated from heldObject, so the collider counts
+	// match on load
+	out.value(uint64_t(spheres.size()));
+	for (shared_ptr<Particle> sphere : spheres) {
+		out.value(sphere->x);
+		out.value(sphere->v);
+		out.value(sphere->x0);
+		out.value(sphere->v0);
+	}
+	out.value(uint64_t(tetrahedrons.size()));
+	for (shared_ptr<Tetrahedron> tetrahedron : tetrahedrons) {
+		out.value(tetrahedron->x);
+	}
+
+	out.value(uint64_t(cloths.size()));
+	out.value(uint64_t(softBodies.size()));
+	for (shared_ptr<Cloth> cloth : cloths) {
+		cloth->save(out);
+	}
+	for (shared_ptr<SoftBody> softBody : softBodies) {
+		softBody->save(out);
+	}
+	return out.close();
+}
+
+bool Scene::loadCheckpoint(const string &path)
+{
+	CheckpointReader in;
+	if (!in.open(path)) {
+		return false;
+	}
+	int32_t held = 0;
+	Vector3d eye, forward;
+	in.value(t);
+	in.value(h);
+	in.value(wind);
+	in.value(windTarget);
+	in.value(prevWindTarget);
+	in.value(windI);
+	in.value(seedValue);
+	in.value(randDraws);
+	in.value(held);
+	in.value(eye);
+	in.value(forward);
+	if (!in.ok() || held < NONE || held > TETRAHEDRON) {
+		cerr << path << " is corrupt" << endl;
+		return false;
+	}
+	setViewpoint(eye, forward);
+	setHeldObject(HeldObject(held));
+
+	uint64_t nSpheres = 0, nTetrahedrons = 0;
+	in.value(nSpheres);
+	if (nSpheres != spheres.size()) {
+		cerr << path << " does not match the loaded scene" << endl;
+		return false;
+	}
+	for (shared_ptr<Particle> sphere : spheres) {
+		in.value(sphere->x);
+		in.value(sphere->v);
+		in.value(sphere->x0);
+		in.value(sphere->v0);
+	}
+	in.value(nTetrahedrons);
+	if (nTetrahedrons != tetrahedrons.size()) {
+		cerr << path << " does not match the loaded scene" << endl;
+		return false;
+	}
+	for (shared_ptr<Tetrahedron> tetrahedron : tetrahedrons) {
+		in.value(tetrahedron->x);
+	}
+
+	uint64_t nCloths = 0, nSoftBodies = 0;
+	in.value(nCloths);
+	in.value(nSoftBodies);
+	if (nCloths != cloths.size() || nSoftBodies != softBodies.size()) {
+		cerr << path << " does not match the loaded scene" << endl;
+		return false;
+	}
 	for (shared_ptr<Cloth> cloth : cloths) {
-		cloth->step(h, grav, wind, spheres, planes, cylinders, tetrahedrons);
+		if (!cloth->load(in)) {
+			cerr << path << " does not match the loaded scene" << endl;
+			return false;
+		}
 	}
 	for (shared_ptr<SoftBody> softBody : softBodies) {
-		softBody->step(h, grav, wind, spheres, planes, cylinders, tetrahedrons);
+		if (!softBody->load(in)) {
+			cerr << path << " does not match the loaded scene" << endl;
+			return false;
+		}
 	}
+
+	// Put rand() where the saved run left it for the next wind target
+	srand(seedValue);
+	for (uint64_t i = 0; i < randDraws; i++) {
+		rand();
+	}
+	return true;
 }
 
-void Scene::setHeldObject(HeldObject heldObject, const std::shared_ptr<Camera> camera) {
+void Scene::setHeldObject(HeldObject heldObject) {
 	if (this->heldObject == heldObject) {
 		return;
 	}
@@ -221,48 +653,106 @@ void Scene::setHeldObject(HeldObject heldObject, const std::shared_ptr<Camera> c
 	case TETRAHEDRON:
 		tetrahedrons.pop_back();
 		break;
+	case NONE:
+		break;
 	}
 
 	switch (heldObject) {
 	case SPHERE: {
 		// will replace this with the code in step() once it works
-		auto heldSphere = make_shared<Particle>(sphereShape);
+		auto heldSphere = make_shared<Particle>();
 		heldSphere->r = 0.1;
-		glm::vec3 cameraTranslation = camera->getTranslation() + normalize(camera->getForward());
-		heldSphere->x = Eigen::Vector3d(cameraTranslation.x, cameraTranslation.y, cameraTranslation.z);
+		heldSphere->x = eye + forward.normalized();
 		spheres.push_back(heldSphere);
 		break;
 	}
 	case TETRAHEDRON: {
-		auto heldTetrahedron = make_shared<Tetrahedron>(tetrahedronShape);
-		glm::vec3 cameraTranslation = camera->getTranslation() + normalize(camera->getForward());
-		heldTetrahedron->x[0] = Eigen::Vector3d(cameraTranslation.x, cameraTranslation.y, cameraTranslation.z);
+		auto heldTetrahedron = make_shared<Tetrahedron>();
+		heldTetrahedron->x[0] = eye + forward.normalized();
 		tetrahedrons.push_back(heldTetrahedron);
 		break;
 	}
+	case NONE:
+		break;
 	}
 
 	this->heldObject = heldObject;
 }
 
-void Scene::draw(shared_ptr<MatrixStack> M, const shared_ptr<Program> prog) const
+int Scene::getParticleCount() const
 {
-	for(auto s : spheres) {
-		s->draw(M, prog);
+	int n = 0;
+	for (shared_ptr<Cloth> cloth : cloths) {
+		n += cloth->getParticles().size();
+	}
+	for (shared_ptr<SoftBody> softBody : softBodies) {
+		n += softBody->getParticles().size();
 	}
-	for (auto p : planes) {
-		p->draw(M, prog);
+	return n;
+}
+
+StepStats Scene::getStats() const
+{
+	StepStats total;
+	for (shared_ptr<Cloth> cloth : cloths) {
+		total += cloth->getStats();
 	}
-	for (auto c : cylinders) {
-		c->draw(M, prog);
+	for (shared_ptr<SoftBody> softBody : softBodies) {
+		total += softBody->getStats();
 	}
-	for (auto t : tetrahedrons) {
-		t->draw(M, prog);
+	for (int i = 0; i < PHASE_COUNT; i++) {
+		total.seconds[i] += stats.seconds[i];
 	}
+	total.stepSeconds = stats.stepSeconds;
+	total.steps = stats.steps;
+	return total;
+}
+
+void Scene::clearStats()
+{
+	stats.clear();
+	fill(bodyStepSeconds.begin(), bodyStepSeconds.end(), 0.0);
+	lastDump.clear();
 	for (shared_ptr<Cloth> cloth : cloths) {
-		cloth->draw(M, prog);
+		cloth->clearStats();
 	}
 	for (shared_ptr<SoftBody> softBody : softBodies) {
-		softBody->draw(M, prog);
+		softBody->clearStats();
+	}
+}
+
+void Scene::setStatsDump(int interval, const string &csvPath)
+{
+	if (interval > 0 && !StepStats::enabled) {
+		cerr << "Step stats are compiled out; rebuild with -DPROFILE=ON" << endl;
+	}
+	statsDumpInterval = interval;
+	lastDump = getStats();
+	if (statsCsv.is_open()) {
+		statsCsv.close();
+	}
+	if (!csvPath.empty()) {
+		statsCsv.open(csvPath);
+		if (!statsCsv) {
+			cerr << "Cannot open " << csvPath << endl;
+			return;
+		}
+		StepStats::writeCsvHeader(statsCsv);
+	}
+}
+
+void Scene::dumpStats()
+{
+	StepStats current = getStats();
+	StepStats delta = current - lastDump;
+	if (delta.steps <= 0) {
+		return;
+	}
+	lastDump = current;
+	if (statsCsv.is_open()) {
+		delta.writeCsvRow(statsCsv, current.steps);
+	}
+	else {
+		delta.print(cerr);
 	}
 }
@@ -5,22 +5,27 @@
 #include <vector>
 #include <memory>
 #include <string>
+#include <fstream>
+#include <cstdint>
 
 #define EIGEN_DONT_ALIGN_STATICALLY
 #include <Eigen/Dense>
 
-#include "Camera.h"
 #include "Plane.h"
 #include "Cylinder.h"
 #include "Tetrahedron.h"
+#include "ConvexPolytope.h"
 #include "SoftBody.h"
+#include "StepStats.h"
+#include "SpatialHash.h"
+#include "ReplayLog.h"
+#include "TripleBuffer.h"
+#include "RenderSnapshot.h"
 
 
 class Cloth;
 class Particle;
-class MatrixStack;
-class Program;
-class Shape;
+class ThreadPool;
 
 enum HeldObject {
 	NONE,
@@ -36,16 +41,125 @@ public:
 	Scene();
 	virtual ~Scene();
 	
-	void load(const std::string &RESOURCE_DIR);
+	// The default demo scene
+	void load();
+	// Builds the scene from a scene file instead (see SceneFile.h). Returns
+	// false and prints an error if the file cannot be read.
+	bool load(const std::string &path);
+	// Seeds the wind from the clock
 	void init();
+	void seed(unsigned seed);
 	void tare();
 	void reset();
-	void step(const std::shared_ptr<Camera> camera);
-	void setHeldObject(HeldObject heldObject, const std::shared_ptr<Camera> camera);
-	void draw(std::shared_ptr<MatrixStack> M, const std::shared_ptr<Program> prog) const;
+	void step();
+	// Publishes render snapshots of all bodies and the colliders. Call from
+	// the thread that steps the scene; SceneRenderer reads them without
+	// locking.
+	void publish();
+	// Render thread: picks up the latest published colliders, never blocks
+	bool acquireColliders() { return colliderSnapshots.acquire(); }
+	const ColliderSnapshot &getColliders() const { return colliderSnapshots.readBuffer(); }
+	// Held objects are placed relative to this viewpoint
+	void setViewpoint(const Eigen::Vector3d &eye, const Eigen::Vector3d &forward);
+	void setHeldObject(HeldObject heldObject);
+	// Keyboard commands that change the simulation: 'r' resets, '0', '1'
+	// and '2' hold nothing, a sphere or a tetrahedron. 'h' (single step) is
+	// only recorded. Call from the thread that steps the scene.
+	void pressKey(char key);
+
+	// Logs the time step, seed, keys, viewpoints, wind targets and steps
+	// from now on.
+	// Start right after load() and init(), before the first step; this
+	// reseeds with the current seed.
+	bool startRecording(const std::string &path);
+	void stopRecording() { replayLog.close(); }
+	// Drives a freshly loaded scene from a log written by startRecording.
+	// replayStep applies the inputs up to and including the next step and
+	// returns false at the end of the log.
+	bool startReplay(const std::string &path);
+	bool replayStep();
+
+	// Writes the full simulation state: body particles, broken springs and
+	// volumes, wind, the held object and the moving colliders.
+	bool saveCheckpoint(const std::string &path) const;
+	// Restores a checkpoint into a freshly loaded scene (load(), no steps)
+	// and continues exactly as the saved run would have. The file is mapped
+	// rather than read. On failure the scene is partly restored; reload it.
+	bool loadCheckpoint(const std::string &path);
 	
 	double getTime() const { return t; }
+	double getTimeStep() const { return h; }
+	void setTimeStep(double h) { this->h = h; }
+	int getParticleCount() const;
+
+	// Worker threads shared by all bodies, including the calling thread.
+	// n <= 0 uses the hardware concurrency. Can be changed after load().
+	void setThreadCount(int n);
+	int getThreadCount() const;
+	// Step bodies concurrently, one body per worker (on by default), when
+	// there are at least as many bodies as workers. Otherwise, or when
+	// off, bodies step one after another and parallelize internally.
+	void setParallelBodies(bool enabled) { parallelBodies = enabled; }
+	// Wall time spent in each body's step since the last clearStats(),
+	// cloths first, then soft bodies, in load order
+	const std::vector<double> &getBodyStepSeconds() const { return bodyStepSeconds; }
+
+	// One pass over each body's particles for all colliders (default), or
+	// one pass per collider. Both give the same positions.
+	void setFusedCollision(bool enabled);
+	bool getFusedCollision() const { return fusedCollision; }
+	// Per-body culling of colliders that cannot be reached this step (on by
+	// default)
+	void setBroadphase(bool enabled);
+	bool getBroadphase() const { return broadphase; }
+
+	// Particle-particle collisions within and between cloths
+	void setSelfCollision(bool enabled) { selfCollision = enabled; }
+	bool getSelfCollision() const { return selfCollision; }
+	// Build the spatial hash on the thread pool (same result either way)
+	void setParallelHashBuild(bool enabled) { parallelHashBuild = enabled; }
+
+	// Phase times summed over all bodies; step time and count are per Scene::step
+	StepStats getStats() const;
+	void clearStats();
+	// Every interval steps, write the stats since the last dump to stderr,
+	// or append them as CSV rows if csvPath is given. interval <= 0 disables.
+	void setStatsDump(int interval, const std::string &csvPath = "");
+	// Writes the stats since the last dump now
+	void dumpStats();
+
+	const std::vector< std::shared_ptr<Cloth> > &getCloths() const { return cloths; }
+	const std::vector< std::shared_ptr<SoftBody> > &getSoftBodies() const { return softBodies; }
+	const std::vector< std::shared_ptr<Particle> > &getSpheres() const { return spheres; }
+	const std::vector< std::shared_ptr<Plane> > &getPlanes() const { return planes; }
+	const std::vector< std::shared_ptr<Cylinder> > &getCylinders() const { return cylinders; }
+	const std::vector< std::shared_ptr<Tetrahedron> > &getTetrahedrons() const { return tetrahedrons; }
+	const std::vector< std::shared_ptr<ConvexPolytope> > &getPolytopes() const { return polytopes; }
+	// Scene building, used by load(). Bodies pick up the current thread pool
+	// and collision settings. Not thread safe; call before stepping.
+	void addCloth(std::shared_ptr<Cloth> cloth);
+	void addSoftBody(std::shared_ptr<SoftBody> softBody);
+	// A swinging sphere moves along z as z0 + amplitude * sin(frequency * t)
+	void addSphere(std::shared_ptr<Particle> sphere, double swingAmplitude = 0.0, double swingFrequency = 0.0);
+	void addPlane(std::shared_ptr<Plane> plane) { planes.push_back(plane); }
+	void addCylinder(std::shared_ptr<Cylinder> cylinder) { cylinders.push_back(cylinder); }
+	// Adds a static convex obstacle
+	void addPolytope(std::shared_ptr<ConvexPolytope> polytope) { polytopes.push_back(polytope); }
+	void setGravity(const Eigen::Vector3d &grav) { this->grav = grav; }
+	// Wind blows towards a random target of up to maxMagnitude, drawn every
+	// steps steps
+	void setWind(double maxMagnitude, int steps) { windMaxMagnitude = maxMagnitude; windN = steps; }
 private:
+	struct Swing
+	{
+		std::shared_ptr<Particle> sphere;
+		double z0;
+		double amplitude;
+		double frequency;
+	};
+
+	void collideCloths();
+
 	double t;
 	double h;
 	Eigen::Vector3d grav;
@@ -57,20 +171,40 @@ private:
 	int windN;
 	int windI;
 
+	unsigned seedValue;
+	uint64_t randDraws; // rand() calls since the last srand
+	ReplayLog replayLog;
+
 	HeldObject heldObject; // not the best naming
-	
-	std::shared_ptr<Shape> sphereShape;
-	std::shared_ptr<Shape> planeShape;
-	std::shared_ptr<Shape> cylinderShape;
-	std::shared_ptr<Shape> tetrahedronShape;
+	Eigen::Vector3d eye;
+	Eigen::Vector3d forward;
 
+	std::shared_ptr<ThreadPool> threadPool;
+	int threadCount;
+	bool parallelBodies;
+	std::vector<double> bodyStepSeconds;
+	bool fusedCollision;
+	bool broadphase;
+
+	bool selfCollision;
+	bool parallelHashBuild;
+	SpatialHash clothHash;
+
+	StepStats stats;
+	StepStats lastDump;
+	int statsDumpInterval;
+	std::ofstream statsCsv;
+	
 	std::vector< std::shared_ptr<Cloth> > cloths;
 	std::vector< std::shared_ptr<SoftBody> > softBodies;
 
 	std::vector< std::shared_ptr<Particle> > spheres;
+	std::vector<Swing> swings;
 	std::vector< std::shared_ptr<Plane> > planes;
 	std::vector< std::shared_ptr<Cylinder> > cylinders;
 	std::vector< std::shared_ptr<Tetrahedron> > tetrahedrons;
+	std::vector< std::shared_ptr<ConvexPolytope> > polytopes;
+	TripleBuffer<ColliderSnapshot> colliderSnapshots;
 };
 
 #endif
@@ -0,0 +1,308 @@
+#include <iostream>
+#include <fstream>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+
+#include "SceneFile.h"
+#include "Scene.h"
+#include "Cloth.h"
+#include "SoftBody.h"
+#include "TetMesh.h"
+#include "TriMesh.h"
+#include "Particle.h"
+#include "Plane.h"
+#include "Cylinder.h"
+
+using namespace std;
+using namespace Eigen;
+
+namespace
+{
+
+// Walks the lines of a file held in memory. Numbers are parsed in place
+// with strtod/strtol, without copying tokens.
+class LineParser
+{
+public:
+	LineParser(const string &text) :
+		p(text.c_str()),
+		end(text.c_str() + text.size()),
+		lineEnd(p),
+		lineNumber(0)
+	{
+	}
+
+	// Moves to the next line with a declaration. False at the end.
+	bool next()
+	{
+		for (;;) {
+			if (lineNumber > 0) {
+				if (lineEnd == end) {
+					return false;
+				}
+				p = lineEnd + 1;
+			}
+			lineNumber++;
+			const char *newline = static_cast<const char *>(memchr(p, '\n', end - p));
+			lineEnd = newline ? newline : end;
+			skipSpace();
+			if (p < lineEnd) {
+				return true;
+			}
+		}
+	}
+
+	int line() const { return lineNumber; }
+
+	string keyword()
+	{
+		skipSpace();
+		const char *start = p;
+		while (p < lineEnd && isalpha((unsigned char)*p)) {
+			p++;
+		}
+		return string(start, p);
+	}
+
+	bool number(double &v)
+	{
+		skipSpace();
+		if (p == lineEnd) {
+			return false;
+		}
+		char *after;
+		v = strtod(p, &after);
+		return advance(after);
+	}
+
+	bool integer(int &v)
+	{
+		skipSpace();
+		if (p == lineEnd) {
+			return false;
+		}
+		char *after;
+		long value = strtol(p, &after, 10);
+		v = int(value);
+		return value == v && advance(after);
+	}
+
+	// A run of non-space characters, such as a file name
+	bool word(string &v)
+	{
+		skipSpace();
+		const char *start = p;
+		while (p < lineEnd && *p != ' ' && *p != '\t' && *p != '\r' && *p != '#') {
+			p++;
+		}
+		v.assign(start, p);
+		return p != start;
+	}
+
+	bool point(Vector3d &v)
+	{
+		return number(v(0)) && number(v(1)) && number(v(2));
+	}
+
+	// True if only a comment is left on the line
+	bool done()
+	{
+		skipSpace();
+		return p == lineEnd;
+	}
+
+private:
+	// Comments and '\r' count as space
+	void skipSpace()
+	{
+		while (p < lineEnd && (*p == ' ' || *p == '\t' || *p == '\r')) {
+			p++;
+		}
+		if (p < lineEnd && *p == '#') {
+			p = lineEnd;
+		}
+	}
+
+	// A number must end at a separator, so that "1x" is not taken as 1
+	bool advance(const char *after)
+	{
+		if (after == p || after > lineEnd) {
+			return false;
+		}
+		p = after;
+		return p == lineEnd || *p == ' ' || *p == '\t' || *p == '\r' || *p == '#';
+	}
+
+	const char *p;
+	const char *end;
+	const char *lineEnd;
+	int lineNumber;
+};
+
+}
+
+bool SceneFile::read(const string &path, Scene &scene)
+{
+	ifstream in(path, ios::binary | ios::ate);
+	if (!in) {
+		cerr << "Cannot open " << path << endl;
+		return false;
+	}
+	string text(size_t(in.tellg()), '\0');
+	in.seekg(0);
+	in.read(&text[0], text.size());
+
+	LineParser parser(text);
+	// A sphere is added once we know whether a swing line follows it
+	shared_ptr<Particle> sphere;
+	double swingAmplitude = 0.0;
+	double swingFrequency = 0.0;
+	auto addSphere = [&]() {
+		if (sphere) {
+			scene.addSphere(sphere, swingAmplitude, swingFrequency);
+			sphere.reset();
+		}
+	};
+
+	while (parser.next()) {
+		string keyword = parser.keyword();
+		bool ok = true;
+		const char *error = "expected a number";
+		if (keyword == "swing") {
+			ok = parser.number(swingAmplitude) && parser.number(swingFrequency);
+			if (ok && !sphere) {
+				ok = false;
+				error = "swing must follow a sphere";
+			}
+		}
+		else {
+			addSphere();
+			if (keyword == "h") {
+				double h;
+				ok = parser.number(h) && h > 0.0;
+				error = "expected a positive time step";
+				if (ok) {
+					scene.setTimeStep(h);
+				}
+			}
+			else if (keyword == "gravity") {
+				Vector3d grav;
+				ok = parser.point(grav);
+				if (ok) {
+					scene.setGravity(grav);
+				}
+			}
+			else if (keyword == "wind") {
+				double magnitude;
+				int steps;
+				ok = parser.number(magnitude) && parser.integer(steps) && steps > 0;
+				error = "expected a magnitude and a positive step count";
+				if (ok) {
+					scene.setWind(magnitude, steps);
+				}
+			}
+			else if (keyword == "cloth") {
+				int rows, cols;
+				Vector3d x00, x01, x10, x11;
+				double mass, alpha, damping, radius;
+				ok = parser.integer(rows) && parser.integer(cols) &&
+					parser.point(x00) && parser.point(x01) && parser.point(x10) && parser.point(x11) &&
+					parser.number(mass) && parser.number(alpha) && parser.number(damping) && parser.number(radius) &&
+					rows >= 2 && cols >= 2 && mass > 0.0;
+				error = "expected rows, cols >= 2, four corners, mass > 0, alpha, damping and radius";
+				if (ok) {
+					scene.addCloth(make_shared<Cloth>(rows, cols, x00, x01, x10, x11, mass, alpha, damping, radius));
+				}
+			}
+			else if (keyword == "softbody") {
+				int rows, cols, tubes;
+				Vector3d x000, x111;
+				double mass, alpha, damping, radius;
+				ok = parser.integer(rows) && parser.integer(cols) && parser.integer(tubes) &&
+					parser.point(x000) && parser.point(x111) &&
+					parser.number(mass) && parser.number(alpha) && parser.number(damping) && parser.number(radius) &&
+					rows >= 2 && cols >= 2 && tubes >= 2 && mass > 0.0;
+				error = "expected rows, cols, tubes >= 2, two corners, mass > 0, alpha, damping and radius";
+				if (ok) {
+					scene.addSoftBody(make_shared<SoftBody>(rows, cols, tubes, x000, x111, mass, alpha, damping, radius));
+				}
+			}
+			else if (keyword == "tetmesh" || keyword == "clothmesh") {
+				string meshPath;
+				Vector3d offset;
+				double scale, mass, alpha, damping, radius;
+				ok = parser.word(meshPath) && parser.point(offset) && parser.number(scale) &&
+					parser.number(mass) && parser.number(alpha) && parser.number(damping) && parser.number(radius) &&
+					scale > 0.0 && mass > 0.0;
+				error = "expected a path, offset, scale > 0, mass > 0, alpha, damping and radius";
+				if (ok) {
+					// Relative to the scene file
+					size_t slash = path.find_last_of("/\\");
+					if (meshPath[0] != '/' && slash != string::npos) {
+						meshPath = path.substr(0, slash + 1) + meshPath;
+					}
+					error = "cannot read the mesh";
+					if (keyword == "tetmesh") {
+						TetMesh mesh;
+						ok = mesh.read(meshPath);
+						if (ok) {
+							mesh.transform(scale, offset);
+							scene.addSoftBody(make_shared<SoftBody>(mesh, mass, alpha, damping, radius));
+						}
+					}
+					else {
+						TriMesh mesh;
+						ok = mesh.read(meshPath);
+						if (ok) {
+							mesh.transform(scale, offset);
+							scene.addCloth(make_shared<Cloth>(mesh, mass, alpha, damping, radius));
+						}
+					}
+				}
+			}
+			else if (keyword == "sphere") {
+				sphere = make_shared<Particle>();
+				swingAmplitude = 0.0;
+				swingFrequency = 0.0;
+				ok = parser.point(sphere->x) && parser.number(sphere->r);
+				if (!ok) {
+					sphere.reset();
+				}
+			}
+			else if (keyword == "plane") {
+				auto plane = make_shared<Plane>();
+				ok = parser.point(plane->x) && parser.point(plane->n) && plane->n.norm() > 0.0;
+				error = "expected a point and a nonzero normal";
+				if (ok) {
+					plane->n.normalize();
+					scene.addPlane(plane);
+				}
+			}
+			else if (keyword == "cylinder") {
+				auto cylinder = make_shared<Cylinder>();
+				ok = parser.point(cylinder->x) && parser.point(cylinder->axis) &&
+					parser.number(cylinder->r) && parser.number(cylinder->h) && cylinder->axis.norm() > 0.0;
+				error = "expected a point, a nonzero axis, radius and height";
+				if (ok) {
+					cylinder->axis.normalize();
+					scene.addCylinder(cylinder);
+				}
+			}
+			else {
+				ok = false;
+				error = "unknown declaration";
+			}
+		}
+		if (ok && !parser.done()) {
+			ok = false;
+			error = "unexpected text at the end of the line";
+		}
+		if (!ok) {
+			cerr << path << ":" << parser.line() << ": " << error << endl;
+			return false;
+		}
+	}
+	addSphere();
+	return true;
+}
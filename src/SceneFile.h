@@ -0,0 +1,40 @@
+#pragma once
+#ifndef SceneFile_H
+#define SceneFile_H
+
+#include <string>
+
+class Scene;
+
+/**
+ * Text scene descriptions, one declaration per line. '#' starts a comment
+ * and points are three numbers. Lines are applied in order, so bodies and
+ * colliders keep the order they are declared in.
+ *
+ *   h <time step>
+ *   gravity <g>
+ *   wind <max magnitude> <steps between targets>
+ *   cloth <rows> <cols> <x00> <x01> <x10> <x11> <mass> <alpha> <damping> <radius>
+ *   softbody <rows> <cols> <tubes> <x000> <x111> <mass> <alpha> <damping> <radius>
+ *   clothmesh <path> <offset> <scale> <mass> <alpha> <damping> <radius>
+ *   tetmesh <path> <offset> <scale> <mass> <alpha> <damping> <radius>
+ *   sphere <x> <radius>
+ *   swing <amplitude> <frequency>       (the previous sphere, along z)
+ *   plane <x> <normal>
+ *   cylinder <x> <axis> <radius> <height>
+ *
+ * clothmesh reads an OBJ file (see TriMesh) and tetmesh TetGen's path.node
+ * and path.ele (see TetMesh), relative to the scene file.
+ *
+ * h and gravity default to 1e-3 and 0 -9.8 0, and the wind to that of the
+ * default scene (Scene::load()), which resources/default.scene reproduces.
+ */
+class SceneFile
+{
+public:
+	// Adds the file's contents to a Scene that has not been loaded yet.
+	// Returns false and prints the offending line if it cannot be parsed.
+	static bool read(const std::string &path, Scene &scene);
+};
+
+#endif
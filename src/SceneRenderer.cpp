@@ -0,0 +1,303 @@
+#include <iostream>
+
+#define GLEW_STATIC
+#include <GL/glew.h>
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#define _USE_MATH_DEFINES
+#include <math.h>
+
+#include "SceneRenderer.h"
+#include "Scene.h"
+#include "Cloth.h"
+#include "SoftBody.h"
+#include "Particle.h"
+#include "Plane.h"
+#include "Cylinder.h"
+#include "Tetrahedron.h"
+#include "ConvexPolytope.h"
+#include "BodyMesh.h"
+#include "FrameFile.h"
+#include "Shape.h"
+#include "Program.h"
+#include "MatrixStack.h"
+
+using namespace std;
+
+SceneRenderer::SceneRenderer(shared_ptr<Scene> scene) :
+	scene(scene)
+{
+}
+
+SceneRenderer::~SceneRenderer()
+{
+}
+
+void SceneRenderer::load(const string &RESOURCE_DIR)
+{
+	sphereShape = make_shared<Shape>();
+	sphereShape->loadMesh(RESOURCE_DIR + "sphere2.obj");
+
+	planeShape = make_shared<Shape>();
+	planeShape->loadMesh(RESOURCE_DIR + "square.obj");
+
+	cylinderShape = make_shared<Shape>();
+	cylinderShape->loadMesh(RESOURCE_DIR + "cylinder.obj");
+
+	tetrahedronShape = make_shared<Shape>();
+	tetrahedronShape->loadMesh(RESOURCE_DIR + "tetrahedron.obj");
+}
+
+void SceneRenderer::addPolytope(const string &meshName, const Eigen::Matrix4d &E)
+{
+	auto shape = make_shared<Shape>();
+	shape->loadMesh(meshName);
+	auto polytope = make_shared<ConvexPolytope>();
+	polytope->setMesh(shape->getPosBuf(), shape->getEleBuf(), E);
+	scene->addPolytope(polytope);
+	polytopeShapes.push_back(shape);
+	polytopeTransforms.push_back(E);
+}
+
+// Appends the column major matrix m to buf
+static void appendTransform(const glm::mat4 &m, vector<float> &buf)
+{
+	const float *v = glm::value_ptr(m);
+	buf.insert(buf.end(), v, v + 16);
+}
+
+// x, y, z, r
+static glm::mat4 sphereTransform(const float *sphere)
+{
+	glm::mat4 transform = glm::translate(glm::mat4(1.0f), glm::make_vec3(sphere));
+	return glm::scale(transform, glm::vec3(sphere[3]));
+}
+
+// x, y, z
+static glm::mat4 planeTransform(const float *plane)
+{
+	glm::mat4 transform = glm::translate(glm::mat4(1.0f), glm::make_vec3(plane));
+	return glm::scale(transform, glm::vec3(1e5f)); // might have to fix if not rendering
+}
+
+// x, y, z, axis x, y, z, r, h
+static glm::mat4 cylinderTransform(const float *cylinder)
+{
+	glm::mat4 transform = glm::translate(glm::mat4(1.0f), glm::make_vec3(cylinder));
+	
+	Eigen::Vector3d up(0.0, 1.0, 0.0);
+	Eigen::Vector3d axis(cylinder[3], cylinder[4], cylinder[5]);
+	Eigen::Vector3d rotationAxis = up.cross(axis);
+	double dotProduct = std::max(-1.0, std::min(1.0, up.dot(axis)));
+	double rotationAngle = acos(dotProduct);
+
+	if (rotationAxis.squaredNorm() < 1e-12) {
+		if (dotProduct < 0.0) {
+			transform = glm::rotate(transform, float(M_PI), glm::vec3(1.0f, 0.0f, 0.0f));
+		}
+	}
+	else {
+		rotationAxis.normalize();
+		transform = glm::rotate(transform, float(rotationAngle), glm::vec3(rotationAxis.x(), rotationAxis.y(), rotationAxis.z()));
+	}
+
+	return glm::scale(transform, glm::vec3(cylinder[6], cylinder[7], cylinder[6]));
+}
+
+// Four corners, x, y, z each
+static glm::mat4 tetrahedronTransform(const float *tetrahedron)
+{
+	glm::vec3 p0 = glm::make_vec3(tetrahedron);
+	glm::vec3 p1 = glm::make_vec3(tetrahedron + 3);
+	glm::vec3 p2 = glm::make_vec3(tetrahedron + 6);
+	glm::vec3 p3 = glm::make_vec3(tetrahedron + 9);
+
+	glm::mat4 transform = glm::identity<glm::mat4>();
+	transform[0] = glm::vec4(p1 - p0, 0.0f);
+	transform[1] = glm::vec4(p2 - p0, 0.0f);
+	transform[2] = glm::vec4(p3 - p0, 0.0f);
+	transform[3] = glm::vec4(p0, 1.0f);
+	return transform;
+}
+
+void SceneRenderer::init()
+{
+	sphereShape->init();
+	planeShape->init();
+	cylinderShape->init();
+	tetrahedronShape->init();
+	for (size_t i = 0; i < polytopeShapes.size(); i++) {
+		// Polytopes are static, so their single instance is set once
+		glm::mat4 transform;
+		for (int c = 0; c < 4; c++) {
+			for (int r = 0; r < 4; r++) {
+				transform[c][r] = float(polytopeTransforms[i](r, c));
+			}
+		}
+		instances.clear();
+		appendTransform(transform, instances);
+		polytopeShapes[i]->init();
+		polytopeShapes[i]->setInstances(instances);
+	}
+	for (shared_ptr<Cloth> cloth : scene->getCloths()) {
+		cloth->acquireSnapshot();
+		auto mesh = make_shared<BodyMesh>();
+		mesh->init(cloth->getSnapshot(), cloth->getTexBuf(), cloth->getElements().capacity());
+		clothMeshes.push_back(mesh);
+	}
+	for (shared_ptr<SoftBody> softBody : scene->getSoftBodies()) {
+		softBody->acquireSnapshot();
+		auto mesh = make_shared<BodyMesh>();
+		mesh->init(softBody->getSnapshot(), softBody->getTexBuf(), softBody->getElements().capacity());
+		softBodyMeshes.push_back(mesh);
+	}
+}
+
+void SceneRenderer::update()
+{
+	// Only upload bodies the simulation has published since the last frame
+	const vector< shared_ptr<Cloth> > &cloths = scene->getCloths();
+	for (size_t i = 0; i < cloths.size(); i++) {
+		if (cloths[i]->acquireSnapshot()) {
+			clothMeshes[i]->upload(cloths[i]->getSnapshot());
+		}
+	}
+	const vector< shared_ptr<SoftBody> > &softBodies = scene->getSoftBodies();
+	for (size_t i = 0; i < softBodies.size(); i++) {
+		if (softBodies[i]->acquireSnapshot()) {
+			softBodyMeshes[i]->upload(softBodies[i]->getSnapshot());
+		}
+	}
+	updateInstances();
+}
+
+bool SceneRenderer::setFrameFile(shared_ptr<FrameFile> frames)
+{
+	vector<int> counts;
+	for (shared_ptr<Cloth> cloth : scene->getCloths()) {
+		counts.push_back(cloth->getParticles().size());
+	}
+	for (shared_ptr<SoftBody> softBody : scene->getSoftBodies()) {
+		counts.push_back(softBody->getParticles().size());
+	}
+	bool match = frames->getBodyCount() == (int)counts.size();
+	for (size_t b = 0; match && b < counts.size(); b++) {
+		match = frames->getParticleCount((int)b) == counts[b];
+	}
+	if (!match) {
+		cerr << "The frame file was recorded from a different scene" << endl;
+		return false;
+	}
+	frameFile = frames;
+	shownVersions.assign(counts.size(), -1);
+	return true;
+}
+
+// Area weighted vertex normals of the triangles in ele
+static void computeNormals(const float *pos, size_t nVerts, const unsigned int *ele, int eleCount, vector<float> &nor)
+{
+	nor.assign(nVerts * 3, 0.0f);
+	for (int k = 0; k + 2 < eleCount; k += 3) {
+		const float *x0 = pos + 3 * ele[k];
+		const float *x1 = pos + 3 * ele[k + 1];
+		const float *x2 = pos + 3 * ele[k + 2];
+		glm::vec3 n = glm::cross(glm::vec3(x1[0] - x0[0], x1[1] - x0[1], x1[2] - x0[2]),
+			glm::vec3(x2[0] - x0[0], x2[1] - x0[1], x2[2] - x0[2]));
+		for (int i = 0; i < 3; i++) {
+			float *v = &nor[3 * ele[k + i]];
+			v[0] += n.x;
+			v[1] += n.y;
+			v[2] += n.z;
+		}
+	}
+	for (size_t i = 0; i < nVerts; i++) {
+		float *v = &nor[3 * i];
+		float length = sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+		if (length > 0.0f) {
+			v[0] /= length;
+			v[1] /= length;
+			v[2] /= length;
+		}
+	}
+}
+
+void SceneRenderer::showFrame(size_t f)
+{
+	// Positions and elements go from the mapping straight into the GL
+	// buffers; only the normals are computed here
+	size_t nCloths = clothMeshes.size();
+	for (int b = 0; b < frameFile->getBodyCount(); b++) {
+		const float *pos = frameFile->getPositions(f, b);
+		const unsigned int *ele = frameFile->getElements(f, b);
+		int eleCount = frameFile->getElementCount(f, b);
+		size_t nVerts = frameFile->getParticleCount(b);
+		computeNormals(pos, nVerts, ele, eleCount, frameNormals);
+		long long version = frameFile->getElementVersion(f, b);
+		bool newElements = version != shownVersions[b];
+		shownVersions[b] = version;
+		shared_ptr<BodyMesh> mesh = (size_t)b < nCloths ? clothMeshes[b] : softBodyMeshes[b - nCloths];
+		mesh->upload(pos, frameNormals.data(), nVerts, newElements ? ele : nullptr, eleCount);
+	}
+	updateInstances();
+}
+
+void SceneRenderer::updateInstances()
+{
+	if (!scene->acquireColliders()) {
+		return;
+	}
+	const ColliderSnapshot &colliders = scene->getColliders();
+	instances.clear();
+	for (size_t i = 0; i + 4 <= colliders.spheres.size(); i += 4) {
+		appendTransform(sphereTransform(&colliders.spheres[i]), instances);
+	}
+	sphereShape->setInstances(instances);
+	instances.clear();
+	for (size_t i = 0; i + 3 <= colliders.planes.size(); i += 3) {
+		appendTransform(planeTransform(&colliders.planes[i]), instances);
+	}
+	planeShape->setInstances(instances);
+	instances.clear();
+	for (size_t i = 0; i + 8 <= colliders.cylinders.size(); i += 8) {
+		appendTransform(cylinderTransform(&colliders.cylinders[i]), instances);
+	}
+	cylinderShape->setInstances(instances);
+	instances.clear();
+	for (size_t i = 0; i + 12 <= colliders.tetrahedrons.size(); i += 12) {
+		appendTransform(tetrahedronTransform(&colliders.tetrahedrons[i]), instances);
+	}
+	tetrahedronShape->setInstances(instances);
+}
+
+void SceneRenderer::draw(shared_ptr<MatrixStack> M, const shared_ptr<Program> prog) const
+{
+	// All colliders share the material and the parent transform; each
+	// instance's own transform comes from its shape's instance buffer
+	int kdFrontID = prog->getUniform("kdFront");
+	if (kdFrontID != -1) {
+		glUniform3f(kdFrontID, 0.8f, 0.8f, 0.8f);
+	}
+	int kdBackID = prog->getUniform("kdBack");
+	if (kdBackID != -1) {
+		glUniform3f(kdBackID, 0.0f, 0.0f, 0.0f);
+	}
+	glUniformMatrix4fv(prog->getUniform("M"), 1, GL_FALSE, glm::value_ptr(M->topMatrix()));
+	Shape::setInstance(prog, glm::value_ptr(glm::mat4(1.0f)));
+	sphereShape->drawInstances(prog);
+	planeShape->drawInstances(prog);
+	cylinderShape->drawInstances(prog);
+	tetrahedronShape->drawInstances(prog);
+	for (shared_ptr<Shape> shape : polytopeShapes) {
+		shape->drawInstances(prog);
+	}
+	for (auto mesh : clothMeshes) {
+		mesh->draw(M, prog);
+	}
+	for (auto mesh : softBodyMeshes) {
+		mesh->draw(M, prog);
+	}
+}
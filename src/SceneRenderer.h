@@ -0,0 +1,71 @@
+#pragma once
+#ifndef SceneRenderer_H
+#define SceneRenderer_H
+
+#include <vector>
+#include <memory>
+#include <string>
+
+#define EIGEN_DONT_ALIGN_STATICALLY
+#include <Eigen/Dense>
+
+class Scene;
+class Shape;
+class BodyMesh;
+class MatrixStack;
+class Program;
+class Particle;
+class Plane;
+class Cylinder;
+class Tetrahedron;
+class FrameFile;
+
+/**
+ * Draws a Scene with OpenGL. All GL state for the scene (collider meshes
+ * and body buffers) lives here so that Scene itself stays GL-free.
+ * Colliders that share a mesh are drawn with one instanced call per pass.
+ */
+class SceneRenderer
+{
+public:
+	SceneRenderer(std::shared_ptr<Scene> scene);
+	virtual ~SceneRenderer();
+	
+	void load(const std::string &RESOURCE_DIR);
+	// Loads a closed convex OBJ mesh as a static obstacle placed by E. Its
+	// half-spaces are added to the scene as a ConvexPolytope, and the mesh
+	// is drawn with the other colliders. Call between load() and init().
+	void addPolytope(const std::string &meshName, const Eigen::Matrix4d &E);
+	void init();
+	// Uploads new body snapshots; call once per frame before the draw passes
+	void update();
+	// Playback: show the bodies as stored in a FrameFile recorded from this
+	// scene, instead of their published snapshots. Call showFrame in place
+	// of update(). setFrameFile returns false if the bodies differ.
+	bool setFrameFile(std::shared_ptr<FrameFile> frames);
+	void showFrame(size_t f);
+	void draw(std::shared_ptr<MatrixStack> M, const std::shared_ptr<Program> prog) const;
+	
+private:
+	// Gathers the collider transforms into each shape's instance buffer
+	void updateInstances();
+	
+	std::shared_ptr<Scene> scene;
+	
+	std::shared_ptr<Shape> sphereShape;
+	std::shared_ptr<Shape> planeShape;
+	std::shared_ptr<Shape> cylinderShape;
+	std::shared_ptr<Shape> tetrahedronShape;
+	std::vector< std::shared_ptr<Shape> > polytopeShapes;
+	std::vector<Eigen::Matrix4d> polytopeTransforms;
+	std::vector<float> instances; // scratch for updateInstances
+	
+	std::vector< std::shared_ptr<BodyMesh> > clothMeshes;
+	std::vector< std::shared_ptr<BodyMesh> > softBodyMeshes;
+
+	std::shared_ptr<FrameFile> frameFile;
+	std::vector<long long> shownVersions; // element version per body, -1 if none
+	std::vector<float> frameNormals;
+};
+
+#endif
@@ -1,10 +1,19 @@
 #include "Shape.h"
 #include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+#include <tuple>
+#include <algorithm>
+#include <sys/types.h>
+#include <sys/stat.h>
 
 #include "GLSL.h"
 #include "Program.h"
+#include "MappedFile.h"
 
-#define TINYOBJLOADER_IMPLEMENTATION
 #include "tiny_obj_loader.h"
 
 using namespace std;
@@ -12,7 +21,9 @@ using namespace std;
 Shape::Shape() :
 	posBufID(0),
 	norBufID(0),
-	texBufID(0)
+	texBufID(0),
+	eleBufID(0),
+	instBufID(0)
 {
 }
 
@@ -20,8 +31,166 @@ Shape::~Shape()
 {
 }
 
+// Mesh cache layout: this header, the OBJ path, then the position, normal
+// and texture coordinate arrays and the indices. Bump the version when the layout or what
+// loadMesh computes from the OBJ changes.
+namespace
+{
+
+const char CACHE_MAGIC[8] = { 'S', 'I', 'M', 'M', 'E', 'S', 'H', '1' };
+const uint32_t CACHE_VERSION = 2;
+
+struct CacheHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t pathLength;
+	uint64_t objSize;
+	int64_t objTime;
+	uint64_t counts[4]; // floats in posBuf, norBuf and texBuf, indices in eleBuf
+};
+
+// The header that a cache of the OBJ file must have, without the counts.
+// False if the OBJ cannot be found.
+bool cacheKey(const string &meshName, CacheHeader &header)
+{
+	struct stat st;
+	if (stat(meshName.c_str(), &st) != 0) {
+		return false;
+	}
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+	header.version = CACHE_VERSION;
+	header.pathLength = uint32_t(meshName.size());
+	header.objSize = uint64_t(st.st_size);
+	header.objTime = int64_t(st.st_mtime);
+	return true;
+}
+
+// Tom Forsyth's linear-speed vertex cache optimisation: emits triangles
+// greedily, always picking the one whose vertices score highest in a
+// simulated LRU cache. Vertices score high when recently used and when few
+// of their triangles are left, so that fans are finished before moving on.
+void optimizeVertexCache(vector<unsigned> &ele, int nVerts)
+{
+	const int CACHE_SIZE = 32;
+	int nTris = int(ele.size() / 3);
+	
+	// Triangles of each vertex (CSR). The first remaining[v] are not yet
+	// emitted.
+	vector<int> start(nVerts + 1, 0);
+	for(unsigned v : ele) {
+		start[v + 1]++;
+	}
+	for(int v = 0; v < nVerts; v++) {
+		start[v + 1] += start[v];
+	}
+	vector<int> vertexTris(ele.size());
+	vector<int> remaining(nVerts, 0);
+	for(int t = 0; t < nTris; t++) {
+		for(int k = 0; k < 3; k++) {
+			unsigned v = ele[3*t+k];
+			vertexTris[start[v] + remaining[v]++] = t;
+		}
+	}
+	
+	vector<int> cachePos(nVerts, -1);
+	auto vertexScore = [&](int v) {
+		if(remaining[v] == 0) {
+			return -1.0f;
+		}
+		float score = 0.0f;
+		int pos = cachePos[v];
+		if(pos >= 0) {
+			// The last triangle's vertices score the same, so that the next
+			// triangle does not just reuse its most recent edge
+			score = pos < 3 ? 0.75f : pow(1.0f - float(pos - 3) / (CACHE_SIZE - 3), 1.5f);
+		}
+		return score + 2.0f / sqrt(float(remaining[v]));
+	};
+	vector<float> scores(nVerts);
+	for(int v = 0; v < nVerts; v++) {
+		scores[v] = vertexScore(v);
+	}
+	vector<char> emitted(nTris, 0);
+	auto triScore = [&](int t) {
+		return scores[ele[3*t]] + scores[ele[3*t+1]] + scores[ele[3*t+2]];
+	};
+	
+	int best = -1;
+	float bestScore = -1.0f;
+	for(int t = 0; t < nTris; t++) {
+		if(triScore(t) > bestScore) {
+			bestScore = triScore(t);
+			best = t;
+		}
+	}
+	vector<unsigned> out;
+	out.reserve(ele.size());
+	vector<int> cache;
+	vector<int> newCache;
+	int next = 0; // no triangle before this one is left
+	for(int n = 0; n < nTris; n++) {
+		if(best < 0) {
+			// Nothing left touches the cache
+			while(emitted[next]) {
+				next++;
+			}
+			best = next;
+		}
+		emitted[best] = 1;
+		const unsigned *tri = &ele[3*best];
+		newCache.assign(tri, tri + 3);
+		for(int k = 0; k < 3; k++) {
+			out.push_back(tri[k]);
+			int v = int(tri[k]);
+			int *begin = &vertexTris[start[v]];
+			int *last = begin + --remaining[v];
+			*find(begin, last, best) = *last;
+		}
+		for(int v : cache) {
+			if(v != int(tri[0]) && v != int(tri[1]) && v != int(tri[2])) {
+				newCache.push_back(v);
+			}
+		}
+		for(size_t k = 0; k < newCache.size(); k++) {
+			int v = newCache[k];
+			cachePos[v] = k < size_t(CACHE_SIZE) ? int(k) : -1;
+			scores[v] = vertexScore(v);
+		}
+		if(newCache.size() > size_t(CACHE_SIZE)) {
+			newCache.resize(CACHE_SIZE);
+		}
+		cache.swap(newCache);
+		
+		best = -1;
+		bestScore = -1.0f;
+		for(int v : cache) {
+			for(int k = start[v]; k < start[v] + remaining[v]; k++) {
+				int t = vertexTris[k];
+				if(triScore(t) > bestScore) {
+					bestScore = triScore(t);
+					best = t;
+				}
+			}
+		}
+	}
+	ele.swap(out);
+}
+
+}
+
 void Shape::loadMesh(const string &meshName)
 {
+	posBuf.clear();
+	norBuf.clear();
+	texBuf.clear();
+	eleBuf.clear();
+	string cacheName = meshName + ".meshcache";
+	if (loadCache(meshName, cacheName)) {
+		return;
+	}
+
 	// Load geometry
 	tinyobj::attrib_t attrib;
 	std::vector<tinyobj::shape_t> shapes;
@@ -33,36 +202,145 @@ void Shape::loadMesh(const string &meshName)
 	} else {
 		// Some OBJ files have different indices for vertex positions, normals,
 		// and texture coordinates. For example, a cube corner vertex may have
-		// three different normals. Here, we are going to duplicate all such
-		// vertices.
-		// Loop over shapes
+		// three different normals. Corners with the same three indices share
+		// a vertex; the others get their own.
+		vector<tinyobj::index_t> corners;
 		for(size_t s = 0; s < shapes.size(); s++) {
-			// Loop over faces (polygons)
-			size_t index_offset = 0;
-			for(size_t f = 0; f < shapes[s].mesh.num_face_vertices.size(); f++) {
-				size_t fv = shapes[s].mesh.num_face_vertices[f];
-				// Loop over vertices in the face.
-				for(size_t v = 0; v < fv; v++) {
-					// access to vertex
-					tinyobj::index_t idx = shapes[s].mesh.indices[index_offset + v];
-					posBuf.push_back(attrib.vertices[3*idx.vertex_index+0]);
-					posBuf.push_back(attrib.vertices[3*idx.vertex_index+1]);
-					posBuf.push_back(attrib.vertices[3*idx.vertex_index+2]);
-					if(!attrib.normals.empty()) {
-						norBuf.push_back(attrib.normals[3*idx.normal_index+0]);
-						norBuf.push_back(attrib.normals[3*idx.normal_index+1]);
-						norBuf.push_back(attrib.normals[3*idx.normal_index+2]);
-					}
-					if(!attrib.texcoords.empty()) {
-						texBuf.push_back(attrib.texcoords[2*idx.texcoord_index+0]);
-						texBuf.push_back(attrib.texcoords[2*idx.texcoord_index+1]);
-					}
-				}
-				index_offset += fv;
-				// per-face material (IGNORE)
-				//shapes[s].mesh.material_ids[f];
+			// Faces are triangulated by LoadObj
+			const vector<tinyobj::index_t> &indices = shapes[s].mesh.indices;
+			corners.insert(corners.end(), indices.begin(), indices.end());
+		}
+		vector<int> order(corners.size());
+		for(size_t c = 0; c < order.size(); c++) {
+			order[c] = int(c);
+		}
+		auto key = [&](int c) {
+			const tinyobj::index_t &idx = corners[c];
+			return make_tuple(idx.vertex_index, idx.normal_index, idx.texcoord_index);
+		};
+		sort(order.begin(), order.end(), [&](int a, int b) {
+			return key(a) < key(b);
+		});
+		eleBuf.resize(corners.size());
+		vector<int> firstCorner;
+		for(size_t k = 0; k < order.size(); k++) {
+			if(k == 0 || key(order[k]) != key(order[k - 1])) {
+				firstCorner.push_back(order[k]);
+			}
+			eleBuf[order[k]] = unsigned(firstCorner.size() - 1);
+		}
+		int nVerts = int(firstCorner.size());
+		
+		// Order the triangles for the post-transform cache, then number the
+		// vertices in order of first use so that fetches walk forward
+		optimizeVertexCache(eleBuf, nVerts);
+		vector<int> newIndex(nVerts, -1);
+		vector<int> oldIndex;
+		oldIndex.reserve(nVerts);
+		for(unsigned &v : eleBuf) {
+			if(newIndex[v] < 0) {
+				newIndex[v] = int(oldIndex.size());
+				oldIndex.push_back(int(v));
+			}
+			v = unsigned(newIndex[v]);
+		}
+		for(int v : oldIndex) {
+			const tinyobj::index_t &idx = corners[firstCorner[v]];
+			posBuf.push_back(attrib.vertices[3*idx.vertex_index+0]);
+			posBuf.push_back(attrib.vertices[3*idx.vertex_index+1]);
+			posBuf.push_back(attrib.vertices[3*idx.vertex_index+2]);
+			if(!attrib.normals.empty()) {
+				norBuf.push_back(attrib.normals[3*idx.normal_index+0]);
+				norBuf.push_back(attrib.normals[3*idx.normal_index+1]);
+				norBuf.push_back(attrib.normals[3*idx.normal_index+2]);
+			}
+			if(!attrib.texcoords.empty()) {
+				texBuf.push_back(attrib.texcoords[2*idx.texcoord_index+0]);
+				texBuf.push_back(attrib.texcoords[2*idx.texcoord_index+1]);
 			}
 		}
+		saveCache(meshName, cacheName);
+	}
+}
+
+bool Shape::loadCache(const string &meshName, const string &cacheName)
+{
+	CacheHeader key;
+	struct stat st;
+	if (!cacheKey(meshName, key) || stat(cacheName.c_str(), &st) != 0) {
+		return false;
+	}
+	MappedFile file;
+	if (!file.open(cacheName) || file.size() < sizeof(CacheHeader)) {
+		return false;
+	}
+	CacheHeader header;
+	memcpy(&header, file.data(), sizeof(header));
+	if (memcmp(header.magic, key.magic, sizeof(key.magic)) != 0 || header.version != key.version ||
+		header.pathLength != key.pathLength || header.objSize != key.objSize || header.objTime != key.objTime ||
+		memcmp(file.data() + sizeof(header), meshName.data(), meshName.size()) != 0) {
+		return false;
+	}
+	// The counts must account for the rest of the file exactly, so a
+	// truncated cache is parsed again. Floats and indices are both 4 bytes.
+	size_t offset = sizeof(header) + header.pathLength;
+	size_t remaining = file.size() - min(offset, file.size());
+	uint64_t total = 0;
+	for(uint64_t count : header.counts) {
+		if(count > remaining / 4) {
+			return false;
+		}
+		total += count;
+	}
+	if(total * 4 != remaining) {
+		return false;
+	}
+	posBuf.resize(size_t(header.counts[0]));
+	norBuf.resize(size_t(header.counts[1]));
+	texBuf.resize(size_t(header.counts[2]));
+	eleBuf.resize(size_t(header.counts[3]));
+	void *data[4] = { posBuf.data(), norBuf.data(), texBuf.data(), eleBuf.data() };
+	for(int k = 0; k < 4; k++) {
+		memcpy(data[k], file.data() + offset, size_t(header.counts[k]) * 4);
+		offset += size_t(header.counts[k]) * 4;
+	}
+	return true;
+}
+
+void Shape::saveCache(const string &meshName, const string &cacheName) const
+{
+	CacheHeader header;
+	if (!cacheKey(meshName, header)) {
+		return;
+	}
+	header.counts[0] = posBuf.size();
+	header.counts[1] = norBuf.size();
+	header.counts[2] = texBuf.size();
+	header.counts[3] = eleBuf.size();
+	// Written under a temporary name and renamed, so that a partly written
+	// cache is never read. The resource directory may be read-only, in
+	// which case the OBJ is simply parsed every time.
+	string tmpName = cacheName + ".tmp";
+	{
+		ofstream out(tmpName, ios::binary | ios::trunc);
+		if (!out) {
+			return;
+		}
+		out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+		out.write(meshName.data(), meshName.size());
+		out.write(reinterpret_cast<const char *>(posBuf.data()), posBuf.size() * sizeof(float));
+		out.write(reinterpret_cast<const char *>(norBuf.data()), norBuf.size() * sizeof(float));
+		out.write(reinterpret_cast<const char *>(texBuf.data()), texBuf.size() * sizeof(float));
+		out.write(reinterpret_cast<const char *>(eleBuf.data()), eleBuf.size() * sizeof(unsigned int));
+		if (!out) {
+			out.close();
+			remove(tmpName.c_str());
+			return;
+		}
+	}
+	remove(cacheName.c_str());
+	if (rename(tmpName.c_str(), cacheName.c_str()) != 0) {
+		remove(tmpName.c_str());
 	}
 }
 
@@ -87,15 +365,20 @@ void Shape::init()
 		glBufferData(GL_ARRAY_BUFFER, texBuf.size()*sizeof(float), &texBuf[0], GL_STATIC_DRAW);
 	}
 	
+	// Send the element array to the GPU
+	glGenBuffers(1, &eleBufID);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, eleBufID);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, eleBuf.size()*sizeof(unsigned int), eleBuf.data(), GL_STATIC_DRAW);
+	
 	// Unbind the arrays
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 	
 	GLSL::checkError(GET_FILE_LINE);
 }
 
-void Shape::draw(const shared_ptr<Program> prog) const
+void Shape::bindBuffers(const shared_ptr<Program> prog) const
 {
-	GLSL::checkError(GET_FILE_LINE);
 	// Bind position buffer
 	int h_pos = prog->getAttribute("aPos");
 	glEnableVertexAttribArray(h_pos);
@@ -118,19 +401,101 @@ void Shape::draw(const shared_ptr<Program> prog) const
 		glVertexAttribPointer(h_tex, 2, GL_FLOAT, GL_FALSE, 0, (const void *)0);
 	}
 	
-	// Draw
-	int count = (int)posBuf.size()/3; // number of indices to be rendered
-	glDrawArrays(GL_TRIANGLES, 0, count);
-	
-	// Disable and unbind
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, eleBufID);
+}
+
+void Shape::unbindBuffers(const shared_ptr<Program> prog) const
+{
+	int h_tex = prog->getAttribute("aTex");
 	if(h_tex != -1) {
 		glDisableVertexAttribArray(h_tex);
 	}
+	int h_nor = prog->getAttribute("aNor");
 	if(h_nor != -1) {
 		glDisableVertexAttribArray(h_nor);
 	}
-	glDisableVertexAttribArray(h_pos);
+	glDisableVertexAttribArray(prog->getAttribute("aPos"));
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+void Shape::draw(const shared_ptr<Program> prog) const
+{
+	GLSL::checkError(GET_FILE_LINE);
+	bindBuffers(prog);
+	int count = (int)eleBuf.size(); // number of indices to be rendered
+	glDrawElements(GL_TRIANGLES, count, GL_UNSIGNED_INT, (const void *)0);
+	unbindBuffers(prog);
+	GLSL::checkError(GET_FILE_LINE);
+}
+
+// Instanced arrays are core since 3.3; older contexts fall back to one
+// draw per instance with aInstance set as a constant attribute
+static bool instancingSupported()
+{
+	return GLEW_VERSION_3_3;
+}
+
+void Shape::setInstances(const vector<float> &transforms)
+{
+	instBuf = transforms;
+	if(!instancingSupported()) {
+		return;
+	}
+	if(instBufID == 0) {
+		glGenBuffers(1, &instBufID);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, instBufID);
+	glBufferData(GL_ARRAY_BUFFER, instBuf.size()*sizeof(float), instBuf.data(), GL_STREAM_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	GLSL::checkError(GET_FILE_LINE);
+}
+
+void Shape::setInstance(const shared_ptr<Program> prog, const float *transform)
+{
+	int h_inst = prog->getAttribute("aInstance");
+	if(h_inst == -1) {
+		return;
+	}
+	// A mat4 attribute takes four consecutive locations, one per column
+	for(int c = 0; c < 4; c++) {
+		glVertexAttrib4fv(h_inst + c, transform + 4*c);
+	}
+}
+
+void Shape::drawInstances(const shared_ptr<Program> prog) const
+{
+	int instanceCount = (int)(instBuf.size() / 16);
+	if(instanceCount == 0) {
+		return;
+	}
+	static const float identity[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+	GLSL::checkError(GET_FILE_LINE);
+	bindBuffers(prog);
+	int count = (int)eleBuf.size();
+	int h_inst = prog->getAttribute("aInstance");
+	if(h_inst != -1 && instBufID != 0) {
+		glBindBuffer(GL_ARRAY_BUFFER, instBufID);
+		for(int c = 0; c < 4; c++) {
+			glEnableVertexAttribArray(h_inst + c);
+			glVertexAttribPointer(h_inst + c, 4, GL_FLOAT, GL_FALSE, 16*sizeof(float), (const void *)(4*c*sizeof(float)));
+			glVertexAttribDivisor(h_inst + c, 1);
+		}
+		glDrawElementsInstanced(GL_TRIANGLES, count, GL_UNSIGNED_INT, (const void *)0, instanceCount);
+		for(int c = 0; c < 4; c++) {
+			glVertexAttribDivisor(h_inst + c, 0);
+			glDisableVertexAttribArray(h_inst + c);
+		}
+	}
+	else {
+		for(int i = 0; i < instanceCount; i++) {
+			setInstance(prog, &instBuf[16*i]);
+			glDrawElements(GL_TRIANGLES, count, GL_UNSIGNED_INT, (const void *)0);
+		}
+	}
+	// The attribute's current value is undefined after it was an array;
+	// leave identity for draws that do not set it
+	setInstance(prog, identity);
+	unbindBuffers(prog);
 	GLSL::checkError(GET_FILE_LINE);
 }
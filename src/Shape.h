@@ -9,11 +9,24 @@
 class Program;
 
 /**
- * A shape defined by a list of triangles
- * - posBuf should be of length 3*ntris
- * - norBuf should be of length 3*ntris (if normals are available)
- * - texBuf should be of length 2*ntris (if texture coords are available)
- * posBufID, norBufID, and texBufID are OpenGL buffer identifiers.
+ * A shape defined by a list of indexed triangles
+ * - posBuf should be of length 3*nverts
+ * - norBuf should be of length 3*nverts (if normals are available)
+ * - texBuf should be of length 2*nverts (if texture coords are available)
+ * - eleBuf should be of length 3*ntris
+ * posBufID, norBufID, texBufID and eleBufID are OpenGL buffer identifiers.
+ *
+ * Corners of the OBJ that share their position, normal and texture
+ * coordinate become one vertex, and the triangles are reordered for the
+ * GPU's post-transform vertex cache.
+ *
+ * loadMesh keeps a binary copy of the buffers next to the OBJ file
+ * (name.obj.meshcache) and reads that instead of the OBJ on later runs,
+ * as long as the OBJ's path, size and modification time still match.
+ *
+ * Repeated copies of a shape are drawn with drawInstances: setInstances
+ * uploads one model matrix per copy, which the vertex shader reads from
+ * the mat4 attribute aInstance, and all copies go out in one call.
  */
 class Shape
 {
@@ -23,14 +36,30 @@ public:
 	void loadMesh(const std::string &meshName);
 	void init();
 	void draw(const std::shared_ptr<Program> prog) const;
+	// transforms holds 16 floats (a column major matrix) per instance
+	void setInstances(const std::vector<float> &transforms);
+	void drawInstances(const std::shared_ptr<Program> prog) const;
+	// Sets aInstance for draws without an instance buffer, e.g. to identity
+	static void setInstance(const std::shared_ptr<Program> prog, const float *transform);
+	const std::vector<float> &getPosBuf() const { return posBuf; }
+	const std::vector<unsigned int> &getEleBuf() const { return eleBuf; }
 	
 private:
+	bool loadCache(const std::string &meshName, const std::string &cacheName);
+	void saveCache(const std::string &meshName, const std::string &cacheName) const;
+	void bindBuffers(const std::shared_ptr<Program> prog) const;
+	void unbindBuffers(const std::shared_ptr<Program> prog) const;
+
 	std::vector<float> posBuf;
 	std::vector<float> norBuf;
 	std::vector<float> texBuf;
+	std::vector<unsigned int> eleBuf;
 	unsigned posBufID;
 	unsigned norBufID;
 	unsigned texBufID;
+	unsigned eleBufID;
+	std::vector<float> instBuf;
+	unsigned instBufID;
 };
 
 #endif
@@ -0,0 +1,441 @@
+#include <iostream>
+#include <cstring>
+#include <algorithm>
+
+#include "SimCache.h"
+#include "Scene.h"
+#include "Cloth.h"
+#include "SoftBody.h"
+
+using namespace std;
+using namespace Eigen;
+
+static const char MAGIC[8] = { 'S', 'I', 'M', 'C', 'A', 'C', 'H', '1' };
+static const char INDEX_MAGIC[8] = { 'S', 'I', 'M', 'C', 'I', 'D', 'X', '1' };
+// Element count of a body whose elements did not change since the
+// previous frame of the chunk
+static const int32_t UNCHANGED = -1;
+
+template <typename T>
+static void append(vector<char> &buf, const T &v)
+{
+	const char *bytes = reinterpret_cast<const char *>(&v);
+	buf.insert(buf.end(), bytes, bytes + sizeof(T));
+}
+
+template <typename T>
+static void appendArray(vector<char> &buf, const vector<T> &v)
+{
+	const char *bytes = reinterpret_cast<const char *>(v.data());
+	buf.insert(buf.end(), bytes, bytes + v.size() * sizeof(T));
+}
+
+template <typename T>
+static void writeValue(ofstream &out, const T &v)
+{
+	out.write(reinterpret_cast<const char *>(&v), sizeof(T));
+}
+
+template <typename T>
+static bool readValue(ifstream &in, T &v)
+{
+	return (bool)in.read(reinterpret_cast<char *>(&v), sizeof(T));
+}
+
+template <typename T>
+static T load(const char *p)
+{
+	T v;
+	memcpy(&v, p, sizeof(T));
+	return v;
+}
+
+// Cloths first, then soft bodies, like the frames
+static vector<const ParticleStore *> bodyParticles(const Scene &scene)
+{
+	vector<const ParticleStore *> stores;
+	for (shared_ptr<Cloth> cloth : scene.getCloths()) {
+		stores.push_back(&cloth->getParticles());
+	}
+	for (shared_ptr<SoftBody> softBody : scene.getSoftBodies()) {
+		stores.push_back(&softBody->getParticles());
+	}
+	return stores;
+}
+
+static vector<const ElementList *> bodyElements(const Scene &scene)
+{
+	vector<const ElementList *> lists;
+	for (shared_ptr<Cloth> cloth : scene.getCloths()) {
+		lists.push_back(&cloth->getElements());
+	}
+	for (shared_ptr<SoftBody> softBody : scene.getSoftBodies()) {
+		lists.push_back(&softBody->getElements());
+	}
+	return lists;
+}
+
+SimCacheWriter::SimCacheWriter() :
+	interval(1),
+	chunkFrames(64),
+	steps(0),
+	frames(0),
+	dropped(0),
+	closing(false),
+	failed(false),
+	chunkFirstFrame(0),
+	chunkFrameCount(0),
+	writtenFrames(0)
+{
+}
+
+SimCacheWriter::~SimCacheWriter()
+{
+	close();
+}
+
+bool SimCacheWriter::open(const string &path, const Scene &scene, int interval, int chunkFrames, int queueFrames)
+{
+	close();
+	this->path = path;
+	out.open(path, ios::binary | ios::trunc);
+	if (!out) {
+		cerr << "Cannot open " << path << endl;
+		return false;
+	}
+	this->interval = max(1, interval);
+	this->chunkFrames = max(1, chunkFrames);
+
+	vector<const ParticleStore *> stores = bodyParticles(scene);
+	out.write(MAGIC, sizeof(MAGIC));
+	writeValue(out, uint32_t(stores.size()));
+	writeValue(out, uint32_t(this->interval));
+	writeValue(out, scene.getTimeStep());
+	for (const ParticleStore *particles : stores) {
+		writeValue(out, uint32_t(particles->size()));
+	}
+
+	steps = 0;
+	frames = 0;
+	dropped = 0;
+	// Forces the first frame to copy every element list
+	elementVersions.assign(stores.size(), ~0ul);
+	freeFrames.clear();
+	queue.clear();
+	for (int i = 0; i < max(1, queueFrames); i++) {
+		freeFrames.push_back(make_unique<SimCacheFrame>());
+	}
+	closing = false;
+	failed = false;
+	chunk.clear();
+	chunkFrameCount = 0;
+	writtenFrames = 0;
+	elements.assign(stores.size(), vector<unsigned int>());
+	chunks.clear();
+	writer = thread(&SimCacheWriter::writerLoop, this);
+	return true;
+}
+
+void SimCacheWriter::capture(const Scene &scene)
+{
+	if (!isOpen() || ++steps % interval != 0) {
+		return;
+	}
+	unique_ptr<SimCacheFrame> frame;
+	{
+		lock_guard<std::mutex> lock(mutex);
+		if (freeFrames.empty()) {
+			dropped++;
+			return;
+		}
+		frame = move(freeFrames.back());
+		freeFrames.pop_back();
+	}
+
+	vector<const ParticleStore *> stores = bodyParticles(scene);
+	vector<const ElementList *> lists = bodyElements(scene);
+	frame->step = steps;
+	frame->t = scene.getTime();
+	frame->positions.resize(stores.size());
+	frame->elements.resize(stores.size());
+	frame->elementsChanged.assign(stores.size(), 0);
+	for (size_t b = 0; b < stores.size(); b++) {
+		const vector<Vector3d> &x = stores[b]->x;
+		vector<float> &pos = frame->positions[b];
+		pos.resize(x.size() * 3);
+		for (size_t i = 0; i < x.size(); i++) {
+			pos[3 * i + 0] = float(x[i](0));
+			pos[3 * i + 1] = float(x[i](1));
+			pos[3 * i + 2] = float(x[i](2));
+		}
+		if (lists[b]->getVersion() != elementVersions[b]) {
+			elementVersions[b] = lists[b]->getVersion();
+			frame->elements[b] = lists[b]->indices();
+			frame->elementsChanged[b] = 1;
+		}
+	}
+	frames++;
+
+	{
+		lock_guard<std::mutex> lock(mutex);
+		queue.push_back(move(frame));
+	}
+	wake.notify_one();
+}
+
+bool SimCacheWriter::close()
+{
+	if (!isOpen()) {
+		return !failed;
+	}
+	{
+		lock_guard<std::mutex> lock(mutex);
+		closing = true;
+	}
+	wake.notify_one();
+	writer.join();
+
+	uint64_t indexOffset = uint64_t(out.tellp());
+	for (const ChunkEntry &entry : chunks) {
+		writeValue(out, entry.offset);
+		writeValue(out, entry.size);
+		writeValue(out, entry.firstFrame);
+		writeValue(out, entry.nFrames);
+	}
+	writeValue(out, uint64_t(chunks.size()));
+	writeValue(out, indexOffset);
+	out.write(INDEX_MAGIC, sizeof(INDEX_MAGIC));
+	out.close();
+	if (!out || failed) {
+		failed = true;
+		cerr << "Cannot write " << path << endl;
+	}
+	return !failed;
+}
+
+void SimCacheWriter::writerLoop()
+{
+	unique_lock<std::mutex> lock(mutex);
+	for (;;) {
+		wake.wait(lock, [this] { return closing || !queue.empty(); });
+		if (queue.empty()) {
+			break;
+		}
+		unique_ptr<SimCacheFrame> frame = move(queue.front());
+		queue.pop_front();
+		lock.unlock();
+		encode(*frame);
+		lock.lock();
+		freeFrames.push_back(move(frame));
+	}
+	lock.unlock();
+	flushChunk();
+}
+
+void SimCacheWriter::encode(const SimCacheFrame &frame)
+{
+	if (chunkFrameCount == 0) {
+		chunkFirstFrame = writtenFrames;
+	}
+	append(chunk, frame.step);
+	append(chunk, frame.t);
+	for (size_t b = 0; b < frame.positions.size(); b++) {
+		appendArray(chunk, frame.positions[b]);
+		if (frame.elementsChanged[b]) {
+			elements[b] = frame.elements[b];
+		}
+		if (frame.elementsChanged[b] || chunkFrameCount == 0) {
+			append(chunk, int32_t(elements[b].size()));
+			appendArray(chunk, elements[b]);
+		}
+		else {
+			append(chunk, UNCHANGED);
+		}
+	}
+	chunkFrameCount++;
+	writtenFrames++;
+	if (chunkFrameCount == uint64_t(chunkFrames)) {
+		flushChunk();
+	}
+}
+
+void SimCacheWriter::flushChunk()
+{
+	if (chunkFrameCount == 0) {
+		return;
+	}
+	ChunkEntry entry;
+	entry.offset = uint64_t(out.tellp());
+	entry.size = chunk.size();
+	entry.firstFrame = chunkFirstFrame;
+	entry.nFrames = chunkFrameCount;
+	out.write(chunk.data(), chunk.size());
+	if (!out) {
+		failed = true;
+	}
+	chunks.push_back(entry);
+	chunk.clear();
+	chunkFrameCount = 0;
+}
+
+SimCacheReader::SimCacheReader() :
+	interval(1),
+	h(0.0),
+	frameCount(0),
+	loadedChunk(SIZE_MAX)
+{
+}
+
+SimCacheReader::~SimCacheReader()
+{
+	close();
+}
+
+bool SimCacheReader::open(const string &path)
+{
+	close();
+	in.open(path, ios::binary);
+	char magic[sizeof(MAGIC)];
+	uint32_t nBodies = 0, cacheInterval = 0;
+	if (!in || !in.read(magic, sizeof(magic)) || memcmp(magic, MAGIC, sizeof(MAGIC)) != 0 ||
+		!readValue(in, nBodies) || !readValue(in, cacheInterval) || !readValue(in, h)) {
+		cerr << path << " is not a simulation cache" << endl;
+		close();
+		return false;
+	}
+	interval = int(cacheInterval);
+	particleCounts.resize(nBodies);
+	for (uint32_t b = 0; b < nBodies; b++) {
+		uint32_t n = 0;
+		readValue(in, n);
+		particleCounts[b] = int(n);
+	}
+
+	// The chunk index is at the end, so an unfinished cache has none
+	uint64_t nChunks = 0, indexOffset = 0;
+	in.seekg(-int(2 * sizeof(uint64_t) + sizeof(INDEX_MAGIC)), ios::end);
+	if (!in || !readValue(in, nChunks) || !readValue(in, indexOffset) ||
+		!in.read(magic, sizeof(magic)) || memcmp(magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0) {
+		cerr << path << " has no chunk index; was the cache closed?" << endl;
+		close();
+		return false;
+	}
+	in.seekg(indexOffset);
+	chunks.resize(nChunks);
+	for (ChunkEntry &entry : chunks) {
+		readValue(in, entry.offset);
+		readValue(in, entry.size);
+		readValue(in, entry.firstFrame);
+		readValue(in, entry.nFrames);
+	}
+	if (!in) {
+		cerr << path << " has a corrupt chunk index" << endl;
+		close();
+		return false;
+	}
+	frameCount = chunks.empty() ? 0 : chunks.back().firstFrame + chunks.back().nFrames;
+	return true;
+}
+
+void SimCacheReader::close()
+{
+	if (in.is_open()) {
+		in.close();
+	}
+	in.clear();
+	particleCounts.clear();
+	chunks.clear();
+	frameCount = 0;
+	loadedChunk = SIZE_MAX;
+	chunk.clear();
+	frameOffsets.clear();
+	elementOffsets.clear();
+}
+
+bool SimCacheReader::loadChunk(size_t c)
+{
+	const ChunkEntry &entry = chunks[c];
+	loadedChunk = SIZE_MAX;
+	chunk.resize(entry.size);
+	in.clear();
+	in.seekg(entry.offset);
+	if (!in.read(chunk.data(), chunk.size())) {
+		cerr << "Cannot read cache chunk " << c << endl;
+		return false;
+	}
+
+	// Find every frame and the element list each frame uses
+	size_t nBodies = particleCounts.size();
+	frameOffsets.resize(entry.nFrames);
+	elementOffsets.resize(entry.nFrames * nBodies);
+	size_t pos = 0;
+	for (uint64_t f = 0; f < entry.nFrames; f++) {
+		frameOffsets[f] = pos;
+		pos += sizeof(uint64_t) + sizeof(double);
+		for (size_t b = 0; b < nBodies; b++) {
+			pos += particleCounts[b] * 3 * sizeof(float);
+			if (pos + sizeof(int32_t) > chunk.size()) {
+				cerr << "Corrupt cache chunk " << c << endl;
+				return false;
+			}
+			int32_t count = load<int32_t>(&chunk[pos]);
+			if (count == UNCHANGED && f > 0) {
+				elementOffsets[f * nBodies + b] = elementOffsets[(f - 1) * nBodies + b];
+				pos += sizeof(int32_t);
+			}
+			else if (count >= 0) {
+				elementOffsets[f * nBodies + b] = pos;
+				pos += sizeof(int32_t) + size_t(count) * sizeof(unsigned int);
+			}
+			else {
+				cerr << "Corrupt cache chunk " << c << endl;
+				return false;
+			}
+		}
+	}
+	if (pos != chunk.size()) {
+		cerr << "Corrupt cache chunk " << c << endl;
+		return false;
+	}
+	loadedChunk = c;
+	return true;
+}
+
+bool SimCacheReader::readFrame(uint64_t i, SimCacheFrame &frame)
+{
+	if (i >= frameCount) {
+		return false;
+	}
+	auto it = upper_bound(chunks.begin(), chunks.end(), i, [](uint64_t frame, const ChunkEntry &entry) {
+		return frame < entry.firstFrame;
+	});
+	size_t c = size_t(it - chunks.begin()) - 1;
+	if (c != loadedChunk && !loadChunk(c)) {
+		return false;
+	}
+
+	size_t nBodies = particleCounts.size();
+	uint64_t f = i - chunks[c].firstFrame;
+	const char *p = &chunk[frameOffsets[f]];
+	frame.step = load<uint64_t>(p);
+	frame.t = load<double>(p + sizeof(uint64_t));
+	p += sizeof(uint64_t) + sizeof(double);
+	frame.positions.resize(nBodies);
+	frame.elements.resize(nBodies);
+	frame.elementsChanged.resize(nBodies);
+	for (size_t b = 0; b < nBodies; b++) {
+		vector<float> &pos = frame.positions[b];
+		pos.resize(size_t(particleCounts[b]) * 3);
+		memcpy(pos.data(), p, pos.size() * sizeof(float));
+		p += pos.size() * sizeof(float);
+		p += sizeof(int32_t) + max(0, load<int32_t>(p)) * sizeof(unsigned int);
+
+		size_t offset = elementOffsets[f * nBodies + b];
+		int32_t count = load<int32_t>(&chunk[offset]);
+		vector<unsigned int> &ele = frame.elements[b];
+		ele.resize(count);
+		memcpy(ele.data(), &chunk[offset + sizeof(int32_t)], ele.size() * sizeof(unsigned int));
+		frame.elementsChanged[b] = f == 0 || offset != elementOffsets[(f - 1) * nBodies + b];
+	}
+	return true;
+}
@@ -0,0 +1,156 @@
+#pragma once
+#ifndef SimCache_H
+#define SimCache_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <fstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstdint>
+
+class Scene;
+
+/**
+ * One cached frame: the state of every body after a step, cloths first,
+ * then soft bodies, in load order. Positions are packed xyz floats and
+ * elements are the triangle index lists with broken triangles left out,
+ * as in RenderSnapshot.
+ */
+struct SimCacheFrame
+{
+	uint64_t step;
+	double t;
+	std::vector< std::vector<float> > positions;
+	std::vector< std::vector<unsigned int> > elements;
+	// Writer side: elements are only copied when the body's ElementList
+	// changed since the previous captured frame
+	std::vector<char> elementsChanged;
+};
+
+/**
+ * Appends frames of a running Scene to a chunked cache file for offline
+ * inspection. capture() only copies the bodies into a free frame buffer;
+ * a background thread encodes and writes them, so the disk never stalls
+ * the stepping thread. If all queueFrames buffers are still waiting for
+ * the disk, the frame is dropped and counted instead.
+ *
+ * File layout: a header with the body sizes, then chunks of up to
+ * chunkFrames frames, then an index of the chunks for random seek. An
+ * element list is only stored when it changed, except that every chunk
+ * starts with all of them, so each chunk decodes on its own.
+ */
+class SimCacheWriter
+{
+public:
+	SimCacheWriter();
+	virtual ~SimCacheWriter();
+
+	// Every interval-th capture() is kept. Returns false and prints an
+	// error if the file cannot be created.
+	bool open(const std::string &path, const Scene &scene, int interval = 1, int chunkFrames = 64, int queueFrames = 16);
+	// Call after each Scene::step, from the thread that steps the scene
+	void capture(const Scene &scene);
+	// Writes the queued frames and the chunk index. False if a write failed.
+	bool close();
+	bool isOpen() const { return writer.joinable(); }
+
+	// Frames captured so far, including queued ones
+	uint64_t getFrameCount() const { return frames; }
+	uint64_t getDroppedFrames() const { return dropped; }
+
+private:
+	struct ChunkEntry
+	{
+		uint64_t offset;
+		uint64_t size;
+		uint64_t firstFrame;
+		uint64_t nFrames;
+	};
+
+	void writerLoop();
+	void encode(const SimCacheFrame &frame);
+	void flushChunk();
+
+	std::string path;
+	std::ofstream out;
+	int interval;
+	int chunkFrames;
+	uint64_t steps;
+	uint64_t frames;
+	uint64_t dropped;
+	std::vector<unsigned long> elementVersions; // per body, last captured
+
+	// Producer/writer hand-off. Frames cycle between the free list and the
+	// queue, so the buffers are only allocated while the first ones fill.
+	std::thread writer;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::vector< std::unique_ptr<SimCacheFrame> > freeFrames;
+	std::deque< std::unique_ptr<SimCacheFrame> > queue;
+	bool closing;
+	std::atomic<bool> failed;
+
+	// Writer thread only
+	std::vector<char> chunk;
+	uint64_t chunkFirstFrame;
+	uint64_t chunkFrameCount;
+	uint64_t writtenFrames;
+	std::vector< std::vector<unsigned int> > elements; // current, per body
+	std::vector<ChunkEntry> chunks;
+};
+
+/**
+ * Reads frames back from a SimCacheWriter file in any order. The chunk
+ * holding a frame is loaded once and kept, so stepping through frames in
+ * order reads each chunk from disk once.
+ */
+class SimCacheReader
+{
+public:
+	SimCacheReader();
+	virtual ~SimCacheReader();
+
+	// Returns false and prints an error if the file is not a complete cache
+	bool open(const std::string &path);
+	void close();
+
+	int getBodyCount() const { return (int)particleCounts.size(); }
+	int getParticleCount(int body) const { return particleCounts[body]; }
+	uint64_t getFrameCount() const { return frameCount; }
+	int getInterval() const { return interval; }
+	double getTimeStep() const { return h; }
+
+	bool readFrame(uint64_t i, SimCacheFrame &frame);
+
+private:
+	struct ChunkEntry
+	{
+		uint64_t offset;
+		uint64_t size;
+		uint64_t firstFrame;
+		uint64_t nFrames;
+	};
+
+	bool loadChunk(size_t c);
+
+	std::ifstream in;
+	std::vector<int> particleCounts;
+	int interval;
+	double h;
+	uint64_t frameCount;
+	std::vector<ChunkEntry> chunks;
+
+	// The loaded chunk, with the offset of each frame and of the element
+	// list in effect for each frame and body
+	size_t loadedChunk;
+	std::vector<char> chunk;
+	std::vector<size_t> frameOffsets;
+	std::vector<size_t> elementOffsets;
+};
+
+#endif
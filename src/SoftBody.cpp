@@ -1,4 +1,7 @@
 #include "SoftBody.h"
+#include "ThreadPool.h"
+#include "Checkpoint.h"
+#include "TetMesh.h"
 
 using namespace std;
 using namespace Eigen;
@@ -18,11 +21,9 @@ SoftBody::SoftBody(int rows, int cols, int tubes,
 	assert(damping >= 0.0);
 	assert(pradius >= 0.0);
 
-	this->rows = rows;
-	this->cols = cols;
-	this->tubes = tubes;
+	this->fusedCollision = true;
 
-	cells.resize(
+	vector< vector< vector<Hexa> > > cells(
 		rows - 1, 
 		vector< vector<Hexa>>(
 			cols - 1, 
@@ -34,6 +35,7 @@ SoftBody::SoftBody(int rows, int cols, int tubes,
 
 	int nVerts = rows * cols * tubes;
 	double particleM = mass / nVerts;
+	particles.reserve(nVerts);
 	for (int i = 0; i < rows; i++) {
 		double posGamma = double(i) / (rows - 1);
 		for (int j = 0; j < cols; j++) {
@@ -47,51 +49,22 @@ SoftBody::SoftBody(int rows, int cols, int tubes,
 					(1.0 - posAlpha) * x000.z() + posAlpha * x111.z()
 				);
 
-				auto p = make_shared<Particle>();
-				p->x = pos;
-				p->v = Vector3d::Zero();
-				p->p = pos;
-				p->x0 = pos;
-				p->v0 = Vector3d::Zero();
-				p->m = particleM;
-				p->r = pradius;
-				p->d = damping;
-
 				// necessary to anchor at times while friction is not yet implemented
-				if (false &&
+				bool fixed = false &&
 					(i == 0 || i == rows - 1) && 
 					(j == 0 || j == cols - 1) && 
-					(k == 0 || k == tubes - 1)
-				) {
-					p->fixed = true;
-				}
-				else {
-					p->fixed = false;
-				}
+					(k == 0 || k == tubes - 1);
 				
-				particles.push_back(p);
+				particles.add(pos, particleM, pradius, damping, fixed);
 			}
 		}
 	}
 
-	unordered_map<int64_t, shared_ptr<Spring>> springMap;
-	auto makeKey = [&](int particleIndex0, int particleIndex1) {
-		if (particleIndex0 > particleIndex1) {
-			swap(particleIndex0, particleIndex1);
-		}
-		return (int64_t(particleIndex0) << 32) | int64_t(int32_t(particleIndex1));
-	};
 	auto addSpring = [&](int particleIndex0, int particleIndex1, double springAlpha) {
-		shared_ptr<Spring> spring = make_shared<Spring>(
-			particles[particleIndex0],
-			particles[particleIndex1],
-			springAlpha
-		);
-		springMap[makeKey(particleIndex0, particleIndex1)] = spring;
-		springs.push_back(spring);
+		constraints.addSpring(particles, particleIndex0, particleIndex1, springAlpha);
 	};
 	auto getSpring = [&](int particleIndex0, int particleIndex1) {
-		return springMap[makeKey(particleIndex0, particleIndex1)];
+		return constraints.findSpring(particleIndex0, particleIndex1);
 	};
 
 	for (int i = 0; i < rows - 1; i++) {
@@ -167,15 +140,6 @@ SoftBody::SoftBody(int rows, int cols, int tubes,
 				H.quads[5].tris[1].index0 = f;
 				H.quads[5].tris[1].index1 = b;
 				H.quads[5].tris[1].index2 = e;
-
-				for (int q = 0; q < 6; q++) {
-					for (int t = 0; t < 2; t++) {
-						Tri &T = H.quads[q].tris[t];
-						T.vertexParticles[0] = particles[T.index0];
-						T.vertexParticles[1] = particles[T.index1];
-						T.vertexParticles[2] = particles[T.index2];
-					}
-				}
 			}
 		}
 	}
@@ -264,6 +228,9 @@ SoftBody::SoftBody(int rows, int cols, int tubes,
 		}
 	}
 
+	// Volumes look up their edge springs, so the springs must be sorted first
+	constraints.sort();
+
 	for (int i = 0; i < rows - 1; i++) {
 		for (int j = 0; j < cols - 1; j++) {
 			for (int k = 0; k < tubes - 1; k++) {
@@ -277,79 +244,22 @@ SoftBody::SoftBody(int rows, int cols, int tubes,
 				int h = i * cols * tubes + (j + 1) * tubes + (k + 1);
 
 				// tetra at a
-				volumes.push_back(std::make_shared<Volume>(
-					particles[a],
-					particles[b],
-					particles[d],
-					particles[e],
-					0.0,
-					getSpring(a, b),
-					getSpring(a, d),
-					getSpring(a, e),
-					getSpring(b, d),
-					getSpring(b, e),
-					getSpring(d, e)
-				));
+				constraints.addVolume(particles, a, b, d, e, 0.0);
 				// tetra at c
-				volumes.push_back(std::make_shared<Volume>(
-					particles[c],
-					particles[b],
-					particles[g],
-					particles[d],
-					0.0,
-					getSpring(c, b),
-					getSpring(c, g),
-					getSpring(c, d),
-					getSpring(b, g),
-					getSpring(b, d),
-					getSpring(g, d)
-				));
+				constraints.addVolume(particles, c, b, g, d, 0.0);
 				// tetra at f
-				volumes.push_back(std::make_shared<Volume>(
-					particles[f],
-					particles[b],
-					particles[e],
-					particles[g],
-					0.0,
-					getSpring(f, b),
-					getSpring(f, e),
-					getSpring(f, g),
-					getSpring(b, e),
-					getSpring(b, g),
-					getSpring(e, g)
-				));
+				constraints.addVolume(particles, f, b, e, g, 0.0);
 				// tetra at h
-				volumes.push_back(std::make_shared<Volume>(
-					particles[h],
-					particles[d],
-					particles[g],
-					particles[e],
-					0.0,
-					getSpring(h, d),
-					getSpring(h, g),
-					getSpring(h, e),
-					getSpring(d, g),
-					getSpring(d, e),
-					getSpring(g, e)
-				));
+				constraints.addVolume(particles, h, d, g, e, 0.0);
 				// center tetra
-				volumes.push_back(std::make_shared<Volume>(
-					particles[b],
-					particles[d],
-					particles[e],
-					particles[g],
-					0.0,
-					getSpring(b, d),
-					getSpring(b, e),
-					getSpring(b, g),
-					getSpring(d, e),
-					getSpring(d, g),
-					getSpring(e, g)
-				));
+				constraints.addVolume(particles, b, d, e, g, 0.0);
 			}
 		}
 	}
 
+	constraints.sort();
+	constraints.color(nVerts);
+
 	for (int i = 0; i < rows - 1; i++) {
 		for (int j = 0; j < cols - 1; j++) {
 			for (int k = 0; k < tubes - 1; k++) {
@@ -427,14 +337,41 @@ SoftBody::SoftBody(int rows, int cols, int tubes,
 		}
 	}
 
-	posBuf.clear();
-	norBuf.clear();
+	// Hexa faces: 0 abcd (k), 1 bfgc (i + 1), 2 ehgf (k + 1), 3 adhe (i),
+	// 4 cghd (j + 1), 5 aefb (j)
+	static const int di[6] = { 0, 1, 0, -1, 0, 0 };
+	static const int dj[6] = { 0, 0, 0, 0, 1, -1 };
+	static const int dk[6] = { -1, 0, 1, 0, 0, 0 };
+	static const int opposite[6] = { 2, 3, 0, 1, 5, 4 };
+	facesPerCell = 6;
+	trisPerFace = 2;
+	int nCells = (rows - 1) * (cols - 1) * (tubes - 1);
+	tris.reserve(nCells * 12);
+	faceNeighbor.reserve(nCells * 6);
+	for (int i = 0; i < rows - 1; i++) {
+		for (int j = 0; j < cols - 1; j++) {
+			for (int k = 0; k < tubes - 1; k++) {
+				for (int q = 0; q < 6; q++) {
+					tris.push_back(cells[i][j][k].quads[q].tris[0]);
+					tris.push_back(cells[i][j][k].quads[q].tris[1]);
+					int ni = i + di[q];
+					int nj = j + dj[q];
+					int nk = k + dk[q];
+					if (ni < 0 || ni >= rows - 1 || nj < 0 || nj >= cols - 1 || nk < 0 || nk >= tubes - 1) {
+						faceNeighbor.push_back(-1);
+					}
+					else {
+						faceNeighbor.push_back(((ni * (cols - 1) + nj) * (tubes - 1) + nk) * 6 + opposite[q]);
+					}
+				}
+			}
+		}
+	}
+
+	buildSurface();
+
 	texBuf.clear();
-	eleBuf.clear();
-	posBuf.resize(nVerts * 3);
-	norBuf.resize(nVerts * 3);
-	updatePosNor();
-	updateEle();
+	publish();
 
 	// Texture coordinates (placeholder, may be implemented later)
 	for (int i = 0; i < rows; i++) {
@@ -448,66 +385,299 @@ SoftBody::SoftBody(int rows, int cols, int tubes,
 
 }
 
+SoftBody::SoftBody(const TetMesh &mesh,
+	double mass,
+	double alpha,
+	double damping,
+	double pradius) {
+	assert(!mesh.tets.empty());
+	assert(mass > 0.0);
+	assert(alpha >= 0.0);
+	assert(damping >= 0.0);
+	assert(pradius >= 0.0);
+
+	this->fusedCollision = true;
+
+	int nVerts = int(mesh.nodes.size());
+	int nTets = int(mesh.tets.size() / 4);
+	double particleM = mass / nVerts;
+	particles.reserve(nVerts);
+	for (const Vector3d &x : mesh.nodes) {
+		particles.add(x, particleM, pradius, damping, false);
+	}
+
+	// Unique tetrahedron edges as the sorted higher neighbors of each node
+	// (CSR). Springs are added in this order, which is already the order
+	// sort() puts them in, so edge k of the CSR is spring k.
+	static const int tetEdges[6][2] = { { 0, 1 }, { 0, 2 }, { 0, 3 }, { 1, 2 }, { 1, 3 }, { 2, 3 } };
+	vector<int> edgeStart(nVerts + 1, 0);
+	vector<int> edgeEnd(mesh.tets.size() / 4 * 6);
+	for (int t = 0; t < nTets; t++) {
+		const int *v = &mesh.tets[size_t(t) * 4];
+		for (int e = 0; e < 6; e++) {
+			edgeStart[min(v[tetEdges[e][0]], v[tetEdges[e][1]]) + 1]++;
+		}
+	}
+	for (int i = 0; i < nVerts; i++) {
+		edgeStart[i + 1] += edgeStart[i];
+	}
+	{
+		vector<int> fill(edgeStart.begin(), edgeStart.end() - 1);
+		for (int t = 0; t < nTets; t++) {
+			const int *v = &mesh.tets[size_t(t) * 4];
+			for (int e = 0; e < 6; e++) {
+				int i0 = v[tetEdges[e][0]];
+				int i1 = v[tetEdges[e][1]];
+				edgeEnd[fill[min(i0, i1)]++] = max(i0, i1);
+			}
+		}
+	}
+	int nEdges = 0;
+	for (int i = 0; i < nVerts; i++) {
+		int begin = edgeStart[i];
+		int end = edgeStart[i + 1];
+		sort(edgeEnd.begin() + begin, edgeEnd.begin() + end);
+		edgeStart[i] = nEdges;
+		for (int k = begin; k < end; k++) {
+			if (k == begin || edgeEnd[k] != edgeEnd[k - 1]) {
+				edgeEnd[nEdges++] = edgeEnd[k];
+				constraints.addSpring(particles, i, edgeEnd[k], alpha);
+			}
+		}
+	}
+	edgeStart[nVerts] = nEdges;
+	auto getSpring = [&](int i0, int i1) {
+		if (i0 > i1) {
+			swap(i0, i1);
+		}
+		return int(lower_bound(edgeEnd.begin() + edgeStart[i0], edgeEnd.begin() + edgeStart[i0 + 1], i1) - edgeEnd.begin());
+	};
+
+	for (int t = 0; t < nTets; t++) {
+		const int *v = &mesh.tets[size_t(t) * 4];
+		int edgeSprings[6];
+		for (int e = 0; e < 6; e++) {
+			edgeSprings[e] = getSpring(v[tetEdges[e][0]], v[tetEdges[e][1]]);
+		}
+		constraints.addVolume(particles, v, edgeSprings, 0.0);
+	}
+	constraints.sort();
+	constraints.color(nVerts);
+
+	// Face q of a tetrahedron is the one opposite its corner q, wound so
+	// that its normal points away from that corner
+	facesPerCell = 4;
+	trisPerFace = 1;
+	tris.resize(size_t(nTets) * 4);
+	for (int t = 0; t < nTets; t++) {
+		const int *v = &mesh.tets[size_t(t) * 4];
+		for (int q = 0; q < 4; q++) {
+			Tri &T = tris[t * 4 + q];
+			T.index0 = v[(q + 1) % 4];
+			T.index1 = v[(q + 2) % 4];
+			T.index2 = v[(q + 3) % 4];
+			const Vector3d &x0 = mesh.nodes[T.index0];
+			Vector3d normal = (mesh.nodes[T.index1] - x0).cross(mesh.nodes[T.index2] - x0);
+			if (normal.dot(mesh.nodes[v[q]] - x0) > 0.0) {
+				swap(T.index1, T.index2);
+			}
+			T.edgeSprings[0] = getSpring(T.index0, T.index1);
+			T.edgeSprings[1] = getSpring(T.index0, T.index2);
+			T.edgeSprings[2] = getSpring(T.index1, T.index2);
+		}
+	}
+	edgeStart = vector<int>();
+	edgeEnd = vector<int>();
+
+	// Two tetrahedra are neighbors if they share a face. Faces are bucketed
+	// by their lowest corner and matched on the other two within a bucket.
+	struct FaceKey {
+		int v1, v2;
+		int face;
+		bool operator<(const FaceKey &o) const { return v1 != o.v1 ? v1 < o.v1 : v2 < o.v2; }
+		bool sameAs(const FaceKey &o) const { return v1 == o.v1 && v2 == o.v2; }
+	};
+	vector<int> faceStart(nVerts + 1, 0);
+	for (const Tri &T : tris) {
+		faceStart[min(T.index0, min(T.index1, T.index2)) + 1]++;
+	}
+	for (int i = 0; i < nVerts; i++) {
+		faceStart[i + 1] += faceStart[i];
+	}
+	vector<FaceKey> keys(tris.size());
+	{
+		vector<int> fill(faceStart.begin(), faceStart.end() - 1);
+		for (size_t face = 0; face < tris.size(); face++) {
+			int v[3] = { tris[face].index0, tris[face].index1, tris[face].index2 };
+			sort(v, v + 3);
+			keys[fill[v[0]]++] = { v[1], v[2], int(face) };
+		}
+	}
+	faceNeighbor.assign(tris.size(), -1);
+	for (int i = 0; i < nVerts; i++) {
+		sort(keys.begin() + faceStart[i], keys.begin() + faceStart[i + 1]);
+		for (int k = faceStart[i]; k < faceStart[i + 1]; ) {
+			int run = k + 1;
+			while (run < faceStart[i + 1] && keys[k].sameAs(keys[run])) {
+				run++;
+			}
+			// A face shared by more than two tetrahedra is left on the surface
+			if (run - k == 2) {
+				faceNeighbor[keys[k].face] = keys[k + 1].face;
+				faceNeighbor[keys[k + 1].face] = keys[k].face;
+			}
+			k = run;
+		}
+	}
+
+	buildSurface();
+
+	texBuf.clear();
+	publish();
+
+	// Texture coordinates (placeholder): x and y across the bounding box
+	Vector3d lo = mesh.nodes[0];
+	Vector3d hi = mesh.nodes[0];
+	for (const Vector3d &x : mesh.nodes) {
+		lo = lo.cwiseMin(x);
+		hi = hi.cwiseMax(x);
+	}
+	Vector3d extent = (hi - lo).cwiseMax(Vector3d::Constant(1e-12));
+	texBuf.reserve(nVerts * 2);
+	for (const Vector3d &x : mesh.nodes) {
+		texBuf.push_back(float((x(0) - lo(0)) / extent(0)));
+		texBuf.push_back(float((x(1) - lo(1)) / extent(1)));
+	}
+}
+
 SoftBody::~SoftBody() {}
 
+void SoftBody::setThreadPool(shared_ptr<ThreadPool> pool) {
+	threadPool = pool;
+}
+
 void SoftBody::tare() {
-	for (auto p : particles) {
-		p->tare();
-	}
+	particles.tare();
 }
 
 void SoftBody::reset() {
-	for (auto p : particles) {
-		p->reset();
+	particles.reset();
+}
+
+void SoftBody::addSurfaceFace(int face) {
+	if (onSurface[face]) {
+		return;
+	}
+	onSurface[face] = 1;
+	surface.push_back(face);
+	for (int t = 0; t < trisPerFace; t++) {
+		const Tri &T = tris[face * trisPerFace + t];
+		if (!T.broken) {
+			elements.insert(face * trisPerFace + t, T.index0, T.index1, T.index2);
+		}
+	}
+}
+
+void SoftBody::buildSurface() {
+	int nFaces = int(faceNeighbor.size());
+	cellOpen.assign(nFaces / facesPerCell, 0);
+	onSurface.assign(nFaces, 0);
+	surface.clear();
+
+	springTris.build(constraints.numSprings(), int(tris.size()), [&](int tri, int e) {
+		return tris[tri].edgeSprings[e];
+	});
+	elements.reset(int(tris.size()));
+
+	// Faces on the outside of the body
+	for (int face = 0; face < nFaces; face++) {
+		if (faceNeighbor[face] < 0) {
+			addSurfaceFace(face);
+		}
+	}
+	applyFractures();
+}
+
+// Breaks the triangles on newly broken springs and opens their cells
+void SoftBody::applyFractures() {
+	const vector<uint32_t> &fractures = constraints.getFractures();
+	int trisPerCell = facesPerCell * trisPerFace;
+	for (uint32_t s : fractures) {
+		springTris.forEach(s, [&](int tri) {
+			tris[tri].broken = true;
+			elements.erase(tri);
+		});
+	}
+	for (uint32_t s : fractures) {
+		springTris.forEach(s, [&](int tri) {
+			openCell(tri / trisPerCell);
+		});
+	}
+	constraints.clearFractures();
+}
+
+// A cell with a broken face no longer hides its neighbors' faces
+void SoftBody::openCell(int cell) {
+	if (cellOpen[cell]) {
+		return;
+	}
+	cellOpen[cell] = 1;
+	for (int q = 0; q < facesPerCell; q++) {
+		int n = faceNeighbor[cell * facesPerCell + q];
+		if (n >= 0) {
+			addSurfaceFace(n);
+		}
 	}
 }
 
+void SoftBody::publish() {
+	updatePosNor();
+	updateEle();
+	snapshots.publish();
+}
+
 void SoftBody::updatePosNor() {
+	RenderSnapshot &snapshot = snapshots.writeBuffer();
+	vector<float> &posBuf = snapshot.posBuf;
+	vector<float> &norBuf = snapshot.norBuf;
+	posBuf.resize(particles.size() * 3);
+	norBuf.resize(particles.size() * 3);
+
 	// Position
-	for (int i = 0; i < rows; i++) {
-		for (int j = 0; j < cols; j++) {
-			for (int k = 0; k < tubes; k++) {
-				int index = i * cols * tubes + j * tubes + k;
-				Vector3d x = particles[index]->x;
-				posBuf[3 * index + 0] = float(x(0));
-				posBuf[3 * index + 1] = float(x(1));
-				posBuf[3 * index + 2] = float(x(2));
-			}
-		}
+	int n = particles.size();
+	for (int index = 0; index < n; index++) {
+		const Vector3d &x = particles.x[index];
+		posBuf[3 * index + 0] = float(x(0));
+		posBuf[3 * index + 1] = float(x(1));
+		posBuf[3 * index + 2] = float(x(2));
 	}
 
 	// Normal
 	// Need to work on this later
-	vector<Vector3d> normalAccumulator(rows * cols * tubes, Vector3d::Zero());
-	for (int i = 0; i < rows - 1; i++) {
-		for (int j = 0; j < cols - 1; j++) {
-			for (int k = 0; k < tubes - 1; k++) {
-				Hexa &H = cells[i][j][k];
-				for (int q = 0; q < 6; q++) {
-					for (int t = 0; t < 2; t++) {
-						Tri &T = H.quads[q].tris[t];
+	vector<Vector3d> normalAccumulator(n, Vector3d::Zero());
+	for (int face : surface) {
+		for (int t = 0; t < trisPerFace; t++) {
+			const Tri &T = tris[face * trisPerFace + t];
 
-						int i0 = T.index0;
-						int i1 = T.index1;
-						int i2 = T.index2;
+			int i0 = T.index0;
+			int i1 = T.index1;
+			int i2 = T.index2;
 
-						Vector3d &x0 = particles[i0]->x;
-						Vector3d &x1 = particles[i1]->x;
-						Vector3d &x2 = particles[i2]->x;
+			const Vector3d &x0 = particles.x[i0];
+			const Vector3d &x1 = particles.x[i1];
+			const Vector3d &x2 = particles.x[i2];
 
-						Vector3d triNormal = (x1 - x0).cross(x2 - x0);
+			Vector3d triNormal = (x1 - x0).cross(x2 - x0);
 
-						normalAccumulator[i0] += triNormal;
-						normalAccumulator[i1] += triNormal;
-						normalAccumulator[i2] += triNormal;
-					}
-				}
-			}
+			normalAccumulator[i0] += triNormal;
+			normalAccumulator[i1] += triNormal;
+			normalAccumulator[i2] += triNormal;
 		}
 	}
 
-	for (int i = 0; i < rows * cols * tubes; i++) {
-		Vector3d n = normalAccumulator[i].normalized();
+	for (int i = 0; i < n; i++) {
+		// Interior particles are not drawn and keep a zero normal
+		Vector3d n = normalAccumulator[i].stableNormalized();
 
 		norBuf[3 * i + 0] = float(n.x());
 		norBuf[3 * i + 1] = float(n.y());
@@ -516,23 +686,22 @@ void SoftBody::updatePosNor() {
 }
 
 void SoftBody::updateEle() {
-	eleBuf.clear();
+	// Only copies when the surface or a fracture changed the elements
+	RenderSnapshot &snapshot = snapshots.writeBuffer();
+	elements.copyTo(snapshot.eleBuf, snapshot.eleVersion);
+}
 
-	for (int i = 0; i < rows - 1; i++) {
-		for (int j = 0; j < cols - 1; j++) {
-			for (int k = 0; k < tubes - 1; k++) {
-				for (int quadIndex = 0; quadIndex < 6; quadIndex++) {
-					for (int triIndex = 0; triIndex < 2; triIndex++) {
-						if (!cells[i][j][k].quads[quadIndex].tris[triIndex].getBroken()) {
-							eleBuf.push_back(cells[i][j][k].quads[quadIndex].tris[triIndex].index0);
-							eleBuf.push_back(cells[i][j][k].quads[quadIndex].tris[triIndex].index1);
-							eleBuf.push_back(cells[i][j][k].quads[quadIndex].tris[triIndex].index2);
-						}
-					}
-				}
-			}
-		}
+void SoftBody::save(CheckpointWriter &out) const {
+	particles.save(out);
+	constraints.save(out);
+}
+
+bool SoftBody::load(CheckpointReader &in) {
+	if (!particles.load(in) || !constraints.load(in)) {
+		return false;
 	}
+	applyFractures();
+	return true;
 }
 
 void SoftBody::step(
@@ -542,277 +711,102 @@ void SoftBody::step(
 	const std::vector< std::shared_ptr<Particle> > spheres,
 	const std::vector< std::shared_ptr<Plane> > planes,
 	const std::vector< std::shared_ptr<Cylinder> > cylinders,
-	const std::vector< std::shared_ptr<Tetrahedron> > tetrahedrons
+	const std::vector< std::shared_ptr<Tetrahedron> > tetrahedrons,
+	const std::vector< std::shared_ptr<ConvexPolytope> > polytopes
 ) {
+	STEP_TIMER_BEGIN(stats);
 
+	// Only exposed faces catch the wind
 	vector<Vector3d> windForces(particles.size(), Vector3d::Zero());
-	for (int i = 0; i < rows - 1; i++) {
-		for (int j = 0; j < cols - 1; j++) {
-			for (int k = 0; k < tubes - 1; k++) {
-				const Hexa &H = cells[i][j][k];
-				for (int q = 0; q < 6; q++) {
-					const Quad &Q = H.quads[q];
-					for (int t = 0; t < 2; t++) {
-						const Tri &T = Q.tris[t];
-
-						Vector3d &x0 = particles[T.index0]->x;
-						Vector3d &x1 = particles[T.index1]->x;
-						Vector3d &x2 = particles[T.index2]->x;
-
-						Vector3d normal = (x1 - x0).cross(x2 - x0);
-						double area = normal.norm();
-						normal.normalize();
-						double pressure = normal.dot(wind);
-						Vector3d triForce = normal * (pressure * area);
-
-						windForces[T.index0] += triForce / 3.0;
-						windForces[T.index1] += triForce / 3.0;
-						windForces[T.index2] += triForce / 3.0;
-					}
-				}
-			}
+	for (int face : surface) {
+		for (int t = 0; t < trisPerFace; t++) {
+			const Tri &T = tris[face * trisPerFace + t];
+
+			const Vector3d &x0 = particles.x[T.index0];
+			const Vector3d &x1 = particles.x[T.index1];
+			const Vector3d &x2 = particles.x[T.index2];
+
+			Vector3d normal = (x1 - x0).cross(x2 - x0);
+			double area = normal.norm();
+			normal.normalize();
+			double pressure = normal.dot(wind);
+			Vector3d triForce = normal * (pressure * area);
+
+			windForces[T.index0] += triForce / 3.0;
+			windForces[T.index1] += triForce / 3.0;
+			windForces[T.index2] += triForce / 3.0;
 		}
 	}
-
-	for (int i = 0; i < particles.size(); i++) {
-		shared_ptr<Particle> particle = particles.at(i);
-		if (particle->fixed) {
-			particle->v = particle->v0;
+	STEP_TIMER_LAP(PHASE_WIND);
+
+	int n = particles.size();
+	vector<Vector3d> &X = particles.x;
+	// Bounds of the particles that can collide, for the broadphase
+	Aabb bounds;
+	double maxRadius = 0.0;
+	for (int i = 0; i < n; i++) {
+		if (particles.fixed[i]) {
+			particles.v[i] = particles.v0[i];
 			continue;
 		}
 
-		Vector3d particleForce = particle->m * grav 
-			- particle->d * particle->v 
-			+ windForces[i];
-		particle->v += (h / particle->m) * particleForce;
-		particle->p = particle->x;
-		particle->x += h * particle->v;
+		// a = g + (wind - d v) / m
+		Vector3d &v = particles.v[i];
+		v += h * (grav + particles.w[i] * (windForces[i] - particles.d[i] * v));
+		particles.p[i] = X[i];
+		X[i] += h * v;
+		bounds.grow(X[i]);
+		maxRadius = max(maxRadius, particles.r[i]);
 	}
+	STEP_TIMER_LAP(PHASE_INTEGRATE);
 
 	for (int i = 0; i < 10; i++) {
-		for (shared_ptr<Spring> spring : springs) {
-			if (spring->broken) {
-				continue;
-			}
-			Vector3d deltax = spring->p1->x - spring->p0->x;
-			double l = deltax.norm();
-			
-			if (l >= spring->L * 2.5) {
-				spring->broken = true;
-				continue;
-			}
-			
-			double C = l - spring->L;
-			Vector3d deltaC0 = -deltax / l;
-			Vector3d deltaC1 = deltax / l;
-
-			double w0 = 1.0 / spring->p0->m;
-			double w1 = 1.0 / spring->p1->m;
-			double lambda = -C / (w0 + w1 + spring->alpha / (h * h));
-
-			if (!spring->p0->fixed) {
-				spring->p0->x += lambda * w0 * deltaC0;
-			}
-			if (!spring->p1->fixed) {
-				spring->p1->x += lambda * w1 * deltaC1;
-			}
-		}
+		constraints.projectSprings(particles, h, threadPool.get());
 	}
+	STEP_TIMER_LAP(PHASE_SPRINGS);
 
-	for (shared_ptr<Volume> volume : volumes) {
-		if (volume->getBroken()) {
-			continue;
-		}
-		shared_ptr<Particle> p0 = volume->p0;
-		shared_ptr<Particle> p1 = volume->p1;
-		shared_ptr<Particle> p2 = volume->p2;
-		shared_ptr<Particle> p3 = volume->p3;
-
-		double volumeCurrent = (1.0 / 6.0) * ((p1->x - p0->x).cross(p2->x - p0->x)).dot(p3->x - p0->x);
-		double C = 6.0 * (volumeCurrent - volume->volume0);
-
-		Vector3d deltaC0 = (p3->x - p1->x).cross(p2->x - p1->x);
-		Vector3d deltaC1 = (p2->x - p0->x).cross(p3->x - p0->x);
-		Vector3d deltaC2 = (p3->x - p0->x).cross(p1->x - p0->x);
-		Vector3d deltaC3 = (p1->x - p0->x).cross(p2->x - p0->x);
-
-		double w0 = 1.0 / p0->m;
-		double w1 = 1.0 / p1->m;
-		double w2 = 1.0 / p2->m;
-		double w3 = 1.0 / p3->m;
-		
-		double lambda = -C / 
-			(w0 * deltaC0.squaredNorm() + 
-				w1 * deltaC1.squaredNorm() + 
-				w2 * deltaC2.squaredNorm() + 
-				w3 * deltaC3.squaredNorm() + 
-				volume->alpha / (h * h));
-
-		if (!p0->fixed) {
-			p0->x += lambda * w0 * deltaC0;
-		}
-		if (!p1->fixed) {
-			p1->x += lambda * w1 * deltaC1;
-		}
-		if (!p2->fixed) {
-			p2->x += lambda * w2 * deltaC2;
-		}
-		if (!p3->fixed) {
-			p3->x += lambda * w3 * deltaC3;
-		}
-	}
+	constraints.projectVolumes(particles, h, threadPool.get());
+	STEP_TIMER_LAP(PHASE_VOLUMES);
 
-	for (shared_ptr<Particle> sphere : spheres) {
-		for (shared_ptr<Particle> particle : particles) {
-			if (particle->fixed) {
-				continue;
-			}
+	broadphase.build(bounds, maxRadius, spheres, planes, cylinders, tetrahedrons, polytopes);
+	STEP_TIMER_LAP(PHASE_BROADPHASE);
 
-			if ((particle->x - sphere->x).norm() < particle->r + sphere->r) {
-				particle->x = (sphere->r + particle->r) * (particle->x - sphere->x).normalized() + sphere->x;
-			}
-		}
+	if (fusedCollision) {
+		colliders.build(broadphase.getSpheres(), broadphase.getPlanes(), broadphase.getCylinders(),
+			broadphase.getTetrahedrons(), broadphase.getPolytopes());
+		CollisionKernels::collide(particles, colliders);
+		STEP_TIMER_LAP(PHASE_COLLIDERS);
 	}
-
-	for (shared_ptr<Plane> plane : planes) {
-		for (shared_ptr<Particle> particle : particles) {
-			if (particle->fixed) {
-				continue;
-			}
-
-			double distance = (particle->x - plane->x).dot(plane->n);
-			if (distance < particle->r) {
-				particle->x = particle->x - plane->n * (distance - particle->r);
-			}
+	else {
+		for (shared_ptr<Particle> sphere : broadphase.getSpheres()) {
+			CollisionKernels::collide(particles, *sphere);
 		}
-	}
-
-	for (shared_ptr<Cylinder> cylinder : cylinders) {
-		for (shared_ptr<Particle> particle : particles) {
-			if (particle->fixed) {
-				continue;
-			}
-
-			double topDistance = (particle->x - (cylinder->x + cylinder->h * cylinder->axis)).dot(cylinder->axis) - particle->r;
-			double bottomDistance = (particle->x - cylinder->x).dot(-cylinder->axis) - particle->r;
-
-			Vector3d d = particle->x - cylinder->x;
-			d = d - (d.dot(cylinder->axis)) * cylinder->axis;
-			double radialDistance = d.norm() - cylinder->r - particle->r;
+		STEP_TIMER_LAP(PHASE_SPHERES);
 
-			if (topDistance < 0.0 && bottomDistance < 0.0 && radialDistance < 0.0) {
-				if (topDistance > bottomDistance && topDistance > radialDistance) {
-					// Move above cylinder
-					particle->x = particle->x - cylinder->axis * topDistance;
-				}
-				else if (bottomDistance > radialDistance) {
-					// Move below cylinder
-					particle->x = particle->x + cylinder->axis * bottomDistance;
-				}
-				else {
-					// Move beside cylinder
-					particle->x = particle->x - d.normalized() * radialDistance;
-				}
-			}
+		for (shared_ptr<Plane> plane : broadphase.getPlanes()) {
+			CollisionKernels::collide(particles, *plane);
 		}
-	}
+		STEP_TIMER_LAP(PHASE_PLANES);
 
-	for (shared_ptr<Tetrahedron> tetrahedron : tetrahedrons) {
-		std::array<Face, 4> faces = tetrahedron->getFaces();
-		for (shared_ptr<Particle> particle : particles) {
-			if (particle->fixed) {
-				continue;
-			}
+		for (shared_ptr<Cylinder> cylinder : broadphase.getCylinders()) {
+			CollisionKernels::collide(particles, *cylinder);
+		}
+		STEP_TIMER_LAP(PHASE_CYLINDERS);
 
-			double constexpr negInfinity = -std::numeric_limits<double>::infinity();
-			double maxDistance = negInfinity;
-			int maxDistanceIndex = -1;
-			for (int i = 0; i < faces.size(); i++) {
-				double distance = (particle->x - faces[i].x).dot(faces[i].n) - particle->r;
-				if (distance > maxDistance) {
-					maxDistance = distance;
-					maxDistanceIndex = i;
-				}
-			}
-			if (maxDistance < 0.0) {
-				particle->x = particle->x - maxDistance * faces[maxDistanceIndex].n;
-			}
+		for (shared_ptr<Tetrahedron> tetrahedron : broadphase.getTetrahedrons()) {
+			CollisionKernels::collide(particles, tetrahedron->getPolytope());
+		}
+		for (shared_ptr<ConvexPolytope> polytope : broadphase.getPolytopes()) {
+			CollisionKernels::collide(particles, *polytope);
 		}
+		STEP_TIMER_LAP(PHASE_POLYTOPES);
 	}
 
-	for (shared_ptr<Particle> particle : particles) {
-		particle->v = (1 / h) * (particle->x - particle->p);
+	for (int i = 0; i < n; i++) {
+		particles.v[i] = (1 / h) * (X[i] - particles.p[i]);
 	}
-}
-
-void SoftBody::init()
-{
-	glGenBuffers(1, &posBufID);
-	glBindBuffer(GL_ARRAY_BUFFER, posBufID);
-	glBufferData(GL_ARRAY_BUFFER, posBuf.size() * sizeof(float), &posBuf[0], GL_DYNAMIC_DRAW);
-
-	glGenBuffers(1, &norBufID);
-	glBindBuffer(GL_ARRAY_BUFFER, norBufID);
-	glBufferData(GL_ARRAY_BUFFER, norBuf.size() * sizeof(float), &norBuf[0], GL_DYNAMIC_DRAW);
-
-	glGenBuffers(1, &texBufID);
-	glBindBuffer(GL_ARRAY_BUFFER, texBufID);
-	glBufferData(GL_ARRAY_BUFFER, texBuf.size() * sizeof(float), &texBuf[0], GL_STATIC_DRAW);
-
-	glGenBuffers(1, &eleBufID);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, eleBufID);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, eleBuf.size() * sizeof(unsigned int), &eleBuf[0], GL_DYNAMIC_DRAW);
+	STEP_TIMER_LAP(PHASE_VELOCITY);
 
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-
-	assert(glGetError() == GL_NO_ERROR);
+	// Springs may have broken during projection
+	applyFractures();
 }
-
-void SoftBody::draw(shared_ptr<MatrixStack> M, const shared_ptr<Program> p) {
-	updatePosNor();
-	updateEle();
-
-	// Draw mesh
-	int kdFrontID = p->getUniform("kdFront");
-	if (kdFrontID != -1) {
-		glUniform3f(kdFrontID, 0.894f, 0.882f, 0.792f);
-	}
-	int kdBackID = p->getUniform("kdBack");
-	if (kdBackID != -1) {
-		glUniform3f(kdBackID, 0.776f, 0.843f, 0.835f);
-	}
-	M->pushMatrix();
-	glUniformMatrix4fv(p->getUniform("M"), 1, GL_FALSE, glm::value_ptr(M->topMatrix()));
-	int h_pos = p->getAttribute("aPos");
-	glEnableVertexAttribArray(h_pos);
-	glBindBuffer(GL_ARRAY_BUFFER, posBufID);
-	glBufferData(GL_ARRAY_BUFFER, posBuf.size() * sizeof(float), &posBuf[0], GL_DYNAMIC_DRAW);
-	glVertexAttribPointer(h_pos, 3, GL_FLOAT, GL_FALSE, 0, (const void *)0);
-	int h_nor = p->getAttribute("aNor");
-	if (h_nor >= 0) {
-		glEnableVertexAttribArray(h_nor);
-		glBindBuffer(GL_ARRAY_BUFFER, norBufID);
-		glBufferData(GL_ARRAY_BUFFER, norBuf.size() * sizeof(float), &norBuf[0], GL_DYNAMIC_DRAW);
-		glVertexAttribPointer(h_nor, 3, GL_FLOAT, GL_FALSE, 0, (const void *)0);
-	}
-	int h_tex = p->getAttribute("aTex");
-	if (h_tex >= 0) {
-		glEnableVertexAttribArray(h_tex);
-		glBindBuffer(GL_ARRAY_BUFFER, texBufID);
-		glVertexAttribPointer(h_tex, 2, GL_FLOAT, GL_FALSE, 0, (const void *)0);
-	}
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, eleBufID);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, eleBuf.size() * sizeof(unsigned int), &eleBuf[0], GL_DYNAMIC_DRAW);
-	glDrawElements(GL_TRIANGLES, eleBuf.size(), GL_UNSIGNED_INT, 0);
-	if (h_tex >= 0) {
-		glDisableVertexAttribArray(h_tex);
-	}
-	if (h_nor >= 0) {
-		glDisableVertexAttribArray(h_nor);
-	}
-	glDisableVertexAttribArray(h_pos);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-	M->popMatrix();
-}
\ No newline at end of file
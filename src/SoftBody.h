@@ -10,33 +10,61 @@
 #include <Eigen/Sparse>
 
 #include "Particle.h"
+#include "ParticleStore.h"
 #include "Plane.h"
 #include "Cylinder.h"
 #include "Tetrahedron.h"
-#include "Spring.h"
-#include "Volume.h"
+#include "ConvexPolytope.h"
+#include "ConstraintTable.h"
 #include "Tri.h"
+#include "ElementList.h"
+#include "StepStats.h"
+#include "TripleBuffer.h"
+#include "RenderSnapshot.h"
+#include "CollisionKernels.h"
+#include "Broadphase.h"
+
+class ThreadPool;
+class TetMesh;
+class CheckpointWriter;
+class CheckpointReader;
 
 class SoftBody {
 	EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 
-	int rows;
-	int cols;
-	int tubes;
+	void updatePosNor();
+	void updateEle();
+	void addSurfaceFace(int face);
+	void buildSurface();
+	void applyFractures();
+	void openCell(int cell);
+
+	ParticleStore particles;
+	ConstraintTable constraints;
+	std::shared_ptr<ThreadPool> threadPool;
+	bool fusedCollision;
+	Broadphase broadphase;
+	ColliderList colliders;
+	StepStats stats;
+
+	// Cells are hexas split into two triangles per face, or tetrahedra with
+	// one. Face q of a cell is cell * facesPerCell + q and triangle t of a
+	// face is face * trisPerFace + t.
+	int facesPerCell;
+	int trisPerFace;
+	std::vector<Tri> tris;
+	std::vector<int> faceNeighbor; // the same face seen from the cell behind it, or -1
 
-	std::vector< std::shared_ptr<Particle> > particles;
-	std::vector< std::shared_ptr<Spring> > springs;
-	std::vector< std::shared_ptr<Volume> > volumes;
-	std::vector< std::vector< std::vector<Hexa> > > cells;
+	// Boundary surface as cell faces. A face is exposed if there is no cell
+	// behind it or that cell has a broken face.
+	std::vector<int> surface;
+	std::vector<char> onSurface;
+	std::vector<char> cellOpen;
+	SpringTriIndex springTris;
+	ElementList elements; // unbroken triangles of the surface faces
 
-	std::vector<unsigned int> eleBuf;
-	std::vector<float> posBuf;
-	std::vector<float> norBuf;
+	TripleBuffer<RenderSnapshot> snapshots;
 	std::vector<float> texBuf;
-	unsigned eleBufID;
-	unsigned posBufID;
-	unsigned norBufID;
-	unsigned texBufID;
 public:
 	// TOOD: make constructor accept all 6 points
 	SoftBody(int rows, int cols, int tubes,
@@ -47,12 +75,28 @@ public:
 		double damping,
 		double pradius
 	);
+	// Arbitrary tetrahedral mesh. Every tetrahedron edge becomes a spring
+	// and every tetrahedron a volume constraint.
+	SoftBody(const TetMesh &mesh,
+		double mass,
+		double alpha,
+		double damping,
+		double pradius
+	);
 	virtual ~SoftBody();
 
+	void setThreadPool(std::shared_ptr<ThreadPool> pool);
+	// See Cloth::setFusedCollision
+	void setFusedCollision(bool enabled) { fusedCollision = enabled; }
+	void setBroadphase(bool enabled) { broadphase.setEnabled(enabled); }
+	const Broadphase &getBroadphase() const { return broadphase; }
 	void tare();
 	void reset();
-	void updatePosNor();
-	void updateEle();
+	// Sim thread: write positions, normals and elements for the renderer
+	void publish();
+	// See Cloth::save
+	void save(CheckpointWriter &out) const;
+	bool load(CheckpointReader &in);
 	void step(
 		double h,
 		const Eigen::Vector3d &grav,
@@ -60,11 +104,20 @@ public:
 		const std::vector< std::shared_ptr<Particle> > spheres,
 		const std::vector< std::shared_ptr<Plane> > planes,
 		const std::vector< std::shared_ptr<Cylinder> > cylinders,
-		const std::vector< std::shared_ptr<Tetrahedron> > tetrahedrons
+		const std::vector< std::shared_ptr<Tetrahedron> > tetrahedrons,
+		const std::vector< std::shared_ptr<ConvexPolytope> > polytopes
 	);
 
-	void init();
-	void draw(std::shared_ptr<MatrixStack> M, const std::shared_ptr<Program> p);
+	const ParticleStore &getParticles() const { return particles; }
+	// Exposed triangles as drawn, with broken ones left out
+	const ElementList &getElements() const { return elements; }
+	const StepStats &getStats() const { return stats; }
+	void clearStats() { stats.clear(); }
+	const std::vector<float> &getTexBuf() const { return texBuf; }
+	// Render thread: picks up the latest published snapshot, never blocks.
+	// Returns false if there was nothing new since the last call.
+	bool acquireSnapshot() { return snapshots.acquire(); }
+	const RenderSnapshot &getSnapshot() const { return snapshots.readBuffer(); }
 };
 
 
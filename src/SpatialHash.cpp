@@ -0,0 +1,114 @@
+#include <cassert>
+#include <algorithm>
+
+#include "SpatialHash.h"
+#include "ParticleStore.h"
+#include "ThreadPool.h"
+
+using namespace std;
+using namespace Eigen;
+
+SpatialHash::SpatialHash() :
+	invCellSize(1.0),
+	tableMask(0)
+{
+	cellStart.assign(2, 0);
+}
+
+SpatialHash::~SpatialHash()
+{
+}
+
+void SpatialHash::build(const vector<const ParticleStore *> &bodies, double cellSize, ThreadPool *pool)
+{
+	assert(cellSize > 0.0);
+	invCellSize = 1.0 / cellSize;
+
+	bodyStart.resize(bodies.size() + 1);
+	bodyStart[0] = 0;
+	for (size_t b = 0; b < bodies.size(); b++) {
+		bodyStart[b + 1] = bodyStart[b] + bodies[b]->size();
+	}
+	int n = bodyStart.back();
+	bodyOf.resize(n);
+	for (size_t b = 0; b < bodies.size(); b++) {
+		fill(bodyOf.begin() + bodyStart[b], bodyOf.begin() + bodyStart[b + 1], (int)b);
+	}
+
+	// About two buckets per particle keeps collisions between cells rare
+	uint32_t tableSize = 64;
+	while (tableSize < 2 * (uint32_t)n) {
+		tableSize *= 2;
+	}
+	tableMask = tableSize - 1;
+	cellOf.resize(n);
+	entries.resize(n);
+	cellStart.resize(tableSize + 1);
+
+	// Counting sort in fixed chunks: each chunk keeps its own histogram, so
+	// the chunks can be hashed and scattered in parallel while the result
+	// stays identical to a serial build. The histograms are interleaved per
+	// cell ([cell][chunk]), so clearing and scanning them is a contiguous
+	// pass that also splits over cell ranges.
+	int nChunks = pool ? min(pool->size(), max(1, n / 1024)) : 1;
+	int grain = max(1, (n + nChunks - 1) / nChunks);
+	chunkCounts.resize((size_t)tableSize * nChunks);
+	uint32_t rangeSize = (tableSize + nChunks - 1) / nChunks;
+	rangeTotals.assign(nChunks + 1, 0);
+
+	ThreadPool::parallelFor(pool, nChunks, [&](int begin, int end, int) {
+		for (int r = begin; r < end; r++) {
+			size_t first = (size_t)min(tableSize, r * rangeSize) * nChunks;
+			size_t last = (size_t)min(tableSize, (r + 1) * rangeSize) * nChunks;
+			fill(chunkCounts.begin() + first, chunkCounts.begin() + last, 0);
+		}
+	}, 1);
+
+	ThreadPool::parallelFor(pool, n, [&](int begin, int end, int) {
+		for (int g = begin; g < end; g++) {
+			int b = bodyOf[g];
+			const Vector3d &x = bodies[b]->x[g - bodyStart[b]];
+			uint32_t c = hashCell(cellCoord(x(0)), cellCoord(x(1)), cellCoord(x(2)));
+			cellOf[g] = c;
+			chunkCounts[(size_t)c * nChunks + g / grain]++;
+		}
+	}, grain);
+
+	// Exclusive scan: range totals, their prefix, then each range in turn
+	ThreadPool::parallelFor(pool, nChunks, [&](int begin, int end, int) {
+		for (int r = begin; r < end; r++) {
+			size_t first = (size_t)min(tableSize, r * rangeSize) * nChunks;
+			size_t last = (size_t)min(tableSize, (r + 1) * rangeSize) * nChunks;
+			int total = 0;
+			for (size_t k = first; k < last; k++) {
+				total += chunkCounts[k];
+			}
+			rangeTotals[r + 1] = total;
+		}
+	}, 1);
+	for (int r = 0; r < nChunks; r++) {
+		rangeTotals[r + 1] += rangeTotals[r];
+	}
+	ThreadPool::parallelFor(pool, nChunks, [&](int begin, int end, int) {
+		for (int r = begin; r < end; r++) {
+			int offset = rangeTotals[r];
+			uint32_t last = min(tableSize, (r + 1) * rangeSize);
+			for (uint32_t c = min(tableSize, r * rangeSize); c < last; c++) {
+				cellStart[c] = offset;
+				int *counts = &chunkCounts[(size_t)c * nChunks];
+				for (int k = 0; k < nChunks; k++) {
+					int chunkCount = counts[k];
+					counts[k] = offset;
+					offset += chunkCount;
+				}
+			}
+		}
+	}, 1);
+	cellStart[tableSize] = n;
+
+	ThreadPool::parallelFor(pool, n, [&](int begin, int end, int) {
+		for (int g = begin; g < end; g++) {
+			entries[chunkCounts[(size_t)cellOf[g] * nChunks + g / grain]++] = g;
+		}
+	}, grain);
+}
@@ -0,0 +1,82 @@
+#pragma once
+#ifndef SpatialHash_H
+#define SpatialHash_H
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#define EIGEN_DONT_ALIGN_STATICALLY
+#include <Eigen/Dense>
+
+class ParticleStore;
+class ThreadPool;
+
+/**
+ * Uniform grid hashed into a fixed-size table, rebuilt from scratch every
+ * step. Particles of several bodies are numbered globally (body offsets
+ * in registration order) and bucketed with a counting sort, so a build is
+ * O(n) and the bucket order does not depend on the number of threads.
+ */
+class SpatialHash
+{
+public:
+	SpatialHash();
+	virtual ~SpatialHash();
+
+	// Rebuilds the table from the current positions. The cell size should
+	// be at least the largest interaction distance.
+	void build(const std::vector<const ParticleStore *> &bodies, double cellSize, ThreadPool *pool = nullptr);
+
+	int size() const { return (int)bodyOf.size(); }
+	int body(int g) const { return bodyOf[g]; }
+	int local(int g) const { return g - bodyStart[bodyOf[g]]; }
+
+	// Calls fn(g) for every particle in the 27 cells around x. Cells that
+	// hash to the same bucket share its particles, so each bucket is
+	// visited once; fn still sees particles from unrelated cells.
+	template <typename F>
+	void query(const Eigen::Vector3d &x, F fn) const
+	{
+		int ix = cellCoord(x(0));
+		int iy = cellCoord(x(1));
+		int iz = cellCoord(x(2));
+		uint32_t visited[27];
+		int nVisited = 0;
+		for (int dx = -1; dx <= 1; dx++) {
+			for (int dy = -1; dy <= 1; dy++) {
+				for (int dz = -1; dz <= 1; dz++) {
+					uint32_t c = hashCell(ix + dx, iy + dy, iz + dz);
+					if (std::find(visited, visited + nVisited, c) != visited + nVisited) {
+						continue;
+					}
+					visited[nVisited++] = c;
+					for (int k = cellStart[c]; k < cellStart[c + 1]; k++) {
+						fn(entries[k]);
+					}
+				}
+			}
+		}
+	}
+
+private:
+	int cellCoord(double x) const { return (int)std::floor(x * invCellSize); }
+	uint32_t hashCell(int ix, int iy, int iz) const
+	{
+		uint32_t h = (uint32_t)ix * 73856093u ^ (uint32_t)iy * 19349663u ^ (uint32_t)iz * 83492791u;
+		return h & tableMask;
+	}
+
+	double invCellSize;
+	uint32_t tableMask;
+	std::vector<int> bodyStart;    // first global index of each body
+	std::vector<int> bodyOf;       // body of each global index
+	std::vector<uint32_t> cellOf;  // hashed cell of each global index
+	std::vector<int> cellStart;    // bucket offsets, table size + 1
+	std::vector<int> entries;      // global indices sorted by cell
+	std::vector<int> chunkCounts;  // per-chunk histograms, [cell][chunk]
+	std::vector<int> rangeTotals;  // prefix of the counts per cell range
+};
+
+#endif
@@ -2,21 +2,16 @@
 #ifndef Spring_H
 #define Spring_H
 
-#include <memory>
+#include <cstdint>
 
-class Particle;
-
-class Spring
+// Distance constraint between two particles of the same body. Stored by
+// value inside a ConstraintTable; the broken flag lives in the table's bitset.
+struct Spring
 {
-public:
-	Spring(std::shared_ptr<Particle> p0, std::shared_ptr<Particle> p1, double alpha);
-	virtual ~Spring();
-	
-	std::shared_ptr<Particle> p0;
-	std::shared_ptr<Particle> p1;
-	double L;
-	double alpha;
-	bool broken;
+	uint32_t i0; // particle index, always less than i1
+	uint32_t i1; // particle index
+	double L;     // rest length
+	double alpha; // compliance
 };
 
 #endif
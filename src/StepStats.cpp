@@ -0,0 +1,88 @@
+#include <iomanip>
+
+#include "StepStats.h"
+
+using namespace std;
+
+static const char *phaseNames[PHASE_COUNT] = {
+	"wind",
+	"integrate",
+	"springs",
+	"volumes",
+	"broadphase",
+	"spheres",
+	"planes",
+	"cylinders",
+	"polytopes",
+	"colliders",
+	"velocity",
+	"selfcollision"
+};
+
+void StepStats::clear()
+{
+	for (int i = 0; i < PHASE_COUNT; i++) {
+		seconds[i] = 0.0;
+	}
+	stepSeconds = 0.0;
+	steps = 0;
+}
+
+StepStats &StepStats::operator+=(const StepStats &o)
+{
+	for (int i = 0; i < PHASE_COUNT; i++) {
+		seconds[i] += o.seconds[i];
+	}
+	stepSeconds += o.stepSeconds;
+	steps += o.steps;
+	return *this;
+}
+
+StepStats StepStats::operator-(const StepStats &o) const
+{
+	StepStats d;
+	for (int i = 0; i < PHASE_COUNT; i++) {
+		d.seconds[i] = seconds[i] - o.seconds[i];
+	}
+	d.stepSeconds = stepSeconds - o.stepSeconds;
+	d.steps = steps - o.steps;
+	return d;
+}
+
+const char *StepStats::phaseName(int phase)
+{
+	return phase >= 0 && phase < PHASE_COUNT ? phaseNames[phase] : "?";
+}
+
+void StepStats::print(ostream &out) const
+{
+	double perStep = steps > 0 ? 1e3 / steps : 0.0;
+	ios::fmtflags flags = out.flags();
+	out << fixed << setprecision(4);
+	out << "step stats over " << steps << " steps (ms/step)" << endl;
+	for (int i = 0; i < PHASE_COUNT; i++) {
+		out << "  " << left << setw(14) << phaseNames[i] << right << setw(10) << seconds[i] * perStep << endl;
+	}
+	out << "  " << left << setw(14) << "step" << right << setw(10) << stepSeconds * perStep << endl;
+	out.flags(flags);
+}
+
+void StepStats::writeCsvHeader(ostream &out)
+{
+	out << "step,steps";
+	for (int i = 0; i < PHASE_COUNT; i++) {
+		out << "," << phaseNames[i];
+	}
+	out << ",total" << endl;
+}
+
+void StepStats::writeCsvRow(ostream &out, long step) const
+{
+	// Seconds summed over the rows' steps, so rows with different step
+	// counts can still be added up
+	out << step << "," << steps;
+	for (int i = 0; i < PHASE_COUNT; i++) {
+		out << "," << seconds[i];
+	}
+	out << "," << stepSeconds << endl;
+}
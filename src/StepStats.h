@@ -0,0 +1,96 @@
+#pragma once
+#ifndef StepStats_H
+#define StepStats_H
+
+#include <chrono>
+#include <ostream>
+
+// Phases of a body step, in the order they run
+enum StepPhase {
+	PHASE_WIND,
+	PHASE_INTEGRATE,
+	PHASE_SPRINGS,
+	PHASE_VOLUMES,
+	PHASE_BROADPHASE,
+	PHASE_SPHERES,
+	PHASE_PLANES,
+	PHASE_CYLINDERS,
+	PHASE_POLYTOPES, // tetrahedrons and convex polytopes
+	PHASE_COLLIDERS, // fused pass over all colliders
+	PHASE_VELOCITY,
+	PHASE_SELF_COLLISION, // Scene::step, between cloths
+	PHASE_COUNT
+};
+
+/**
+ * Accumulated wall time per step phase. Only filled in when the sim library
+ * is built with SIM_PROFILE defined (cmake -DPROFILE=ON); otherwise the
+ * timers compile to nothing and every field stays zero.
+ */
+struct StepStats
+{
+#ifdef SIM_PROFILE
+	static constexpr bool enabled = true;
+#else
+	static constexpr bool enabled = false;
+#endif
+
+	double seconds[PHASE_COUNT];
+	double stepSeconds; // wall time of whole steps, including untimed work
+	long steps;
+
+	StepStats() { clear(); }
+	void clear();
+
+	StepStats &operator+=(const StepStats &o);
+	StepStats operator-(const StepStats &o) const;
+
+	static const char *phaseName(int phase);
+	// Per-step averages in milliseconds
+	void print(std::ostream &out) const;
+	static void writeCsvHeader(std::ostream &out);
+	void writeCsvRow(std::ostream &out, long step) const;
+};
+
+/**
+ * Charges the time since the previous lap to a phase. Construct one at the
+ * top of a step; the destructor counts the step and its total time.
+ */
+class StepTimer
+{
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	StepTimer(StepStats &stats) : stats(stats), start(Clock::now()), last(start) {}
+	~StepTimer()
+	{
+		stats.stepSeconds += std::chrono::duration<double>(Clock::now() - start).count();
+		stats.steps++;
+	}
+
+	void lap(StepPhase phase)
+	{
+		Clock::time_point now = Clock::now();
+		stats.seconds[phase] += std::chrono::duration<double>(now - last).count();
+		last = now;
+	}
+	// Starts the next phase without charging the time since the last lap
+	void skip() { last = Clock::now(); }
+
+private:
+	StepStats &stats;
+	Clock::time_point start;
+	Clock::time_point last;
+};
+
+#ifdef SIM_PROFILE
+#define STEP_TIMER_BEGIN(stats) StepTimer stepTimer(stats)
+#define STEP_TIMER_LAP(phase) stepTimer.lap(phase)
+#define STEP_TIMER_SKIP() stepTimer.skip()
+#else
+#define STEP_TIMER_BEGIN(stats) ((void)0)
+#define STEP_TIMER_LAP(phase) ((void)0)
+#define STEP_TIMER_SKIP() ((void)0)
+#endif
+
+#endif
@@ -0,0 +1,224 @@
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+
+#include "TetMesh.h"
+#include "MappedFile.h"
+
+using namespace std;
+using namespace Eigen;
+
+namespace
+{
+
+// Whitespace separated tokens of a mapped file. Line breaks only matter
+// for error messages and '#' comments, since TetGen's headers give the
+// number of values on every line.
+class TokenReader
+{
+public:
+	TokenReader(const MappedFile &file, const string &path) :
+		p(file.data()),
+		end(file.data() + file.size()),
+		path(path),
+		lineNumber(1)
+	{
+	}
+
+	bool integer(int &v)
+	{
+		const char *start, *stop;
+		if (!token(start, stop)) {
+			return false;
+		}
+		bool negative = *start == '-';
+		const char *c = start + (negative || *start == '+');
+		if (c == stop) {
+			return fail(start, stop, "expected an integer");
+		}
+		long long value = 0;
+		for (; c < stop; c++) {
+			if (*c < '0' || *c > '9' || value > 0x7fffffff) {
+				return fail(start, stop, "expected an integer");
+			}
+			value = value * 10 + (*c - '0');
+		}
+		v = int(negative ? -value : value);
+		return true;
+	}
+
+	bool number(double &v)
+	{
+		const char *start, *stop;
+		if (!token(start, stop)) {
+			return false;
+		}
+		// strtod needs a terminator, which the mapped file does not have
+		char buf[64];
+		size_t n = stop - start;
+		if (n >= sizeof(buf)) {
+			return fail(start, stop, "expected a number");
+		}
+		memcpy(buf, start, n);
+		buf[n] = '\0';
+		char *after;
+		v = strtod(buf, &after);
+		if (after != buf + n) {
+			return fail(start, stop, "expected a number");
+		}
+		return true;
+	}
+
+	// Skips the optional attributes and boundary marker of a line
+	bool skip(int count)
+	{
+		const char *start, *stop;
+		for (int k = 0; k < count; k++) {
+			if (!token(start, stop)) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	bool error(const char *message)
+	{
+		cerr << path << ":" << lineNumber << ": " << message << endl;
+		return false;
+	}
+
+private:
+	bool token(const char *&start, const char *&stop)
+	{
+		while (p < end) {
+			if (*p == '\n') {
+				lineNumber++;
+			}
+			else if (*p == '#') {
+				const char *newline = static_cast<const char *>(memchr(p, '\n', end - p));
+				p = newline ? newline : end;
+				continue;
+			}
+			else if (*p != ' ' && *p != '\t' && *p != '\r') {
+				break;
+			}
+			p++;
+		}
+		if (p == end) {
+			return error("unexpected end of file");
+		}
+		start = p;
+		while (p < end && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n' && *p != '#') {
+			p++;
+		}
+		stop = p;
+		return true;
+	}
+
+	bool fail(const char *start, const char *stop, const char *message)
+	{
+		cerr << path << ":" << lineNumber << ": " << message << ", got '" << string(start, stop) << "'" << endl;
+		return false;
+	}
+
+	const char *p;
+	const char *end;
+	const string &path;
+	int lineNumber;
+};
+
+}
+
+bool TetMesh::read(const string &base)
+{
+	string stem = base;
+	for (const char *ext : { ".node", ".ele" }) {
+		size_t n = strlen(ext);
+		if (stem.size() > n && stem.compare(stem.size() - n, n, ext) == 0) {
+			stem.resize(stem.size() - n);
+			break;
+		}
+	}
+	nodes.clear();
+	tets.clear();
+
+	// <# of points> <dimension (3)> <# of attributes> <boundary markers (0 or 1)>
+	// <point #> <x> <y> <z> [attributes] [boundary marker]
+	string nodePath = stem + ".node";
+	MappedFile nodeFile;
+	if (!nodeFile.open(nodePath)) {
+		return false;
+	}
+	TokenReader in(nodeFile, nodePath);
+	int nNodes, dim, nAttributes, nMarkers;
+	if (!in.integer(nNodes) || !in.integer(dim) || !in.integer(nAttributes) || !in.integer(nMarkers)) {
+		return false;
+	}
+	if (nNodes <= 0 || dim != 3 || nAttributes < 0 || nMarkers < 0 || nMarkers > 1) {
+		return in.error("expected a 3D point count, attribute count and 0 or 1 boundary markers");
+	}
+	nodes.resize(nNodes);
+	int first = 0;
+	for (int i = 0; i < nNodes; i++) {
+		int index;
+		Vector3d &x = nodes[i];
+		if (!in.integer(index) || !in.number(x(0)) || !in.number(x(1)) || !in.number(x(2)) ||
+			!in.skip(nAttributes + nMarkers)) {
+			return false;
+		}
+		if (i == 0) {
+			first = index;
+		}
+		if (index != first + i || first < 0 || first > 1) {
+			return in.error("points must be numbered consecutively from 0 or 1");
+		}
+	}
+	nodeFile.close();
+
+	// <# of tetrahedra> <nodes per tetrahedron (4 or 10)> <# of attributes>
+	// <tetrahedron #> <node> <node> ... [attributes]
+	string elePath = stem + ".ele";
+	MappedFile eleFile;
+	if (!eleFile.open(elePath)) {
+		return false;
+	}
+	TokenReader ein(eleFile, elePath);
+	int nTets, nCorners, nTetAttributes;
+	if (!ein.integer(nTets) || !ein.integer(nCorners) || !ein.integer(nTetAttributes)) {
+		return false;
+	}
+	if (nTets <= 0 || (nCorners != 4 && nCorners != 10) || nTetAttributes < 0) {
+		return ein.error("expected a tetrahedron count, 4 or 10 nodes per tetrahedron and an attribute count");
+	}
+	tets.resize(size_t(nTets) * 4);
+	for (int t = 0; t < nTets; t++) {
+		int index;
+		if (!ein.integer(index)) {
+			return false;
+		}
+		int *v = &tets[size_t(t) * 4];
+		for (int k = 0; k < 4; k++) {
+			if (!ein.integer(v[k])) {
+				return false;
+			}
+			v[k] -= first;
+			if (v[k] < 0 || v[k] >= nNodes) {
+				return ein.error("node index out of range");
+			}
+		}
+		if (v[0] == v[1] || v[0] == v[2] || v[0] == v[3] || v[1] == v[2] || v[1] == v[3] || v[2] == v[3]) {
+			return ein.error("tetrahedron with a repeated node");
+		}
+		if (!ein.skip(nCorners - 4 + nTetAttributes)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void TetMesh::transform(double scale, const Vector3d &offset)
+{
+	for (Vector3d &x : nodes) {
+		x = scale * x + offset;
+	}
+}
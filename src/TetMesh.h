@@ -0,0 +1,31 @@
+#pragma once
+#ifndef TetMesh_H
+#define TetMesh_H
+
+#include <string>
+#include <vector>
+
+#define EIGEN_DONT_ALIGN_STATICALLY
+#include <Eigen/Dense>
+
+/**
+ * Tetrahedral mesh read from TetGen's .node and .ele files. The files are
+ * mapped and parsed in one pass without copying lines, so meshes with
+ * millions of tetrahedra load in seconds. Indices may start at 0 or 1 (the
+ * first node decides); ten-node tetrahedra keep their four corners.
+ */
+class TetMesh
+{
+public:
+	// base is the path without extension, or the .node or .ele file.
+	// Returns false and prints the file and line of the first error.
+	bool read(const std::string &base);
+
+	// x -> scale * x + offset
+	void transform(double scale, const Eigen::Vector3d &offset);
+
+	std::vector<Eigen::Vector3d> nodes;
+	std::vector<int> tets; // four node indices per tetrahedron, from 0
+};
+
+#endif
@@ -1,7 +1,7 @@
 #include "Tetrahedron.h"
 
-Tetrahedron::Tetrahedron(const std::shared_ptr<Shape> shape) : 
-	tetrahedron(shape)
+Tetrahedron::Tetrahedron() :
+	cached(false)
 {
 	x = { {
 		Eigen::Vector3d(0.0, 0.0, 0.0),
@@ -19,38 +19,7 @@ Tetrahedron::Tetrahedron(const std::shared_ptr<Shape> shape) :
 	faceOppositeIndices = { {
 		3, 1, 2, 0
 	} };
-}
-
-void Tetrahedron::draw(std::shared_ptr<MatrixStack> M, const std::shared_ptr<Program> prog) const {
-	if (tetrahedron) {
-		int kdFrontID = prog->getUniform("kdFront");
-		if (kdFrontID != -1) {
-			glUniform3f(kdFrontID, 0.8f, 0.8f, 0.8f);
-		}
-		int kdBackID = prog->getUniform("kdBack");
-		if (kdBackID != -1) {
-			glUniform3f(kdBackID, 0.0f, 0.0f, 0.0f);
-		}
-
-		M->pushMatrix();
-		
-		glm::vec3 p0(x[0].x(), x[0].y(), x[0].z());
-		glm::vec3 p1(x[1].x(), x[1].y(), x[1].z());
-		glm::vec3 p2(x[2].x(), x[2].y(), x[2].z());
-		glm::vec3 p3(x[3].x(), x[3].y(), x[3].z());
-
-		glm::mat4 transform = glm::identity<glm::mat4>();
-		transform[0] = glm::vec4(p1 - p0, 0.0f);
-		transform[1] = glm::vec4(p2 - p0, 0.0f);
-		transform[2] = glm::vec4(p3 - p0, 0.0f);
-		transform[3] = glm::vec4(p0, 1.0f);
-		
-		M->multMatrix(transform);
-		
-		glUniformMatrix4fv(prog->getUniform("M"), 1, GL_FALSE, glm::value_ptr(M->topMatrix()));
-		tetrahedron->draw(prog);
-		M->popMatrix();
-	}
+	update();
 }
 
 std::array<Face, 4> Tetrahedron::getFaces() const {
@@ -71,4 +40,16 @@ std::array<Face, 4> Tetrahedron::getFaces() const {
 		};
 	}
 	return faces;
-}
\ No newline at end of file
+}
+
+void Tetrahedron::update()
+{
+	if (cached && x == cachedX) {
+		return;
+	}
+	std::vector<Eigen::Vector3d> vertices(x.begin(), x.end());
+	std::vector< std::array<int, 3> > tris(faceIndices.begin(), faceIndices.end());
+	polytope.build(vertices, tris);
+	cachedX = x;
+	cached = true;
+}
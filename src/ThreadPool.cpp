@@ -0,0 +1,125 @@
+#include <algorithm>
+
+#include "ThreadPool.h"
+
+using namespace std;
+
+static thread_local int tlsWorker = 0;
+static thread_local bool tlsInPool = false;
+
+ThreadPool::ThreadPool(int nThreads) :
+	job(nullptr),
+	jobN(0),
+	jobGrain(1),
+	numChunks(0),
+	nextChunk(0),
+	busy(0),
+	generation(0),
+	quit(false)
+{
+	if (nThreads <= 0) {
+		nThreads = max(1, (int)thread::hardware_concurrency());
+	}
+	for (int i = 1; i < nThreads; i++) {
+		workers.emplace_back(&ThreadPool::workerLoop, this, i);
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		lock_guard<std::mutex> lock(mutex);
+		quit = true;
+	}
+	wake.notify_all();
+	for (thread &t : workers) {
+		t.join();
+	}
+}
+
+int ThreadPool::workerIndex()
+{
+	return tlsWorker;
+}
+
+void ThreadPool::parallelFor(ThreadPool *pool, int n, const RangeFn &fn, int grain)
+{
+	if (pool) {
+		pool->parallelFor(n, fn, grain);
+	}
+	else if (n > 0) {
+		fn(0, n, tlsWorker);
+	}
+}
+
+void ThreadPool::parallelFor(int n, const RangeFn &fn, int grain)
+{
+	if (n <= 0) {
+		return;
+	}
+	grain = max(1, grain);
+	if (workers.empty() || n <= grain || tlsInPool) {
+		fn(0, n, tlsWorker);
+		return;
+	}
+
+	lock_guard<std::mutex> submitLock(submitMutex);
+	{
+		lock_guard<std::mutex> lock(mutex);
+		job = &fn;
+		jobN = n;
+		jobGrain = grain;
+		numChunks = (n + grain - 1) / grain;
+		nextChunk = 0;
+		busy = (int)workers.size();
+		++generation;
+	}
+	wake.notify_all();
+
+	tlsInPool = true;
+	runChunks(0);
+	tlsInPool = false;
+
+	unique_lock<std::mutex> lock(mutex);
+	done.wait(lock, [this] { return busy == 0; });
+	job = nullptr;
+}
+
+void ThreadPool::runChunks(int worker)
+{
+	int prevWorker = tlsWorker;
+	tlsWorker = worker;
+	for (;;) {
+		int chunk = nextChunk.fetch_add(1);
+		if (chunk >= numChunks) {
+			break;
+		}
+		int begin = chunk * jobGrain;
+		int end = min(jobN, begin + jobGrain);
+		(*job)(begin, end, worker);
+	}
+	tlsWorker = prevWorker;
+}
+
+void ThreadPool::workerLoop(int id)
+{
+	tlsInPool = true;
+	unsigned long seen = 0;
+	for (;;) {
+		{
+			unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [&] { return quit || generation != seen; });
+			if (quit) {
+				return;
+			}
+			seen = generation;
+		}
+		runChunks(id);
+		{
+			lock_guard<std::mutex> lock(mutex);
+			if (--busy == 0) {
+				done.notify_one();
+			}
+		}
+	}
+}
@@ -0,0 +1,56 @@
+#pragma once
+#ifndef ThreadPool_H
+#define ThreadPool_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <memory>
+
+/**
+ * Persistent pool of worker threads for data-parallel loops. The calling
+ * thread takes part in every loop, so a pool of size 1 has no workers and
+ * runs everything inline. Nested calls from inside a worker run serially.
+ */
+class ThreadPool
+{
+public:
+	// fn(begin, end, worker), worker in [0, size())
+	typedef std::function<void(int, int, int)> RangeFn;
+
+	// nThreads <= 0 picks the hardware concurrency
+	ThreadPool(int nThreads = 0);
+	virtual ~ThreadPool();
+
+	int size() const { return (int)workers.size() + 1; }
+	void parallelFor(int n, const RangeFn &fn, int grain = 256);
+
+	// Runs on pool if there is one, otherwise inline as worker 0
+	static void parallelFor(ThreadPool *pool, int n, const RangeFn &fn, int grain = 256);
+	// Index of the calling thread within its pool, 0 outside of any pool
+	static int workerIndex();
+
+private:
+	void workerLoop(int id);
+	void runChunks(int worker);
+
+	std::vector<std::thread> workers;
+	std::mutex submitMutex;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+
+	const RangeFn *job;
+	int jobN;
+	int jobGrain;
+	int numChunks;
+	std::atomic<int> nextChunk;
+	int busy;
+	unsigned long generation;
+	bool quit;
+};
+
+#endif
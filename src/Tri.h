@@ -3,21 +3,8 @@
 
 struct Tri {
 	int index0, index1, index2;
-	std::shared_ptr<Particle> vertexParticles[3];
-	std::shared_ptr<Spring> edgeSprings[3];
-	bool broken;
-	bool getBroken() {
-		if (broken) {
-			return true;
-		}
-
-		if (edgeSprings[0]->broken || edgeSprings[1]->broken || edgeSprings[2]->broken) {
-			broken = true;
-			return true;
-		}
-
-		return false;
-	}
+	int edgeSprings[3]; // indices into the body's ConstraintTable
+	bool broken = false; // set when one of the edge springs breaks
 };
 
 struct Quad {
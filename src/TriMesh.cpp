@@ -0,0 +1,82 @@
+#include <iostream>
+
+#include "TriMesh.h"
+
+#define TINYOBJLOADER_IMPLEMENTATION
+#include "tiny_obj_loader.h"
+
+using namespace std;
+using namespace Eigen;
+
+bool TriMesh::read(const string &path)
+{
+	nodes.clear();
+	tris.clear();
+	texcoords.clear();
+
+	tinyobj::attrib_t attrib;
+	vector<tinyobj::shape_t> shapes;
+	vector<tinyobj::material_t> materials;
+	string errStr;
+	if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &errStr, path.c_str())) {
+		cerr << errStr << endl;
+		return false;
+	}
+
+	// Positions are renumbered in order of first use
+	int nPositions = int(attrib.vertices.size() / 3);
+	vector<int> nodeOf(nPositions, -1);
+	bool hasTexcoords = !attrib.texcoords.empty();
+	for (const tinyobj::shape_t &shape : shapes) {
+		const vector<tinyobj::index_t> &indices = shape.mesh.indices;
+		size_t offset = 0;
+		for (unsigned char fv : shape.mesh.num_face_vertices) {
+			const tinyobj::index_t *corners = &indices[offset];
+			offset += fv;
+			if (fv != 3) {
+				continue;
+			}
+			int v[3];
+			for (int k = 0; k < 3; k++) {
+				v[k] = corners[k].vertex_index;
+				if (v[k] < 0 || v[k] >= nPositions) {
+					cerr << path << ": vertex index out of range" << endl;
+					return false;
+				}
+			}
+			if (v[0] == v[1] || v[0] == v[2] || v[1] == v[2]) {
+				continue;
+			}
+			for (int k = 0; k < 3; k++) {
+				int &node = nodeOf[v[k]];
+				if (node < 0) {
+					node = int(nodes.size());
+					const float *x = &attrib.vertices[3 * v[k]];
+					nodes.push_back(Vector3d(x[0], x[1], x[2]));
+					int vt = corners[k].texcoord_index;
+					hasTexcoords = hasTexcoords && vt >= 0 && 2 * vt + 1 < int(attrib.texcoords.size());
+					if (hasTexcoords) {
+						texcoords.push_back(attrib.texcoords[2 * vt + 0]);
+						texcoords.push_back(attrib.texcoords[2 * vt + 1]);
+					}
+				}
+				tris.push_back(node);
+			}
+		}
+	}
+	if (!hasTexcoords) {
+		texcoords.clear();
+	}
+	if (tris.empty()) {
+		cerr << path << ": no triangles" << endl;
+		return false;
+	}
+	return true;
+}
+
+void TriMesh::transform(double scale, const Vector3d &offset)
+{
+	for (Vector3d &x : nodes) {
+		x = scale * x + offset;
+	}
+}
@@ -0,0 +1,31 @@
+#pragma once
+#ifndef TriMesh_H
+#define TriMesh_H
+
+#include <string>
+#include <vector>
+
+#define EIGEN_DONT_ALIGN_STATICALLY
+#include <Eigen/Dense>
+
+/**
+ * Triangle mesh read from an OBJ file with tiny_obj_loader. Corners with
+ * the same position index share a vertex, so texture or normal seams do not
+ * split the mesh. Polygons are triangulated, and degenerate triangles and
+ * unused positions are dropped.
+ */
+class TriMesh
+{
+public:
+	// Returns false and prints the loader's error
+	bool read(const std::string &path);
+
+	// x -> scale * x + offset
+	void transform(double scale, const Eigen::Vector3d &offset);
+
+	std::vector<Eigen::Vector3d> nodes;
+	std::vector<int> tris;        // three node indices per triangle, from 0
+	std::vector<float> texcoords; // two per node, empty if the file has none
+};
+
+#endif
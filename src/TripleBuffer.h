@@ -0,0 +1,50 @@
+#pragma once
+#ifndef TripleBuffer_H
+#define TripleBuffer_H
+
+#include <atomic>
+
+/**
+ * Single-producer, single-consumer triple buffer. The producer fills
+ * writeBuffer() and publishes it; the consumer acquires the most recently
+ * published buffer. Both sides only swap slot indices through one atomic,
+ * so neither ever waits for the other, and the consumer never sees a
+ * buffer while it is being written.
+ */
+template <typename T>
+class TripleBuffer
+{
+public:
+	TripleBuffer() : back(0), middle(1), front(2) {}
+
+	// Producer side
+	T &writeBuffer() { return slots[back]; }
+	void publish()
+	{
+		unsigned prev = middle.exchange(back | FRESH, std::memory_order_acq_rel);
+		back = prev & INDEX;
+	}
+
+	// Consumer side. Returns true if a newer buffer was picked up.
+	bool acquire()
+	{
+		if ((middle.load(std::memory_order_relaxed) & FRESH) == 0) {
+			return false;
+		}
+		unsigned prev = middle.exchange(front, std::memory_order_acq_rel);
+		front = prev & INDEX;
+		return true;
+	}
+	const T &readBuffer() const { return slots[front]; }
+
+private:
+	static const unsigned INDEX = 3;
+	static const unsigned FRESH = 4;
+
+	T slots[3];
+	unsigned back;                // owned by the producer
+	std::atomic<unsigned> middle; // slot index, plus FRESH if unread
+	unsigned front;               // owned by the consumer
+};
+
+#endif
@@ -3,11 +3,13 @@
 #include <stdlib.h>
 #include <iostream>
 #include <vector>
+#include <cmath>
 
 #ifndef _GLIBCXX_USE_NANOSLEEP
 #define _GLIBCXX_USE_NANOSLEEP
 #endif
 #include <thread>
+#include <mutex>
 
 #define GLEW_STATIC
 #include <GL/glew.h>
@@ -23,6 +25,8 @@
 #include "MatrixStack.h"
 #include "Shape.h"
 #include "Scene.h"
+#include "SceneRenderer.h"
+#include "FrameFile.h"
 
 using namespace std;
 using namespace Eigen;
@@ -31,11 +35,15 @@ bool keyToggles[256] = {false}; // only for English keyboards!
 
 GLFWwindow *window; // Main application window
 string RESOURCE_DIR = ""; // Where the resources are loaded from
+string SCENE_PATH = ""; // Scene file, or empty for the default scene
+string FRAMES_PATH = ""; // Recording to play back instead of simulating
+string RECORD_PATH = ""; // Replay log to record the session to (-w)
 
 shared_ptr<Camera> camera;
 shared_ptr<Program> prog;
 shared_ptr<Program> depthProg;
 shared_ptr<Scene> scene;
+shared_ptr<SceneRenderer> sceneRenderer;
 
 // TODO: dot product with tris and also area
 // TODO: make sure shear and nonuniform scale is not used, mvit is not available currently
@@ -44,6 +52,25 @@ shared_ptr<Scene> scene;
 
 // https://stackoverflow.com/questions/41470942/stop-infinite-loop-in-different-thread
 std::atomic<bool> stop_flag;
+// Keyboard commands for the scene ('h', 'r', '0', '1', '2'). They run on
+// the stepper thread so that it stays the only writer of the scene and of
+// body snapshots, and so that they are recorded in step order.
+// The camera pose goes the same way: the main thread owns the camera and
+// leaves its pose here for the stepper to place held objects with.
+std::mutex key_mutex;
+std::vector<char> key_queue;
+Vector3d viewEye(0.0, 0.0, 0.0);
+Vector3d viewForward(0.0, 0.0, 1.0);
+
+// Playback mode (-p frames.bin): bodies are drawn from a recording made
+// by sim_bench -F (of the same scene, -s) and the scene is never stepped.
+// Only touched on the main thread. Space plays and pauses, ',' and '.'
+// step one frame, '[' and ']' jump a tenth of the recording, '-' and '='
+// halve and double the rate.
+shared_ptr<FrameFile> frameFile;
+double playbackFrame = 0.0; // fractional, advanced in recorded sim time
+double playbackRate = 1.0;  // sim seconds per wall second
+double playbackClock = 0.0;
 
 static void error_callback(int error, const char *description)
 {
@@ -58,25 +85,68 @@ static void key_callback(GLFWwindow *window, int key, int scancode, int action,
 	}
 }
 
+// Main thread: leaves the current camera pose for the stepper
+static void shareViewpoint()
+{
+	glm::vec3 eye = camera->getTranslation();
+	glm::vec3 forward = camera->getForward();
+	lock_guard<mutex> lock(key_mutex);
+	viewEye = Vector3d(eye.x, eye.y, eye.z);
+	viewForward = Vector3d(forward.x, forward.y, forward.z);
+}
+
+// Moves the playback position, wrapping around the ends of the recording
+static void seekPlayback(double frame)
+{
+	double n = double(frameFile->getFrameCount());
+	playbackFrame = fmod(frame, n);
+	if(playbackFrame < 0.0) {
+		playbackFrame += n;
+	}
+}
+
+static void playbackKey(unsigned int key)
+{
+	double n = double(frameFile->getFrameCount());
+	switch(key) {
+		case ',':
+			seekPlayback(floor(playbackFrame) - 1.0);
+			break;
+		case '.':
+			seekPlayback(floor(playbackFrame) + 1.0);
+			break;
+		case '[':
+			seekPlayback(playbackFrame - 0.1 * n);
+			break;
+		case ']':
+			seekPlayback(playbackFrame + 0.1 * n);
+			break;
+		case '-':
+			playbackRate *= 0.5;
+			break;
+		case '=':
+			playbackRate *= 2.0;
+			break;
+	}
+}
+
 static void char_callback(GLFWwindow *window, unsigned int key)
 {
 	keyToggles[key] = !keyToggles[key];
+	if(frameFile) {
+		playbackKey(key);
+		return;
+	}
 	switch(key) {
 		case 'h':
-			scene->step(camera);
-			break;
 		case 'r':
-			scene->reset();
-			break;
 		case '0':
-			scene->setHeldObject(NONE, camera);
-			break;
 		case '1':
-			scene->setHeldObject(SPHERE, camera);
-			break;
-		case '2':
-			scene->setHeldObject(TETRAHEDRON, camera);
+		case '2': {
+			lock_guard<mutex> lock(key_mutex);
+			key_queue.push_back((char)key);
 			break;
+		}
 	}
 }
 
@@ -104,7 +174,7 @@ void mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
 	}
 }
 
-static void init()
+static bool init()
 {
 	GLSL::checkVersion();
 	
@@ -130,6 +200,7 @@ static void init()
 	prog->addUniform("shadowMap");
 	prog->addAttribute("aPos");
 	prog->addAttribute("aNor");
+	prog->addAttribute("aInstance");
 	prog->setVerbose(false);
 
 	depthProg = make_shared<Program>();
@@ -138,26 +209,67 @@ static void init()
 	depthProg->addUniform("lightVP");
 	depthProg->addUniform("M");
 	depthProg->addAttribute("aPos");
+	depthProg->addAttribute("aInstance");
 	depthProg->setVerbose(false);
 
 	depthProg->initFrameBuffer(8192, 8192, true);
 	
 	camera = make_shared<Camera>();
 	camera->setTranslation(glm::vec3(0.0f, 1.0f, -2.0f));
+	shareViewpoint();
 
 	scene = make_shared<Scene>();
-	scene->load(RESOURCE_DIR);
+	if(SCENE_PATH.empty()) {
+		scene->load();
+	}
+	else if(!scene->load(SCENE_PATH)) {
+		return false;
+	}
 	scene->tare();
 	scene->init();
+	scene->publish(); // the stepper has not started yet
+
+	sceneRenderer = make_shared<SceneRenderer>(scene);
+	sceneRenderer->load(RESOURCE_DIR);
+	sceneRenderer->init();
 	
 	// If there were any OpenGL errors, this will print something.
 	// You can intersperse this line in your code to find the exact location
 	// of your OpenGL error.
 	GLSL::checkError(GET_FILE_LINE);
+	return true;
+}
+
+// Advances the playback by the wall time since the last frame and shows
+// the current recorded frame
+static void updatePlayback()
+{
+	double now = glfwGetTime();
+	double elapsed = now - playbackClock;
+	playbackClock = now;
+	if(keyToggles[(unsigned)' ']) {
+		double frameSeconds = frameFile->getTimeStep() * frameFile->getInterval();
+		seekPlayback(playbackFrame + elapsed * playbackRate / frameSeconds);
+	}
+	size_t f = size_t(playbackFrame);
+	sceneRenderer->showFrame(f);
+
+	char title[128];
+	snprintf(title, sizeof(title), "Kyle Palermo - playback %zu/%zu, t = %.3f s, %gx%s", f + 1,
+		frameFile->getFrameCount(), frameFile->getTime(f), playbackRate, keyToggles[(unsigned)' '] ? "" : " (paused)");
+	glfwSetWindowTitle(window, title);
 }
 
 void render()
 {
+	// Pick up the latest simulation state once, so both passes agree
+	if(frameFile) {
+		updatePlayback();
+	}
+	else {
+		sceneRenderer->update();
+	}
+
 	// Pass 1
 	auto P = make_shared<MatrixStack>();
 	auto V = make_shared<MatrixStack>();
@@ -180,7 +292,7 @@ void render()
 
 	depthProg->bind();
 	glUniformMatrix4fv(depthProg->getUniform("lightVP"), 1, GL_FALSE, glm::value_ptr(lightVP));
-	scene->draw(M, depthProg);
+	sceneRenderer->draw(M, depthProg);
 	depthProg->unbind();
 	depthProg->unbindFrameBuffer();
 	P->popMatrix();
@@ -196,6 +308,7 @@ void render()
 	glfwGetWindowSize(window, &width, &height);
 	camera->setAspect((float)width/(float)height);
 	camera->pollKeyPresses(window);
+	shareViewpoint();
 	
 	// Clear buffers
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -226,7 +339,7 @@ void render()
 	glUniform3fv(prog->getUniform("lightPos"), 1, glm::value_ptr(lightEye));
 	glActiveTexture(GL_TEXTURE0);
 	glBindTexture(GL_TEXTURE_2D, depthProg->getTextureID());
-	scene->draw(M, prog);
+	sceneRenderer->draw(M, prog);
 	prog->unbind();
 	
 	//////////////////////////////////////////////////////
@@ -249,10 +362,28 @@ void stepperFunc()
 	auto nextStepTime = std::chrono::high_resolution_clock::now();
 
 	while(!stop_flag) {
+		vector<char> keys;
+		Vector3d eye, forward;
+		{
+			lock_guard<mutex> lock(key_mutex);
+			keys.swap(key_queue);
+			eye = viewEye;
+			forward = viewForward;
+		}
+		for(char key : keys) {
+			scene->setViewpoint(eye, forward);
+			scene->pressKey(key);
+			if(key == 'h') {
+				scene->step();
+			}
+			scene->publish();
+		}
 		if(keyToggles[(unsigned)' ']) {
 			auto now = std::chrono::high_resolution_clock::now();
 			if (now >= nextStepTime) {
-				scene->step(camera);
+				scene->setViewpoint(eye, forward);
+				scene->step();
+				scene->publish();
 				nextStepTime += stepInterval;
 			}
 			else {
@@ -265,6 +396,11 @@ void stepperFunc()
 	}
 }
 
+static void usage(const char *argv0)
+{
+	cout << "Usage: " << argv0 << " RESOURCE_DIR [-s scene] [-p frames.bin | -w record.log]" << endl;
+}
+
 int main(int argc, char **argv)
 {
 	if(argc < 2) {
@@ -272,6 +408,27 @@ int main(int argc, char **argv)
 		return 0;
 	}
 	RESOURCE_DIR = argv[1] + string("/");
+	for(int i = 2; i < argc; ++i) {
+		string arg = argv[i];
+		if(arg == "-s" && i + 1 < argc) {
+			SCENE_PATH = argv[++i];
+		}
+		else if(arg == "-p" && i + 1 < argc) {
+			FRAMES_PATH = argv[++i];
+		}
+		else if(arg == "-w" && i + 1 < argc) {
+			RECORD_PATH = argv[++i];
+		}
+		else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	// Playback never steps the scene, so there would be nothing to record
+	if(!FRAMES_PATH.empty() && !RECORD_PATH.empty()) {
+		usage(argv[0]);
+		return 1;
+	}
 	
 	// Set error callback.
 	glfwSetErrorCallback(error_callback);
@@ -307,10 +464,29 @@ int main(int argc, char **argv)
 	// Set mouse button callback.
 	glfwSetMouseButtonCallback(window, mouse_button_callback);
 	// Initialize scene.
-	init();
+	if(!init()) {
+		return -1;
+	}
+	if(!FRAMES_PATH.empty()) {
+		// Play back a recording instead of simulating
+		frameFile = make_shared<FrameFile>();
+		if(!frameFile->open(FRAMES_PATH) || frameFile->getFrameCount() == 0 || !sceneRenderer->setFrameFile(frameFile)) {
+			cerr << "Cannot play " << FRAMES_PATH << endl;
+			return -1;
+		}
+		playbackClock = glfwGetTime();
+		keyToggles[(unsigned)' '] = true;
+	}
+	// Optionally record the session for sim_bench -r
+	else if(!RECORD_PATH.empty() && !scene->startRecording(RECORD_PATH)) {
+		return -1;
+	}
 	// Start simulation thread.
 	stop_flag = false;
-	thread stepperThread(stepperFunc);
+	thread stepperThread;
+	if(!frameFile) {
+		stepperThread = thread(stepperFunc);
+	}
 	// Loop until the user closes the window.
 	while(!glfwWindowShouldClose(window)) {
 		if(!glfwGetWindowAttrib(window, GLFW_ICONIFIED)) {
@@ -324,7 +500,9 @@ int main(int argc, char **argv)
 	}
 	// Quit program.
 	stop_flag = true;
-	stepperThread.join();
+	if(stepperThread.joinable()) {
+		stepperThread.join();
+	}
 	glfwDestroyWindow(window);
 	glfwTerminate();
 	return 0;